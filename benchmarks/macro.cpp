@@ -0,0 +1,51 @@
+#include <benchmark/benchmark.h>
+
+#include <optional>
+
+#include "System.hpp"
+#include "scenes.hpp"
+
+
+/* Whole System::step over the procedural scenes. Every iteration rebuilds the scene outside
+   the timed region and then times a fixed number of steps from the same initial state, so
+   each iteration does identical work whatever iteration count the library picks. */
+constexpr size_t G_MACRO_STEPS { 50 };
+
+
+static void run_scene(benchmark::State& state, SceneType type)
+{
+    auto n = static_cast<size_t>(state.range(0));
+    size_t bodies = 0;
+
+    // Outlives the timed region, the previous scene is torn down while timing is paused
+    std::optional<System> system;
+
+    for (auto _ : state) {
+        state.PauseTiming();
+        system.reset();
+        system.emplace();
+        build_scene(*system, type, n);
+        bodies = system->get_rigid_bodies().size();
+        state.ResumeTiming();
+
+        for (size_t i = 0; i < G_MACRO_STEPS; ++i) {
+            system->step();
+        }
+
+        benchmark::ClobberMemory();
+    }
+
+    state.SetItemsProcessed(state.iterations() * G_MACRO_STEPS);
+    state.counters["bodies"] = static_cast<double>(bodies);
+}
+
+
+static void BM_BallPile(benchmark::State& state) { run_scene(state, BALL_PILE); }
+static void BM_BoxStack(benchmark::State& state) { run_scene(state, BOX_STACK); }
+static void BM_SpringGrid(benchmark::State& state) { run_scene(state, SPRING_GRID); }
+static void BM_PendulumChain(benchmark::State& state) { run_scene(state, PENDULUM_CHAIN); }
+
+BENCHMARK(BM_BallPile)->RangeMultiplier(4)->Range(64, 4096)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_BoxStack)->RangeMultiplier(4)->Range(16, 1024)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_SpringGrid)->RangeMultiplier(4)->Range(64, 16384)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_PendulumChain)->RangeMultiplier(4)->Range(16, 4096)->Unit(benchmark::kMillisecond);
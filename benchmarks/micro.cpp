@@ -0,0 +1,200 @@
+#include <cmath>
+#include <limits>
+#include <random>
+#include <vector>
+#include <benchmark/benchmark.h>
+
+#include "System.hpp"
+#include "OdeSolver.hpp"
+#include "collisions.hpp"
+#include "LinearSolver.hpp"
+#include "scenes.hpp"
+
+
+/* Microbenchmarks of the step hot paths, argument is the problem size. */
+
+static void build_packed_balls(System& system, size_t n)
+{
+    /* Square lattice of unit balls overlapping their four neighbours by less than the
+       penetration threshold, so every ball is in contact without any settling. */
+    auto side = static_cast<size_t>(std::ceil(std::sqrt(static_cast<double>(n))));
+    ShapeHandle ball = system.add_shape(circle_shape(0.5));
+
+    for (size_t i = 0; i < n; ++i) {
+        vector2 position { 0.995 * static_cast<double>(i % side), 0.995 * static_cast<double>(i / side) };
+        vector2 velocity { 0, 0 };
+        system.add_dynamic_body(1, ball, 0, 0, position, velocity);
+    }
+}
+
+
+static void build_packed_polygons(System& system, size_t n, size_t sides, double spacing)
+{
+    /* Square lattice of regular polygons of unit diameter at random angles. Spacing below one
+       leaves most neighbours touching, spacing one mostly separated with overlapping boxes. */
+    auto side = static_cast<size_t>(std::ceil(std::sqrt(static_cast<double>(n))));
+
+    std::vector<vector2> vertices;
+    for (size_t k = 0; k < sides; ++k) {
+        double t = -2 * M_PI * static_cast<double>(k) / static_cast<double>(sides);
+        vertices.push_back({ 0.5 * std::cos(t), 0.5 * std::sin(t) });
+    }
+    ShapeHandle polygon = system.add_shape(polygon_shape(std::move(vertices)));
+
+    std::mt19937 random { 7 };
+    std::uniform_real_distribution<double> angle { 0, 2 * M_PI };
+
+    for (size_t i = 0; i < n; ++i) {
+        vector2 position { spacing * static_cast<double>(i % side), spacing * static_cast<double>(i / side) };
+        vector2 velocity { 0, 0 };
+        system.add_dynamic_body(1, polygon, angle(random), 0, position, velocity);
+    }
+}
+
+
+static void BM_SortAndSweep(benchmark::State& state)
+{
+    System system;
+    build_packed_balls(system, static_cast<size_t>(state.range(0)));
+
+    for (auto _ : state) {
+        auto pairs = sort_and_sweep_aabb_boxes(system.get_rigid_bodies());
+        benchmark::DoNotOptimize(pairs.data());
+    }
+
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_SortAndSweep)->RangeMultiplier(4)->Range(256, 16384)->Unit(benchmark::kMicrosecond);
+
+
+static void BM_DetectCollisions(benchmark::State& state)
+{
+    System system;
+    build_packed_balls(system, static_cast<size_t>(state.range(0)));
+
+    std::vector<Contact> contacts;
+    CollisionCache cache;
+
+    for (auto _ : state) {
+        detect_collisions(system.get_rigid_bodies(), contacts, system.get_config().penetration_threshhold, &cache);
+        benchmark::DoNotOptimize(contacts.data());
+    }
+
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+    state.counters["contacts"] = static_cast<double>(contacts.size());
+}
+BENCHMARK(BM_DetectCollisions)->RangeMultiplier(4)->Range(256, 16384)->Unit(benchmark::kMicrosecond);
+
+
+static void BM_DetectPolygonCollisions(benchmark::State& state)
+{
+    /* Polygon narrowphase, arguments are the vertex count and the lattice spacing in percent
+       of the diameter. Deep contacts must not stop the pass early, so there is no threshold. */
+    System system;
+    build_packed_polygons(system, 4096, static_cast<size_t>(state.range(0)), static_cast<double>(state.range(1)) / 100);
+
+    std::vector<Contact> contacts;
+    CollisionCache cache;
+
+    for (auto _ : state) {
+        detect_collisions(system.get_rigid_bodies(), contacts, std::numeric_limits<double>::infinity(), &cache);
+        benchmark::DoNotOptimize(contacts.data());
+    }
+
+    state.counters["contacts"] = static_cast<double>(contacts.size());
+}
+BENCHMARK(BM_DetectPolygonCollisions)->ArgsProduct({ { 4, 8, 16 }, { 90, 100 } })->Unit(benchmark::kMicrosecond);
+
+
+static void BM_ResolveContact(benchmark::State& state)
+{
+    /* Two boxes approaching along the contact normal, the velocities are reset before every
+       resolution so each one applies the impulses. */
+    System system;
+    system.set_global_gravity_flag(false);
+
+    vector2 pa { 0, 0 }, pb { 0.99, 0.1 }, va { 1, 0 }, vb { -1, 0 };
+    RigidBody* a = system.add_dynamic_body(1, polygon_shape({ { -0.5, -0.5 }, { -0.5, 0.5 }, { 0.5, 0.5 }, { 0.5, -0.5 } }), 0, 0, pa, va);
+    RigidBody* b = system.add_dynamic_body(2, polygon_shape({ { -0.5, -0.5 }, { -0.5, 0.5 }, { 0.5, 0.5 }, { 0.5, -0.5 } }), 0, 0, pb, vb);
+
+    Contact contact { a, b, { -1, 0 }, 0.01, { { 0.495, -0.4 }, { 0.495, 0.5 } } };
+
+    for (auto _ : state) {
+        a->velocity = va;
+        b->velocity = vb;
+        a->angular_velocity = 0;
+        b->angular_velocity = 0;
+
+        resolve_contact(contact);
+        benchmark::DoNotOptimize(a->velocity);
+    }
+}
+BENCHMARK(BM_ResolveContact);
+
+
+static void BM_ConjugateGradient(benchmark::State& state)
+{
+    /* Shifted one dimensional Laplacian, symmetric positive definite and well conditioned. */
+    auto dim = static_cast<size_t>(state.range(0));
+
+    matrix_func laplacian = [dim](const std::vector<double>& x)
+    {
+        std::vector<double> y(dim);
+        for (size_t i = 0; i < dim; ++i) {
+            y[i] = 3 * x[i] - ((i > 0) ? x[i - 1] : 0) - ((i + 1 < dim) ? x[i + 1] : 0);
+        }
+        return y;
+    };
+
+    for (auto _ : state) {
+        ConjugateGradSleSolver solver(laplacian, std::vector<double>(dim, 1.0), dim, 1e-8);
+        auto solution = solver.solve();
+        benchmark::DoNotOptimize(solution.data());
+    }
+
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_ConjugateGradient)->RangeMultiplier(4)->Range(64, 16384)->Unit(benchmark::kMicrosecond);
+
+
+static void BM_LeapFrogStep(benchmark::State& state)
+{
+    /* Free falling balls far enough apart never to collide, only the integrator runs. */
+    System system;
+    ShapeHandle ball = system.add_shape(circle_shape(0.1));
+
+    for (long i = 0; i < state.range(0); ++i) {
+        vector2 position { static_cast<double>(i), 0 };
+        vector2 velocity { 0, 1 };
+        system.add_dynamic_body(1, ball, 0, 0, position, velocity);
+    }
+
+    LeapFrog solver(&system);
+    double time_step = system.get_config().time_step;
+
+    for (auto _ : state) {
+        solver.step(time_step);
+    }
+
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_LeapFrogStep)->RangeMultiplier(4)->Range(256, 65536)->Unit(benchmark::kMicrosecond);
+
+
+static void BM_SpringGeneratorApplyForce(benchmark::State& state)
+{
+    /* One connector per link of a pendulum chain, the accumulators are not cleared. */
+    System system;
+    build_pendulum_chain(system, static_cast<size_t>(state.range(0)));
+
+    const auto& forces = system.get_forces();
+
+    for (auto _ : state) {
+        for (auto& force : forces) {
+            force->apply_force();
+        }
+    }
+
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_SpringGeneratorApplyForce)->RangeMultiplier(4)->Range(256, 65536)->Unit(benchmark::kMicrosecond);
@@ -0,0 +1,131 @@
+#include "scenes.hpp"
+
+#include <cmath>
+
+
+static std::vector<vector2> box_vertices(double width, double height)
+{
+    return { { -width/2, -height/2 }, { -width/2, height/2 }, { width/2, height/2 }, { width/2, -height/2 } };
+}
+
+
+static size_t grid_side(size_t n)
+{
+    return std::max<size_t>(1, static_cast<size_t>(std::ceil(std::sqrt(static_cast<double>(n)))));
+}
+
+
+void build_ball_pile(System& system, size_t n)
+{
+    /* Balls of radius 0.5 on a slightly sheared lattice, so they do not land exactly on top
+       of each other, inside a box just wider than the lattice. */
+    size_t side = grid_side(n);
+    double width = 1.2 * static_cast<double>(side) + 2;
+    double height = 1.2 * static_cast<double>(side) + 4;
+
+    vector2 ground { 0, -1 };
+    vector2 left   { -width/2 - 0.5, height/2 - 1 };
+    vector2 right  {  width/2 + 0.5, height/2 - 1 };
+    system.add_static_body(box_vertices(width + 2, 1), 0, ground);
+    system.add_static_body(box_vertices(1, height), 0, left);
+    system.add_static_body(box_vertices(1, height), 0, right);
+
+    ShapeHandle ball = system.add_shape(circle_shape(0.5));
+
+    for (size_t i = 0; i < n; ++i) {
+        double row = static_cast<double>(i / side);
+        double column = static_cast<double>(i % side);
+
+        vector2 position { -width/2 + 1.5 + 1.2 * column + 0.1 * std::fmod(row, 3), 1 + 1.2 * row };
+        vector2 velocity { 0, 0 };
+        system.add_dynamic_body(1, ball, 0, 0, position, velocity);
+    }
+}
+
+
+void build_box_stack(System& system, size_t n)
+{
+    size_t columns = (n + 9) / 10;
+    double width = 1.5 * static_cast<double>(columns) + 2;
+
+    vector2 ground { 0, -0.5 };
+    system.add_static_body(box_vertices(width, 1), 0, ground);
+
+    ShapeHandle box = system.add_shape(polygon_shape(box_vertices(1, 1)));
+
+    for (size_t i = 0; i < n; ++i) {
+        double level = static_cast<double>(i % 10);
+        double column = static_cast<double>(i / 10);
+
+        vector2 position { -width/2 + 1.5 + 1.5 * column, 0.505 + 1.01 * level };
+        vector2 velocity { 0, 0 };
+        system.add_dynamic_body(1, box, 0, 0, position, velocity);
+    }
+}
+
+
+void build_spring_grid(System& system, size_t n)
+{
+    /* Small boxes a unit apart, far enough not to touch, joined into one spring network. */
+    size_t side = grid_side(n);
+    ShapeHandle node = system.add_shape(polygon_shape(box_vertices(0.2, 0.2)));
+
+    std::vector<RigidBody*> bodies;
+    bodies.reserve(side * side);
+
+    for (size_t row = 0; row < side; ++row) {
+        for (size_t column = 0; column < side; ++column) {
+            vector2 position { static_cast<double>(column), -static_cast<double>(row) };
+            vector2 velocity { 0, 0 };
+
+            bodies.push_back((row == 0) ? system.add_static_body(node, 0, position)
+                                        : system.add_dynamic_body(1, node, 0, 0, position, velocity));
+        }
+    }
+
+    SpringNetwork* network = system.add_spring_network();
+    network->reserve(2 * side * side);
+
+    for (size_t row = 0; row < side; ++row) {
+        for (size_t column = 0; column < side; ++column) {
+            RigidBody* body = bodies[row * side + column];
+
+            if (column + 1 < side) {
+                network->add_spring(body, bodies[row * side + column + 1], OFFSET_0_ANGLE_0, OFFSET_0_ANGLE_0, 1, 500, 0.5);
+            }
+            if (row + 1 < side) {
+                network->add_spring(body, bodies[(row + 1) * side + column], OFFSET_0_ANGLE_0, OFFSET_0_ANGLE_0, 1, 500, 0.5);
+            }
+        }
+    }
+}
+
+
+void build_pendulum_chain(System& system, size_t n)
+{
+    /* Starts horizontal, so the whole chain swings down from the first step. */
+    vector2 pivot { 0, 0 };
+    RigidBody* previous = system.add_static_body(box_vertices(0.2, 0.2), 0, pivot);
+
+    ShapeHandle link = system.add_shape(polygon_shape(box_vertices(0.5, 0.2)));
+
+    for (size_t i = 0; i < n; ++i) {
+        vector2 position { static_cast<double>(i + 1), 0 };
+        vector2 velocity { 0, 0 };
+
+        RigidBody* body = system.add_dynamic_body(1, link, 0, 0, position, velocity);
+        system.add_spring_connector(previous, body, OFFSET_0_ANGLE_0, OFFSET_0_ANGLE_0, 2000, 1);
+        previous = body;
+    }
+}
+
+
+void build_scene(System& system, SceneType type, size_t n)
+{
+    switch (type) {
+        case BALL_PILE:      build_ball_pile(system, n);      break;
+        case BOX_STACK:      build_box_stack(system, n);      break;
+        case SPRING_GRID:    build_spring_grid(system, n);    break;
+        case PENDULUM_CHAIN: build_pendulum_chain(system, n); break;
+    }
+}
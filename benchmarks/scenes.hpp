@@ -0,0 +1,38 @@
+#ifndef SCENES_HPP
+#define SCENES_HPP
+
+#include <string>
+#include <cstddef>
+#include <unordered_map>
+
+#include "System.hpp"
+
+
+/* Brief: Procedural scenes parameterised by their size n, built into an empty System. Every
+          call with the same n builds the same scene, so timings of different builds compare. */
+enum SceneType
+{
+    BALL_PILE,       // n balls dropped into a walled box
+    BOX_STACK,       // n unit boxes in columns of ten on the ground
+    SPRING_GRID,     // about n bodies on a square grid, springs to the four neighbours, top row fixed
+    PENDULUM_CHAIN,  // n links joined by stiff springs, hanging from a static anchor
+};
+
+
+const std::unordered_map<SceneType, std::string> G_SCENE_STRINGS_MAP
+{
+    { BALL_PILE,      "ball-pile" },
+    { BOX_STACK,      "box-stack" },
+    { SPRING_GRID,    "spring-grid" },
+    { PENDULUM_CHAIN, "pendulum-chain" },
+};
+
+
+void build_ball_pile(System& system, size_t n);
+void build_box_stack(System& system, size_t n);
+void build_spring_grid(System& system, size_t n);
+void build_pendulum_chain(System& system, size_t n);
+
+void build_scene(System& system, SceneType type, size_t n);
+
+#endif
@@ -72,7 +72,7 @@ class SimScene
         RigidBody* add_static_object(double angle, vector2&& position, ShapeParameters* parameters)
         {
             RigidBody* body_ptr = physics.add_static_body(
-                VERTEX_FUNCTIONS[parameters->vertex_function](parameters), angle, position
+                collision_shape(parameters), angle, position
             );
 
             Shape* shape_ptr = render.add_shape(
@@ -90,7 +90,7 @@ class SimScene
                                         vector2&& position, ShapeParameters* parameters)
         {
             RigidBody* body_ptr = physics.add_rotational_body(mass, 
-                VERTEX_FUNCTIONS[parameters->vertex_function](parameters), angle, angular_velocity, position
+                collision_shape(parameters), angle, angular_velocity, position
             );
 
             Shape* shape_ptr = render.add_shape(
@@ -108,7 +108,7 @@ class SimScene
                                       vector2&& velocity, ShapeParameters* parameters)
         {
             RigidBody* body_ptr = physics.add_dynamic_body(mass, 
-                VERTEX_FUNCTIONS[parameters->vertex_function](parameters), angle, angular_velocity, position,
+                collision_shape(parameters), angle, angular_velocity, position,
                 velocity
             );
 
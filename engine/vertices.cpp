@@ -32,4 +32,14 @@ vertices rectangle_vertices(ShapeParameters* parameters)
     vertices.push_back(vector2 {  parameters->xscaling/2, -parameters->yscaling/2 });
 
     return vertices;
+}
+
+
+ShapeDefinition collision_shape(ShapeParameters* parameters)
+{
+    if (parameters->shape_type == ELIPSE && parameters->xscaling == parameters->yscaling) {
+        return circle_shape(parameters->xscaling);
+    }
+
+    return polygon_shape(VERTEX_FUNCTIONS[parameters->vertex_function](parameters));
 }
\ No newline at end of file
@@ -4,6 +4,7 @@
 
 #include <array>
 #include "vector2.hpp"
+#include "collisions.hpp"
 
 
 enum VertexFunction
@@ -19,6 +20,9 @@ class ShapeParameters;
 vertices elipse_vertices(ShapeParameters* parameters);
 vertices rectangle_vertices(ShapeParameters* parameters);
 
+// Circles map to the native collision shape, everything else to its vertex polygon
+ShapeDefinition collision_shape(ShapeParameters* parameters);
+
 
 constexpr std::array<vertices (*)(ShapeParameters*), NUM_VERTEX_FUNCTIONS> VERTEX_FUNCTIONS {
     elipse_vertices,
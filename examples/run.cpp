@@ -0,0 +1,404 @@
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <charconv>
+#include <algorithm>
+#include <stdexcept>
+#include <string_view>
+#include <unordered_map>
+
+#include "System.hpp"
+#include "scenes.hpp"
+#include "tracing.hpp"
+#include "scene_file.hpp"
+#include "TrajectoryRecorder.hpp"
+
+
+/* Headless batch runner: builds a scene, steps it as fast as possible for a number of steps
+   or of simulated seconds and writes trajectories and run statistics. No window, no OpenGL. */
+
+struct RunOptions
+{
+    SceneType scene { BALL_PILE };
+    size_t size { 100 };
+
+    size_t steps { 1000 };
+    double duration { 0 };  // simulated seconds, overrides steps when positive
+    double time_step { 0 }; // 0 keeps the default of SystemConfig
+
+    std::string trajectory_path {};
+    size_t trajectory_interval { 1 };
+    std::string record_path {};
+    TrajectoryOptions record_options {};
+    std::string stats_path {};
+    std::string trace_path {};
+
+    std::string scene_path {};      // replaces --scene
+    std::unordered_map<std::string, double> variables {};
+
+    std::string restore_path {};    // replaces the scene
+    std::string checkpoint_path {};
+
+    bool deterministic { false };
+};
+
+
+static void print_usage()
+{
+    std::fprintf(stderr,
+        "usage: mecsim_run [options]\n"
+        "  --scene NAME        ball-pile | box-stack | spring-grid | pendulum-chain (ball-pile)\n"
+        "  --size N            scene size (100)\n"
+        "  --scene-file FILE   build the scene from a scene file instead\n"
+        "  --define NAME=V     set a variable of the scene file, repeatable\n"
+        "  --steps N           number of steps (1000)\n"
+        "  --time T            simulated seconds, replaces --steps\n"
+        "  --dt H              time step\n"
+        "  --trajectory FILE   CSV of the body states\n"
+        "  --record FILE       binary columnar trajectory, written in the background\n"
+        "  --record-format F   f64 | f32 | f64-delta | f32-delta (f64)\n"
+        "  --every K           write the trajectory every K steps (1)\n"
+        "  --stats FILE        run statistics, printed to stdout as well\n"
+        "  --trace FILE        Chrome trace of the stage timelines, needs MECSIM_ENABLE_TRACING\n"
+        "  --restore FILE      start from a checkpoint instead of building the scene\n"
+        "  --checkpoint FILE   save a checkpoint at the end of the run\n"
+        "  --deterministic     bit reproducible results for any thread count\n");
+}
+
+
+template <typename T>
+static T parse_number(std::string_view text, const char* option)
+{
+    T value {};
+    auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+
+    if (error != std::errc() || end != text.data() + text.size()) {
+        throw std::runtime_error(std::string("ERROR::RUN::INVALID_VALUE_FOR_") + option + "\n");
+    }
+
+    return value;
+}
+
+
+static RunOptions parse_options(int argc, char** argv)
+{
+    RunOptions options;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string_view option = argv[i];
+
+        if (option == "--help" || option == "-h") {
+            print_usage();
+            std::exit(0);
+        }
+
+        if (option == "--deterministic") {
+            options.deterministic = true;
+            continue;
+        }
+
+        if (i + 1 >= argc) {
+            throw std::runtime_error("ERROR::RUN::MISSING_VALUE_FOR_" + std::string(option) + "\n");
+        }
+        std::string_view value = argv[++i];
+
+        if (option == "--scene") {
+            bool found = false;
+            for (auto& [type, name] : G_SCENE_STRINGS_MAP) {
+                if (name == value) {
+                    options.scene = type;
+                    found = true;
+                }
+            }
+            if (!found) {
+                throw std::runtime_error("ERROR::RUN::UNKNOWN_SCENE_" + std::string(value) + "\n");
+            }
+        }
+        else if (option == "--size")       { options.size = parse_number<size_t>(value, "SIZE"); }
+        else if (option == "--scene-file") { options.scene_path = value; }
+        else if (option == "--define") {
+            size_t equal = value.find('=');
+            if (equal == std::string_view::npos || equal == 0) {
+                throw std::runtime_error("ERROR::RUN::INVALID_DEFINE_" + std::string(value) + "\n");
+            }
+            options.variables[std::string(value.substr(0, equal))] = parse_number<double>(value.substr(equal + 1), "DEFINE");
+        }
+        else if (option == "--steps")      { options.steps = parse_number<size_t>(value, "STEPS"); }
+        else if (option == "--time")       { options.duration = parse_number<double>(value, "TIME"); }
+        else if (option == "--dt")         { options.time_step = parse_number<double>(value, "DT"); }
+        else if (option == "--trajectory") { options.trajectory_path = value; }
+        else if (option == "--record")     { options.record_path = value; }
+        else if (option == "--record-format") {
+            if (value != "f64" && value != "f32" && value != "f64-delta" && value != "f32-delta") {
+                throw std::runtime_error("ERROR::RUN::UNKNOWN_RECORD_FORMAT_" + std::string(value) + "\n");
+            }
+            options.record_options.float32 = value.starts_with("f32");
+            options.record_options.delta = value.ends_with("-delta");
+        }
+        else if (option == "--every")      { options.trajectory_interval = std::max<size_t>(1, parse_number<size_t>(value, "EVERY")); }
+        else if (option == "--stats")      { options.stats_path = value; }
+        else if (option == "--trace")      { options.trace_path = value; }
+        else if (option == "--restore")    { options.restore_path = value; }
+        else if (option == "--checkpoint") { options.checkpoint_path = value; }
+        else {
+            throw std::runtime_error("ERROR::RUN::UNKNOWN_OPTION_" + std::string(option) + "\n");
+        }
+    }
+
+    return options;
+}
+
+
+class TrajectoryWriter
+{
+    /* Brief: CSV rows of step, time, body id and state, formatted with to_chars into a large
+              buffer that is flushed in blocks. */
+    private:
+        std::FILE* m_file { nullptr };
+        std::vector<char> m_buffer {};
+        size_t m_used {};
+
+        // Eight numbers and their separators, to_chars writes at most 24 characters per number
+        static constexpr size_t s_max_numbers_length { 8 * 25 };
+
+        void flush()
+        {
+            std::fwrite(m_buffer.data(), 1, m_used, m_file);
+            m_used = 0;
+        }
+
+        // Room for a row of the given length, grown past the block size for very long body names
+        void reserve_row(size_t length)
+        {
+            if (m_used + length > m_buffer.size()) {
+                flush();
+            }
+            if (length > m_buffer.size()) {
+                m_buffer.resize(length);
+            }
+        }
+
+        void put(std::string_view text)
+        {
+            text.copy(m_buffer.data() + m_used, text.size());
+            m_used += text.size();
+        }
+
+        template <typename T>
+        void put_number(T value)
+        {
+            auto result = std::to_chars(m_buffer.data() + m_used, m_buffer.data() + m_buffer.size(), value);
+            m_used = static_cast<size_t>(result.ptr - m_buffer.data());
+        }
+
+    public:
+        explicit TrajectoryWriter(const std::string& path) : m_buffer(1 << 20)
+        {
+            m_file = std::fopen(path.c_str(), "w");
+            if (m_file == nullptr) {
+                throw std::runtime_error("ERROR::TRAJECTORY_WRITER::CANNOT_OPEN_" + path + "\n");
+            }
+            put("step,time,id,x,y,angle,vx,vy,omega\n");
+        }
+
+        ~TrajectoryWriter()
+        {
+            flush();
+            std::fclose(m_file);
+        }
+
+        TrajectoryWriter(const TrajectoryWriter&) = delete;
+        TrajectoryWriter& operator=(const TrajectoryWriter&) = delete;
+
+        void write(size_t step, const System& system)
+        {
+            for (auto& b : system.get_rigid_bodies()) {
+                std::string id = b->get_id();
+                reserve_row(s_max_numbers_length + id.size() + 1);
+
+                put_number(step);                put(",");
+                put_number(system.get_time());   put(",");
+                put(id);                         put(",");
+                put_number(b->position.x);       put(",");
+                put_number(b->position.y);       put(",");
+                put_number(b->angle);            put(",");
+                put_number(b->velocity.x);       put(",");
+                put_number(b->velocity.y);       put(",");
+                put_number(b->angular_velocity); put("\n");
+            }
+        }
+};
+
+
+static void run(const RunOptions& options)
+{
+    // The configuration of a scene file is fixed when the system is built
+    SceneDescription description;
+    if (options.restore_path.empty() && !options.scene_path.empty()) {
+        description = read_scene_file(options.scene_path, options.variables);
+    }
+
+    System system { std::move(description.config) };
+
+    // A checkpoint brings its own time step, --dt still overrides it
+    if (!options.restore_path.empty()) {
+        system.load_checkpoint(options.restore_path);
+    } else if (!options.scene_path.empty()) {
+        load_scene(system, description, true);
+    } else {
+        build_scene(system, options.scene, options.size);
+    }
+
+    if (options.time_step > 0) {
+        system.set_time_step(options.time_step);
+    }
+
+    if (options.deterministic) {
+        system.set_deterministic(true);
+    }
+
+    double time_step = system.get_config().time_step;
+
+    std::unique_ptr<TrajectoryWriter> trajectory;
+    if (!options.trajectory_path.empty()) {
+        trajectory = std::make_unique<TrajectoryWriter>(options.trajectory_path);
+        trajectory->write(0, system);
+    }
+
+    std::unique_ptr<TrajectoryRecorder> recorder;
+    if (!options.record_path.empty()) {
+        recorder = std::make_unique<TrajectoryRecorder>(options.record_path, options.record_options);
+        recorder->record(system);
+    }
+
+    double initial_energy = system.compute_energy();
+    double start_time = system.get_time();
+    size_t steps = 0;
+    size_t reduced_steps = 0;
+    double min_step = time_step;
+
+    if (!options.trace_path.empty()) {
+        start_tracing();
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    // A step shorter than requested means the penetration loop halved it
+    while ((options.duration > 0) ? system.get_time() - start_time < options.duration : steps < options.steps) {
+        double taken = system.step();
+        ++steps;
+
+        if (taken < time_step) {
+            ++reduced_steps;
+            min_step = std::min(min_step, taken);
+        }
+
+        if (steps % options.trajectory_interval == 0) {
+            if (trajectory) {
+                trajectory->write(steps, system);
+            }
+            if (recorder) {
+                recorder->record(system);
+            }
+        }
+    }
+
+    double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    trajectory.reset();
+    if (recorder) {
+        recorder->finish();
+    }
+
+    if (!options.checkpoint_path.empty()) {
+        system.save_checkpoint(options.checkpoint_path);
+    }
+
+    if (!options.trace_path.empty()) {
+        stop_tracing();
+        if (write_chrome_trace(options.trace_path) == 0) {
+            std::fputs("WARNING::RUN::EMPTY_TRACE, build with MECSIM_ENABLE_TRACING\n", stderr);
+        }
+    }
+
+    double final_energy = system.compute_energy();
+    size_t nbodies = system.get_rigid_bodies().size();
+
+    std::string scene = !options.restore_path.empty() ? options.restore_path :
+                        !options.scene_path.empty()   ? options.scene_path :
+                                                        G_SCENE_STRINGS_MAP.at(options.scene);
+
+    char stats[1024];
+    std::snprintf(stats, sizeof(stats),
+        "scene           %s\n"
+        "bodies          %zu\n"
+        "steps           %zu\n"
+        "simulated time  %.6g s\n"
+        "wall time       %.6g s\n"
+        "steps/s         %.6g\n"
+        "body steps/s    %.6g\n"
+        "reduced steps   %zu (min step %.3g s)\n"
+        "energy          %.9g -> %.9g\n"
+        "state hash      %016llx%s\n",
+        scene.c_str(), nbodies, steps, system.get_time() - start_time, wall,
+        steps / wall, static_cast<double>(steps * nbodies) / wall, reduced_steps, min_step,
+        initial_energy, final_energy, static_cast<unsigned long long>(system.state_hash()),
+        system.get_config().deterministic ? "" : " (not deterministic)");
+
+    std::string report = stats;
+
+#ifdef MECSIM_ENABLE_PROFILING
+    const StepStats& total = system.stats().total;
+    double step_seconds = total.seconds[STAGE_STEP];
+
+    for (size_t k = STAGE_INTEGRATION; k < NUM_PROFILE_STAGES; ++k) {
+        auto stage = static_cast<ProfileStage>(k);
+        std::snprintf(stats, sizeof(stats), "  %-20s %10.6f s %6.2f %%\n", G_PROFILE_STAGE_STRINGS_MAP.at(stage).c_str(),
+                      total.seconds[k], (step_seconds > 0) ? 100 * total.seconds[k] / step_seconds : 0.0);
+        report += stats;
+    }
+
+    for (size_t k = 0; k < NUM_PROFILE_COUNTERS; ++k) {
+        auto counter = static_cast<ProfileCounter>(k);
+        std::snprintf(stats, sizeof(stats), "  %-20s %10.4g per step\n", G_PROFILE_COUNTER_STRINGS_MAP.at(counter).c_str(),
+                      static_cast<double>(total.counters[k]) / static_cast<double>(std::max<size_t>(1, system.stats().steps)));
+        report += stats;
+    }
+#endif
+
+    std::fputs(report.c_str(), stdout);
+
+    if (!options.stats_path.empty()) {
+        std::FILE* file = std::fopen(options.stats_path.c_str(), "w");
+        if (file == nullptr) {
+            throw std::runtime_error("ERROR::RUN::CANNOT_OPEN_" + options.stats_path + "\n");
+        }
+        std::fputs(report.c_str(), file);
+        std::fclose(file);
+    }
+}
+
+
+int main(int argc, char** argv)
+{
+    RunOptions options;
+
+    try {
+        options = parse_options(argc, argv);
+    } catch (const std::exception& error) {
+        std::fputs(error.what(), stderr);
+        print_usage();
+        return 1;
+    }
+
+    try {
+        run(options);
+    } catch (const std::exception& error) {
+        std::fputs(error.what(), stderr);
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,380 @@
+#include "BarnesHut.hpp"
+#include "parallel.hpp"
+#include "util.hpp"
+
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+
+double BarnesHutGenerator::strength(size_t i) const
+{
+    return (m_law == GRAVITATIONAL_LAW) ? 1 / m_bodies[i]->get_inverse_mass() : m_charges[i];
+}
+
+
+void BarnesHutGenerator::add_body(RigidBody* body, double charge)
+{
+    if (body == nullptr) {
+        throw std::runtime_error("ERROR::BARNES_HUT_GENERATOR::NULL_BODY\n");
+    }
+
+    if (m_law == GRAVITATIONAL_LAW && body->get_inverse_mass() == 0) {
+        throw std::runtime_error("ERROR::BARNES_HUT_GENERATOR::INFINITE_MASS\n");
+    }
+
+    m_bodies.push_back(body);
+    m_charges.push_back(charge);
+    ++m_max_nbodies;
+    ++m_bodies_version;
+}
+
+
+bool BarnesHutGenerator::del_body(const RigidBody* body)
+{
+    auto it = std::find(m_bodies.begin(), m_bodies.end(), body);
+    if (it != m_bodies.end()) {
+        m_charges.erase(m_charges.begin() + (it - m_bodies.begin()));
+        m_bodies.erase(it);
+        --m_max_nbodies;
+        ++m_bodies_version;
+    }
+
+    return false;
+}
+
+
+bool BarnesHutGenerator::del_pending_bodies()
+{
+    size_t kept = 0;
+
+    for (size_t i = 0; i < m_bodies.size(); ++i) {
+        if (!m_bodies[i]->is_pending_removal()) {
+            m_bodies[kept] = m_bodies[i];
+            m_charges[kept] = m_charges[i];
+            ++kept;
+        }
+    }
+
+    if (kept != m_bodies.size()) {
+        m_bodies.resize(kept);
+        m_charges.resize(kept);
+        m_max_nbodies = kept;
+        ++m_bodies_version;
+    }
+
+    return false;
+}
+
+
+void BarnesHutGenerator::compute_moments(std::vector<Node>& nodes, uint32_t index) const
+{   
+    /* Net strength, and the centre of the strength magnitudes. Empty or neutral cells keep
+       the centre of the cell. */
+    Node& node = nodes[index];
+    double strength = 0;
+    double weight = 0;
+    double wx = 0;
+    double wy = 0;
+
+    if (node.leaf) {
+        for (size_t k = node.first; k < node.first + node.count; ++k) {
+            double w = std::abs(m_s[k]);
+            strength += m_s[k];
+            weight += w;
+            wx += w * m_x[k];
+            wy += w * m_y[k];
+        }
+    } else {
+        for (uint32_t c : node.children) {
+            if (c == G_NO_NODE) {
+                continue;
+            }
+
+            const Node& child = nodes[c];
+            strength += child.strength;
+            weight += child.weight;
+            wx += child.weight * child.x;
+            wy += child.weight * child.y;
+        }
+    }
+
+    node.strength = strength;
+    node.weight = weight;
+    node.x = (weight > 0) ? wx / weight : node.x;
+    node.y = (weight > 0) ? wy / weight : node.y;
+}
+
+
+uint32_t BarnesHutGenerator::build_node(std::vector<Node>& nodes, size_t begin, size_t end, unsigned level,
+                                        double x0, double y0, double size, std::vector<Subtree>* deferred) const
+{   
+    /* The bodies of [begin, end) share the top 2*level bits of their Morton codes, the
+       next two bits pick the quadrant. Sorted codes make every quadrant a contiguous range. */
+    auto index = static_cast<uint32_t>(nodes.size());
+    nodes.emplace_back();
+    nodes[index].first = static_cast<uint32_t>(begin);
+    nodes[index].count = static_cast<uint32_t>(end - begin);
+    nodes[index].size = size;
+    nodes[index].x = x0 + size / 2;
+    nodes[index].y = y0 + size / 2;
+
+    if (end - begin <= G_BARNES_HUT_LEAF_SIZE || level >= 16) {
+        compute_moments(nodes, index);
+        return index;
+    }
+
+    nodes[index].leaf = false;
+
+    if (deferred != nullptr && level == G_BARNES_HUT_SPLIT_LEVEL) {
+        deferred->push_back(Subtree { index, begin, end, x0, y0, size });
+        return index;
+    }
+
+    unsigned shift = 2 * (15 - level);
+    double half = size / 2;
+    size_t lo = begin;
+
+    for (uint32_t q = 0; q < 4; ++q) {
+        size_t hi = std::partition_point(m_codes.begin() + lo, m_codes.begin() + end, 
+                                         [&](uint32_t code) { return ((code >> shift) & 3) <= q; }) - m_codes.begin();
+        if (hi > lo) {
+            uint32_t child = build_node(nodes, lo, hi, level + 1, x0 + (q & 1) * half, y0 + (q >> 1) * half, half, deferred);
+            nodes[index].children[q] = child;
+        }
+        lo = hi;
+    }
+
+    compute_moments(nodes, index);
+    return index;
+}
+
+
+void BarnesHutGenerator::finish_top_moments(uint32_t index, unsigned level) const
+{
+    if (level >= G_BARNES_HUT_SPLIT_LEVEL || m_nodes[index].leaf) {
+        return;
+    }
+
+    for (uint32_t c : m_nodes[index].children) {
+        if (c != G_NO_NODE) {
+            finish_top_moments(c, level + 1);
+        }
+    }
+
+    compute_moments(m_nodes, index);
+}
+
+
+void BarnesHutGenerator::build_tree() const
+{   
+    /* Bodies are quantised to 16 bits per axis over their bounding square and sorted by
+       Morton code. The top levels are built serially, the subtrees below them in parallel
+       into separate arrays that are then appended to the node array. */
+    size_t n = m_bodies.size();
+    bool parallel = (m_accumulation != SERIAL_ACCUMULATION);
+
+    double min_x = std::numeric_limits<double>::max();
+    double min_y = std::numeric_limits<double>::max();
+    double max_x = std::numeric_limits<double>::lowest();
+    double max_y = std::numeric_limits<double>::lowest();
+
+    for (const RigidBody* b : m_bodies) {
+        min_x = std::min(min_x, b->position.x);
+        min_y = std::min(min_y, b->position.y);
+        max_x = std::max(max_x, b->position.x);
+        max_y = std::max(max_y, b->position.y);
+    }
+
+    double size = std::max({ max_x - min_x, max_y - min_y, m_softening });
+    double scale = 65535 / size;
+
+    std::vector<uint64_t> keys(n);
+    parallel_for(0, n, [&](size_t i)
+    {
+        auto x = static_cast<uint16_t>((m_bodies[i]->position.x - min_x) * scale);
+        auto y = static_cast<uint16_t>((m_bodies[i]->position.y - min_y) * scale);
+        keys[i] = (static_cast<uint64_t>(morton_code(x, y)) << 32) | i;
+    }, parallel ? 4096 : n + 1);
+
+    std::sort(keys.begin(), keys.end());
+
+    for (auto* array : { &m_x, &m_y, &m_s }) {
+        array->resize(n);
+    }
+    m_order.resize(n);
+    m_codes.resize(n);
+
+    for (size_t k = 0; k < n; ++k) {
+        auto i = static_cast<uint32_t>(keys[k] & UINT32_MAX);
+        m_order[k] = i;
+        m_codes[k] = static_cast<uint32_t>(keys[k] >> 32);
+        m_x[k] = m_bodies[i]->position.x;
+        m_y[k] = m_bodies[i]->position.y;
+        m_s[k] = strength(i);
+    }
+
+    m_nodes.clear();
+    if (n == 0) {
+        m_root = G_NO_NODE;
+        return;
+    }
+
+    std::vector<Subtree> deferred {};
+    m_root = build_node(m_nodes, 0, n, 0, min_x, min_y, size, &deferred);
+
+    std::vector<std::vector<Node>> subtrees(deferred.size());
+    parallel_for(0, deferred.size(), [&](size_t k)
+    {
+        const Subtree& d = deferred[k];
+        build_node(subtrees[k], d.begin, d.end, G_BARNES_HUT_SPLIT_LEVEL, d.x0, d.y0, d.size, nullptr);
+    }, parallel ? 1 : deferred.size() + 1);
+
+    for (size_t k = 0; k < deferred.size(); ++k) {
+        auto offset = static_cast<uint32_t>(m_nodes.size());
+        for (Node& node : subtrees[k]) {
+            for (uint32_t& c : node.children) {
+                c = (c == G_NO_NODE) ? c : c + offset;
+            }
+        }
+
+        // The subtree root is its first node and replaces the placeholder
+        m_nodes.insert(m_nodes.end(), subtrees[k].begin(), subtrees[k].end());
+        m_nodes[deferred[k].node] = m_nodes[offset];
+    }
+
+    finish_top_moments(m_root, 0);
+}
+
+
+void BarnesHutGenerator::traverse(size_t i) const
+{   
+    /* Cells far enough away act through their monopole, near leaves are summed directly.
+       A cell containing the body itself is always opened. */
+    double eps2 = m_softening * m_softening;
+    double theta2 = m_opening_angle * m_opening_angle;
+    double xi = m_x[i];
+    double yi = m_y[i];
+
+    double fx = 0;
+    double fy = 0;
+    double potential = 0;
+
+    auto interact = [&](double x, double y, double s)
+    {
+        double dx = xi - x;
+        double dy = yi - y;
+        double inv = 1 / std::sqrt(dx * dx + dy * dy + eps2);
+        double inv3 = inv * inv * inv;
+
+        fx += s * dx * inv3;
+        fy += s * dy * inv3;
+        potential += s * inv;
+    };
+
+    // Depth is bounded by 17 levels with at most 3 pending siblings each
+    std::array<uint32_t, 64> stack;
+    size_t top = 0;
+    stack[top++] = m_root;
+
+    while (top > 0) {
+        const Node& node = m_nodes[stack[--top]];
+        if (node.weight == 0) {
+            continue;
+        }
+
+        bool inside = (i >= node.first && i < node.first + node.count);
+        double dx = xi - node.x;
+        double dy = yi - node.y;
+
+        if (!inside && node.size * node.size < theta2 * (dx * dx + dy * dy)) {
+            interact(node.x, node.y, node.strength);
+        } else if (node.leaf) {
+            for (size_t k = node.first; k < node.first + node.count; ++k) {
+                if (k != i) {
+                    interact(m_x[k], m_y[k], m_s[k]);
+                }
+            }
+        } else {
+            for (uint32_t c : node.children) {
+                if (c != G_NO_NODE) {
+                    stack[top++] = c;
+                }
+            }
+        }
+    }
+
+    double c = coupling();
+    m_fx[i] = c * m_s[i] * fx;
+    m_fy[i] = c * m_s[i] * fy;
+    m_potential[i] = c * potential;
+}
+
+
+void BarnesHutGenerator::evaluate() const
+{
+    build_tree();
+
+    size_t n = m_bodies.size();
+    for (auto* array : { &m_fx, &m_fy, &m_potential }) {
+        array->resize(n);
+    }
+
+    bool parallel = (m_accumulation != SERIAL_ACCUMULATION);
+    parallel_for(0, n, [this](size_t i) { traverse(i); }, parallel ? 256 : n + 1);
+}
+
+
+void BarnesHutGenerator::apply_force() const
+{
+    evaluate();
+
+    for (size_t k = 0; k < m_order.size(); ++k) {
+        RigidBody* b = m_bodies[m_order[k]];
+        b->force_accumulator.x += m_fx[k];
+        b->force_accumulator.y += m_fy[k];
+    }
+}
+
+
+double BarnesHutGenerator::compute_energy() const
+{
+    evaluate();
+
+    double energy = 0;
+    for (size_t k = 0; k < m_order.size(); ++k) {
+        energy += 0.5 * m_s[k] * m_potential[k];
+    }
+
+    return energy;
+}
+
+
+void BarnesHutGenerator::write_state(BinaryWriter& writer, const BodyIndexMap& indices) const
+{
+    writer.write(m_law);
+    writer.write(m_constant);
+    writer.write(m_softening);
+    writer.write(m_opening_angle);
+    write_bodies(writer, indices);
+    writer.write_array(m_charges);
+}
+
+
+std::unique_ptr<BarnesHutGenerator> BarnesHutGenerator::read_state(BinaryReader& reader, const std::vector<RigidBody*>& bodies)
+{
+    auto law = reader.read<PairLaw>();
+    auto constant = reader.read<double>();
+    auto softening = reader.read<double>();
+    auto opening_angle = reader.read<double>();
+
+    auto generator = std::make_unique<BarnesHutGenerator>(law, constant, softening, opening_angle);
+    generator->read_bodies(reader, bodies);
+    reader.read_array(generator->m_charges);
+
+    if (generator->m_charges.size() != generator->m_bodies.size()) {
+        throw std::runtime_error("ERROR::BARNES_HUT_GENERATOR::READ_STATE::SIZE_MISMATCH\n");
+    }
+
+    return generator;
+}
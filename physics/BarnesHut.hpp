@@ -0,0 +1,132 @@
+#ifndef BARNES_HUT_HPP
+#define BARNES_HUT_HPP
+
+#include <array>
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#include "vector2.hpp"
+#include "RigidBody.hpp"
+#include "ForceGenerator.hpp"
+
+
+enum PairLaw
+{
+    GRAVITATIONAL_LAW,  // strengths are the masses, attractive
+    ELECTROSTATIC_LAW,  // strengths are charges, like charges repel
+};
+
+
+constexpr uint32_t G_NO_NODE { UINT32_MAX };
+
+// Bodies per leaf, and quadtree levels built serially before the subtrees go parallel
+constexpr size_t G_BARNES_HUT_LEAF_SIZE { 8 };
+constexpr unsigned G_BARNES_HUT_SPLIT_LEVEL { 2 };
+
+
+class BarnesHutGenerator : public ForceGenerator
+{
+    /* Brief: Softened inverse square pair force between all bodies of the generator, the
+              pair potential is c*s_i*s_j/sqrt(r^2 + eps^2) with c = -G for gravitation and
+              c = k for electrostatics. Bodies are sorted along a Morton curve and a quadtree
+              is built over the sorted ranges every evaluation. A cell is replaced by its
+              monopole when its size is below opening_angle times its distance. The centre of
+              a cell weighs the strengths by magnitude, so cells of mixed charge are only
+              approximated to the monopole. The energy uses the same approximation. */
+    private:
+        struct Node
+        {
+            double x {};
+            double y {};
+            double strength {};
+            double weight {};
+            double size {};
+
+            uint32_t first {};
+            uint32_t count {};
+            std::array<uint32_t, 4> children { G_NO_NODE, G_NO_NODE, G_NO_NODE, G_NO_NODE };
+            bool leaf { true };
+        };
+
+        // Subtree below the serially built top levels, built on its own thread
+        struct Subtree
+        {
+            uint32_t node {};
+            size_t begin {};
+            size_t end {};
+            double x0 {};
+            double y0 {};
+            double size {};
+        };
+
+        PairLaw m_law {};
+        double m_constant {};
+        double m_softening {};
+        double m_opening_angle {};
+
+        std::vector<double> m_charges {};
+
+        /* Tree of the last evaluation, bodies in Morton order. */
+        mutable std::vector<Node> m_nodes {};
+        mutable uint32_t m_root { G_NO_NODE };
+        mutable std::vector<uint32_t> m_order {};
+        mutable std::vector<uint32_t> m_codes {};
+        mutable std::vector<double> m_x {}, m_y {}, m_s {};
+        mutable std::vector<double> m_fx {}, m_fy {}, m_potential {};
+
+        double coupling() const { return m_law == GRAVITATIONAL_LAW ? -m_constant : m_constant; }
+        double strength(size_t i) const;
+
+        void build_tree() const;
+        uint32_t build_node(std::vector<Node>& nodes, size_t begin, size_t end, unsigned level,
+                            double x0, double y0, double size, std::vector<Subtree>* deferred) const;
+        void compute_moments(std::vector<Node>& nodes, uint32_t index) const;
+        void finish_top_moments(uint32_t index, unsigned level) const;
+
+        void traverse(size_t i) const;
+        void evaluate() const;
+
+    public:
+        BarnesHutGenerator(PairLaw law, double constant, double softening, double opening_angle = 0.5) :
+        m_law(law), m_constant(constant), m_softening(softening), m_opening_angle(opening_angle)
+        {
+            m_type = BARNES_HUT;
+
+            if (constant <= 0) {
+                throw std::runtime_error("ERROR::BARNES_HUT_GENERATOR::NON_POSITIVE_CONSTANT\n");
+            }
+
+            if (softening <= 0) {
+                throw std::runtime_error("ERROR::BARNES_HUT_GENERATOR::NON_POSITIVE_SOFTENING\n");
+            }
+
+            set_opening_angle(opening_angle);
+        }
+
+        void set_opening_angle(double opening_angle)
+        {
+            if (opening_angle < 0) {
+                throw std::runtime_error("ERROR::BARNES_HUT_GENERATOR::NEGATIVE_OPENING_ANGLE\n");
+            }
+            m_opening_angle = opening_angle;
+        }
+
+        double get_opening_angle() const { return m_opening_angle; }
+
+        /* The charge is only used by electrostatic generators, gravitational ones take the
+           mass of the body, which must then be finite. */
+        void add_body(RigidBody* body, double charge = 0);
+
+        bool del_body(const RigidBody* body) override;
+        bool del_pending_bodies() override;
+
+        void apply_force() const override;
+        double compute_energy() const override;
+
+        void write_state(BinaryWriter& writer, const BodyIndexMap& indices) const override;
+        static std::unique_ptr<BarnesHutGenerator> read_state(BinaryReader& reader, const std::vector<RigidBody*>& bodies);
+};
+
+#endif
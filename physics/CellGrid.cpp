@@ -0,0 +1,62 @@
+#include "CellGrid.hpp"
+
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+
+void CellGrid::build(const double* x, const double* y, size_t n, double cell_size)
+{
+    m_points.resize(n);
+    m_point_cells.resize(n);
+
+    if (n == 0) {
+        m_nx = m_ny = 0;
+        m_cell_start.assign(1, 0);
+        return;
+    }
+
+    double max_x = std::numeric_limits<double>::lowest();
+    double max_y = std::numeric_limits<double>::lowest();
+    m_min_x = std::numeric_limits<double>::max();
+    m_min_y = std::numeric_limits<double>::max();
+
+    for (size_t i = 0; i < n; ++i) {
+        m_min_x = std::min(m_min_x, x[i]);
+        m_min_y = std::min(m_min_y, y[i]);
+        max_x = std::max(max_x, x[i]);
+        max_y = std::max(max_y, y[i]);
+    }
+
+    // At most about 4 cells per point, sparse sets would otherwise allocate huge grids
+    double width = max_x - m_min_x;
+    double height = max_y - m_min_y;
+    double max_cells = 4.0 * static_cast<double>(n) + 16;
+
+    m_cell_size = cell_size;
+    if ((width / m_cell_size + 1) * (height / m_cell_size + 1) > max_cells) {
+        m_cell_size = std::max(m_cell_size, std::sqrt(width * height / max_cells) * 1.01);
+        m_cell_size = std::max(m_cell_size, std::max(width, height) / max_cells * 1.01);
+    }
+
+    m_nx = static_cast<size_t>(width / m_cell_size) + 1;
+    m_ny = static_cast<size_t>(height / m_cell_size) + 1;
+
+    m_cell_start.assign(m_nx * m_ny + 1, 0);
+
+    for (size_t i = 0; i < n; ++i) {
+        size_t cx = std::min(m_nx - 1, static_cast<size_t>((x[i] - m_min_x) / m_cell_size));
+        size_t cy = std::min(m_ny - 1, static_cast<size_t>((y[i] - m_min_y) / m_cell_size));
+        m_point_cells[i] = static_cast<uint32_t>(cy * m_nx + cx);
+        ++m_cell_start[m_point_cells[i] + 1];
+    }
+
+    for (size_t c = 0; c < m_nx * m_ny; ++c) {
+        m_cell_start[c + 1] += m_cell_start[c];
+    }
+
+    std::vector<uint32_t> next(m_cell_start.begin(), m_cell_start.end() - 1);
+    for (size_t i = 0; i < n; ++i) {
+        m_points[next[m_point_cells[i]]++] = static_cast<uint32_t>(i);
+    }
+}
@@ -0,0 +1,72 @@
+#ifndef CELL_GRID_HPP
+#define CELL_GRID_HPP
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+
+class CellGrid
+{
+    /* Brief: Uniform grid of square cells over a point set, stored as a cell list: the point
+              indices sorted by cell and the offset of every cell into them, built by counting
+              sort in linear time. Cells are at least cell_size wide, so every pair of points
+              closer than cell_size lies in one cell or in two adjacent ones. The number of
+              cells is capped relative to the number of points, sparse sets get wider cells. */
+    private:
+        double m_min_x {};
+        double m_min_y {};
+        double m_cell_size { 1 };
+        size_t m_nx { 0 };
+        size_t m_ny { 0 };
+
+        std::vector<uint32_t> m_cell_start {};
+        std::vector<uint32_t> m_points {};
+        std::vector<uint32_t> m_point_cells {};
+
+    public:
+        void build(const double* x, const double* y, size_t n, double cell_size);
+
+        size_t size() const { return m_points.size(); }
+        size_t num_cells() const { return m_nx * m_ny; }
+        double cell_size() const { return m_cell_size; }
+
+        template <typename Function>
+        void for_each_candidate_pair(Function&& function) const
+        {
+            /* Every unordered pair sharing a cell or adjacent cells exactly once: each cell
+               is paired with itself and with half of its neighbours. */
+            static constexpr int stencil[4][2] { { 1, 0 }, { -1, 1 }, { 0, 1 }, { 1, 1 } };
+
+            for (size_t cy = 0; cy < m_ny; ++cy) {
+                for (size_t cx = 0; cx < m_nx; ++cx) {
+                    size_t cell = cy * m_nx + cx;
+                    uint32_t begin = m_cell_start[cell];
+                    uint32_t end = m_cell_start[cell + 1];
+
+                    for (uint32_t a = begin; a < end; ++a) {
+                        for (uint32_t b = a + 1; b < end; ++b) {
+                            function(m_points[a], m_points[b]);
+                        }
+                    }
+
+                    for (auto& offset : stencil) {
+                        auto nx = static_cast<long>(cx) + offset[0];
+                        auto ny = static_cast<long>(cy) + offset[1];
+                        if (nx < 0 || ny < 0 || nx >= static_cast<long>(m_nx) || ny >= static_cast<long>(m_ny)) {
+                            continue;
+                        }
+
+                        size_t other = static_cast<size_t>(ny) * m_nx + static_cast<size_t>(nx);
+                        for (uint32_t a = begin; a < end; ++a) {
+                            for (uint32_t b = m_cell_start[other]; b < m_cell_start[other + 1]; ++b) {
+                                function(m_points[a], m_points[b]);
+                            }
+                        }
+                    }
+                }
+            }
+        }
+};
+
+#endif
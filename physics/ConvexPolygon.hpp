@@ -0,0 +1,208 @@
+#ifndef CONVEX_POLYGON_HPP
+#define CONVEX_POLYGON_HPP
+
+#include <array>
+#include <cmath>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <limits>
+#include <algorithm>
+
+#include "simd.hpp"
+#include "vector2.hpp"
+
+
+class ConvexPolygon
+{
+    /* Brief: Clockwise convex polygon in local space with its outward edge normals. Vertex i
+              is adjacent to vertices i-1 and i+1 (mod n) and edge i joins vertex i to i+1.
+              Dot products with a fixed direction are unimodal around the ring, so extreme
+              vertex queries hill climb from a starting vertex instead of scanning. Cold
+              queries start from a table of support vertices for NUM_SECTORS directions.
+              Degenerate cores of rounded shapes (a point, a segment) are supported. */
+
+    public:
+        static constexpr size_t NUM_SECTORS { 16 };
+
+    private:
+        std::vector<vector2> m_vertices {};
+        std::vector<vector2> m_normals {};
+        std::array<uint32_t, NUM_SECTORS> m_sector_support {};
+
+        PlaneArrays<double> m_planes {};
+
+        template <typename T>
+        void fill_planes(PlaneArrays<T>& planes) const
+        {
+            size_t padded = (m_normals.size() + G_SIMD_PADDING - 1) / G_SIMD_PADDING * G_SIMD_PADDING;
+
+            planes.nx.assign(padded, 0);
+            planes.ny.assign(padded, 0);
+            planes.offset.assign(padded, std::numeric_limits<T>::max());
+
+            for (size_t i = 0; i < m_normals.size(); ++i) {
+                planes.nx[i] = static_cast<T>(m_normals[i].x);
+                planes.ny[i] = static_cast<T>(m_normals[i].y);
+                planes.offset[i] = static_cast<T>(m_normals[i] * m_vertices[i]);
+            }
+        }
+
+        // Monotonic pseudo angle in [0, 4), avoids atan2 when bucketing directions
+        static double pseudo_angle(const vector2& d)
+        {
+            double p = d.y / (std::abs(d.x) + std::abs(d.y));
+            return (d.x < 0) ? 2 - p : (p < 0 ? 4 + p : p);
+        }
+
+        static size_t sector(const vector2& d)
+        {
+            if (d.x == 0 && d.y == 0) {
+                return 0;
+            }
+
+            size_t s = static_cast<size_t>(pseudo_angle(d) * (NUM_SECTORS / 4.0));
+            return s < NUM_SECTORS ? s : NUM_SECTORS - 1;
+        }
+
+        size_t linear_support(const vector2& direction) const
+        {
+            size_t best = 0;
+            double max = m_vertices[0] * direction;
+
+            for (size_t i = 1; i < m_vertices.size(); ++i) {
+                double projection = m_vertices[i] * direction;
+                if (projection > max) {
+                    max = projection;
+                    best = i;
+                }
+            }
+
+            return best;
+        }
+
+    public:
+        ConvexPolygon() = default;
+
+        explicit ConvexPolygon(std::vector<vector2>&& vertices) : m_vertices(std::move(vertices))
+        {
+            size_t n = m_vertices.size() > 1 ? m_vertices.size() : 0;
+            m_normals.resize(n);
+
+            for (size_t i = 0; i < n; ++i) {
+                vector2 ab = m_vertices[(i + 1) % n] - m_vertices[i];
+                m_normals[i] = normalize(perpendicular(ab));
+            }
+
+            fill_planes(m_planes);
+
+            // Support vertex of the direction in the middle of each sector
+            for (size_t s = 0; s < NUM_SECTORS; ++s) {
+                double p = (s + 0.5) * 4.0 / NUM_SECTORS;
+                vector2 d = (p < 1) ? vector2 { 1 - p, p } :
+                            (p < 2) ? vector2 { 1 - p, 2 - p } :
+                            (p < 3) ? vector2 { p - 3, 2 - p } : vector2 { p - 3, p - 4 };
+
+                m_sector_support[s] = m_vertices.empty() ? 0 : static_cast<uint32_t>(linear_support(d));
+            }
+        }
+
+        size_t size() const { return m_vertices.size(); }
+
+        const std::vector<vector2>& vertices() const { return m_vertices; }
+        const std::vector<vector2>& normals()  const { return m_normals; }
+
+        const PlaneArrays<double>& planes() const { return m_planes; }
+
+        size_t support(const vector2& direction) const
+        {
+            return support(direction, m_sector_support[sector(direction)]);
+        }
+
+        size_t support(const vector2& direction, size_t hint) const
+        {
+            size_t n = m_vertices.size();
+            if (n < 3) {
+                return (n == 2 && m_vertices[1] * direction > m_vertices[0] * direction) ? 1 : 0;
+            }
+
+            size_t i = hint < n ? hint : 0;
+            double best = m_vertices[i] * direction;
+
+            size_t next = (i + 1) % n;
+            int step = (m_vertices[next] * direction > best) ? 1 : -1;
+
+            for (size_t k = 0; k < n; ++k) {
+                size_t j = (i + n + step) % n;
+                double projection = m_vertices[j] * direction;
+                if (projection <= best) {
+                    break;
+                }
+
+                best = projection;
+                i = j;
+            }
+
+            return i;
+        }
+
+        size_t best_edge(const vector2& direction) const
+        {
+            /* The edge whose normal is most aligned with direction is one of the two edges
+               meeting at the support vertex of direction. */
+            size_t n = m_normals.size();
+            if (n == 0) {
+                return 0;
+            }
+
+            size_t i = support(direction);
+            size_t prev = (i + n - 1) % n;
+
+            return (m_normals[prev] * direction > m_normals[i] * direction) ? prev : i;
+        }
+};
+
+
+struct ConvexProxy
+{
+    /* Brief: Polygon placed in the world by a rigid transform. Queries rotate the direction
+              into local space instead of transforming every vertex. */
+    const ConvexPolygon* polygon {};
+    vector2 position {};
+    double cos_angle { 1 };
+    double sin_angle { 0 };
+
+    size_t size() const { return polygon->size(); }
+
+    vector2 to_local(const vector2& direction) const
+    {
+        return rotate(direction, cos_angle, -sin_angle);
+    }
+
+    vector2 vertex(size_t i) const
+    {
+        return position + rotate(polygon->vertices()[i], cos_angle, sin_angle);
+    }
+
+    vector2 normal(size_t i) const
+    {
+        return rotate(polygon->normals()[i], cos_angle, sin_angle);
+    }
+
+    size_t support(const vector2& direction) const
+    {
+        return polygon->support(to_local(direction));
+    }
+
+    size_t support(const vector2& direction, size_t hint) const
+    {
+        return polygon->support(to_local(direction), hint);
+    }
+
+    size_t best_edge(const vector2& direction) const
+    {
+        return polygon->best_edge(to_local(direction));
+    }
+};
+
+#endif
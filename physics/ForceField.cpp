@@ -0,0 +1,124 @@
+#include "ForceField.hpp"
+#include "simd.hpp"
+
+#include <cmath>
+
+
+void LinearField::apply(BodyArrays& bodies) const
+{
+    accumulate_linear_field(bodies.mass.data(), bodies.vx.data(), bodies.vy.data(), bodies.flags.data(),
+                            bodies.fx.data(), bodies.fy.data(), bodies.size(), m_mask,
+                            m_acceleration, m_drag, m_flow);
+}
+
+
+double LinearField::compute_energy(const BodyArrays& bodies) const
+{
+    double energy = 0;
+
+    for (size_t i = 0; i < bodies.size(); ++i) {
+        double inside = (bodies.flags[i] & m_mask) ? 1.0 : 0.0;
+        energy -= inside * bodies.mass[i] * (m_acceleration.x * bodies.x[i] + m_acceleration.y * bodies.y[i]);
+    }
+
+    return energy;
+}
+
+
+void RadialField::apply(BodyArrays& bodies) const
+{
+    double eps2 = m_softening * m_softening;
+
+    for (size_t i = 0; i < bodies.size(); ++i) {
+        double dx = bodies.x[i] - m_center.x;
+        double dy = bodies.y[i] - m_center.y;
+        double r2 = dx * dx + dy * dy + eps2;
+
+        double inside = (bodies.flags[i] & m_mask) ? 1.0 : 0.0;
+        double scale = -inside * m_strength * bodies.mass[i] / (r2 * std::sqrt(r2));
+
+        bodies.fx[i] += scale * dx;
+        bodies.fy[i] += scale * dy;
+    }
+}
+
+
+double RadialField::compute_energy(const BodyArrays& bodies) const
+{
+    double eps2 = m_softening * m_softening;
+    double energy = 0;
+
+    for (size_t i = 0; i < bodies.size(); ++i) {
+        double dx = bodies.x[i] - m_center.x;
+        double dy = bodies.y[i] - m_center.y;
+
+        double inside = (bodies.flags[i] & m_mask) ? 1.0 : 0.0;
+        energy -= inside * m_strength * bodies.mass[i] / std::sqrt(dx * dx + dy * dy + eps2);
+    }
+
+    return energy;
+}
+
+
+void LinearField::write_state(BinaryWriter& writer) const
+{
+    writer.write(m_type);
+    writer.write(m_mask);
+    writer.write(m_acceleration);
+    writer.write(m_drag);
+    writer.write(m_flow);
+}
+
+
+void RadialField::write_state(BinaryWriter& writer) const
+{
+    writer.write(m_type);
+    writer.write(m_mask);
+    writer.write(m_center);
+    writer.write(m_strength);
+    writer.write(m_softening);
+}
+
+
+std::unique_ptr<ForceField> ForceField::read_state(BinaryReader& reader)
+{
+    auto type = reader.read<ForceFieldType>();
+    auto mask = reader.read<uint32_t>();
+
+    if (type == RADIAL_FIELD) {
+        auto center = reader.read<vector2>();
+        auto strength = reader.read<double>();
+        auto softening = reader.read<double>();
+        return std::make_unique<RadialField>(center, strength, softening, mask);
+    }
+
+    auto acceleration = reader.read<vector2>();
+    auto drag = reader.read<double>();
+    auto flow = reader.read<vector2>();
+
+    // The subclasses fix some of the parameters, the others are set through their constructor
+    std::unique_ptr<ForceField> field {};
+
+    switch (type) {
+        case LINEAR_FIELD:
+            field = std::make_unique<LinearField>(mask, acceleration, drag, flow);
+            break;
+        case GRAVITY_FIELD:
+            field = std::make_unique<GravityField>(-acceleration.y);
+            break;
+        case UNIFORM_FIELD:
+            field = std::make_unique<UniformField>(acceleration, mask);
+            break;
+        case VISCOUS_DRAG_FIELD:
+            field = std::make_unique<ViscousDragField>(drag);
+            break;
+        case WIND_FIELD:
+            field = std::make_unique<WindField>(flow, drag, mask);
+            break;
+        default:
+            throw std::runtime_error("ERROR::FORCE_FIELD::READ_STATE::UNKNOWN_FIELD_TYPE\n");
+    }
+
+    field->set_mask(mask);
+    return field;
+}
@@ -0,0 +1,175 @@
+#ifndef FORCE_FIELD_HPP
+#define FORCE_FIELD_HPP
+
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#include "vector2.hpp"
+#include "serialize.hpp"
+#include "RigidBody.hpp"
+
+
+struct BodyArrays
+{
+    /* Brief: Body state gathered into component arrays, in the storage order of the system.
+              Force fields add into fx and fy, which are scattered back into the force
+              accumulators afterwards. Bodies that fields must not move have zero flags. */
+    std::vector<double> mass {};
+    std::vector<double> x {};
+    std::vector<double> y {};
+    std::vector<double> vx {};
+    std::vector<double> vy {};
+    std::vector<double> fx {};
+    std::vector<double> fy {};
+    std::vector<uint32_t> flags {};
+
+    size_t size() const { return mass.size(); }
+
+    void resize(size_t n)
+    {
+        mass.resize(n);
+        x.resize(n);
+        y.resize(n);
+        vx.resize(n);
+        vy.resize(n);
+        fx.resize(n);
+        fy.resize(n);
+        flags.resize(n);
+    }
+};
+
+
+enum ForceFieldType
+{
+    LINEAR_FIELD,
+    GRAVITY_FIELD,
+    UNIFORM_FIELD,
+    VISCOUS_DRAG_FIELD,
+    WIND_FIELD,
+    RADIAL_FIELD,
+};
+
+
+class ForceField
+{
+    /* Brief: Force acting on every body at its centre of mass, selected by the field mask of
+              the body instead of a membership list. Works on the gathered body arrays. */
+    protected:
+        ForceFieldType m_type {};
+        uint32_t m_mask {};
+
+        ForceField(ForceFieldType type, uint32_t mask) : m_type(type), m_mask(mask) {}
+
+    public:
+        virtual ~ForceField() = default;
+
+        ForceFieldType get_type() const { return m_type; }
+        uint32_t get_mask() const { return m_mask; }
+        void set_mask(uint32_t mask) { m_mask = mask; }
+
+        virtual void apply(BodyArrays& bodies) const = 0;
+        virtual double compute_energy(const BodyArrays& bodies) const = 0;
+
+        /* Type, mask and parameters, read_state() builds the field of the right class. */
+        virtual void write_state(BinaryWriter& writer) const = 0;
+        static std::unique_ptr<ForceField> read_state(BinaryReader& reader);
+};
+
+
+class LinearField : public ForceField
+{
+    /* Brief: F = m*a + c*(w - v), a uniform acceleration plus linear drag towards a flow
+              velocity. Gravity, uniform fields, viscous drag and wind are all of this form
+              and share one vectorised kernel. Only the acceleration part has an energy. */
+    protected:
+        vector2 m_acceleration {};
+        double m_drag {};
+        vector2 m_flow {};
+
+    public:
+        LinearField(uint32_t mask, const vector2& acceleration, double drag, const vector2& flow) :
+        ForceField(LINEAR_FIELD, mask), m_acceleration(acceleration), m_drag(drag), m_flow(flow)
+        {
+            if (drag < 0) {
+                throw std::runtime_error("ERROR::LINEAR_FIELD::NEGATIVE_DRAG\n");
+            }
+        }
+
+        void apply(BodyArrays& bodies) const override;
+        double compute_energy(const BodyArrays& bodies) const override;
+
+        void write_state(BinaryWriter& writer) const override;
+};
+
+
+class GravityField : public LinearField
+{
+    public:
+        explicit GravityField(double g) : LinearField(FIELD_GRAVITY, { 0, -g }, 0, { 0, 0 }) { m_type = GRAVITY_FIELD; }
+
+        void set_g(double g) { m_acceleration = { 0, -g }; }
+};
+
+
+class UniformField : public LinearField
+{
+    public:
+        explicit UniformField(const vector2& acceleration, uint32_t mask = FIELD_UNIFORM) :
+        LinearField(mask, acceleration, 0, { 0, 0 }) { m_type = UNIFORM_FIELD; }
+
+        void set_acceleration(const vector2& acceleration) { m_acceleration = acceleration; }
+};
+
+
+class ViscousDragField : public LinearField
+{
+    public:
+        explicit ViscousDragField(double coefficient) : LinearField(FIELD_DRAG, { 0, 0 }, coefficient, { 0, 0 })
+        {
+            m_type = VISCOUS_DRAG_FIELD;
+        }
+
+        void set_coefficient(double coefficient) { m_drag = coefficient; }
+};
+
+
+class WindField : public LinearField
+{
+    public:
+        WindField(const vector2& velocity, double coefficient, uint32_t mask = FIELD_WIND) :
+        LinearField(mask, { 0, 0 }, coefficient, velocity) { m_type = WIND_FIELD; }
+
+        void set_velocity(const vector2& velocity) { m_flow = velocity; }
+};
+
+
+class RadialField : public ForceField
+{
+    /* Brief: Plummer softened point source, F = -k*m*r/(|r|^2 + eps^2)^(3/2) with r measured
+              from the centre. Attracts for positive strength k, repels for negative. */
+    private:
+        vector2 m_center {};
+        double m_strength {};
+        double m_softening {};
+
+    public:
+        RadialField(const vector2& center, double strength, double softening, uint32_t mask = FIELD_RADIAL) :
+        ForceField(RADIAL_FIELD, mask), m_center(center), m_strength(strength), m_softening(softening)
+        {
+            if (softening <= 0) {
+                throw std::runtime_error("ERROR::RADIAL_FIELD::NON_POSITIVE_SOFTENING\n");
+            }
+        }
+
+        void set_center(const vector2& center) { m_center = center; }
+        void set_strength(double strength) { m_strength = strength; }
+
+        void apply(BodyArrays& bodies) const override;
+        double compute_energy(const BodyArrays& bodies) const override;
+
+        void write_state(BinaryWriter& writer) const override;
+};
+
+#endif
@@ -1,56 +1,90 @@
 #include "ForceGenerator.hpp"
+#include "parallel.hpp"
 
+#include <cmath>
+#include <algorithm>
 
-void ForceGenerator::add_body(RigidBody* body)
-{   
-    if (m_bodies.size() < m_max_nbodies) {
-        m_bodies.emplace_back(body);
-    } else {
-        throw std::runtime_error("ERROR::FORCE_GENRATOR::MAX_CAPACITY\n");
+
+static uint32_t checkpoint_index(const BodyIndexMap& indices, const RigidBody* body)
+{
+    auto it = indices.find(body);
+    if (it == indices.end()) {
+        throw std::runtime_error("ERROR::FORCE_GENERATOR::CHECKPOINT::BODY_NOT_IN_SYSTEM\n");
     }
+    return it->second;
 }
 
 
-bool GravityGenerator::del_body(std::string_view id)
+static RigidBody* checkpoint_body(const std::vector<RigidBody*>& bodies, uint32_t index)
 {
-    for (auto it = m_bodies.begin(); it != m_bodies.end(); ++it) {
-        if ((*it)->get_id() == id)
-        {
-            m_bodies.erase(it);
-            break;
-        }
+    if (index >= bodies.size()) {
+        throw std::runtime_error("ERROR::FORCE_GENERATOR::CHECKPOINT::BODY_INDEX_OUT_OF_RANGE\n");
     }
+    return bodies[index];
+}
 
-    return false;
+
+void ForceGenerator::write_bodies(BinaryWriter& writer, const BodyIndexMap& indices) const
+{
+    std::vector<uint32_t> body_indices(m_bodies.size());
+    for (size_t i = 0; i < m_bodies.size(); ++i) {
+        body_indices[i] = checkpoint_index(indices, m_bodies[i]);
+    }
+
+    writer.write(m_accumulation);
+    writer.write<uint64_t>(m_max_nbodies);
+    writer.write<uint64_t>(m_bodies_version);
+    writer.write_array(body_indices);
 }
 
 
-void GravityGenerator::apply_force() const
+void ForceGenerator::read_bodies(BinaryReader& reader, const std::vector<RigidBody*>& bodies)
 {
-    for(auto& b : m_bodies) {
-        double mass = 1/b->get_inverse_mass();
-        b->force_accumulator +=  vector2 {0.0, -m_g * mass};
+    m_accumulation = reader.read<AccumulationMode>();
+    m_max_nbodies = reader.read<uint64_t>();
+    m_bodies_version = reader.read<uint64_t>();
+
+    auto body_indices = reader.read_array<uint32_t>();
+    m_bodies.resize(body_indices.size());
+    for (size_t i = 0; i < body_indices.size(); ++i) {
+        m_bodies[i] = checkpoint_body(bodies, body_indices[i]);
     }
 }
 
 
-double GravityGenerator::compute_energy() const 
+static RigidBody* remapped(const BodyRemap& remap, RigidBody* body)
 {
-    double energy = 0;
-    for(auto& b : m_bodies) {
-        energy += 1/b->get_inverse_mass() * m_g * b->position.y;
+    auto it = remap.find(body);
+    return (it == remap.end()) ? body : it->second;
+}
+
+
+void ForceGenerator::remap_bodies(const BodyRemap& remap)
+{
+    for (RigidBody*& body : m_bodies) {
+        body = remapped(remap, body);
     }
+}
 
-    return energy;
+
+void ForceGenerator::add_body(RigidBody* body)
+{   
+    if (m_bodies.size() < m_max_nbodies) {
+        m_bodies.emplace_back(body);
+        ++m_bodies_version;
+    } else {
+        throw std::runtime_error("ERROR::FORCE_GENRATOR::MAX_CAPACITY\n");
+    }
 }
 
 
-bool SpringGenerator::del_body(std::string_view id) 
+bool SpringGenerator::del_body(const RigidBody* body) 
 {   
     for (auto it = m_bodies.begin(); it != m_bodies.end(); ++it) {
-        if ((*it)->get_id() == id)
+        if (*it == body)
         {
             m_bodies.erase(it);
+            ++m_bodies_version;
             return true;
         }
     }
@@ -59,6 +93,12 @@ bool SpringGenerator::del_body(std::string_view id)
 }
 
 
+bool SpringGenerator::del_pending_bodies()
+{
+    return m_b1->is_pending_removal() || m_b2->is_pending_removal();
+}
+
+
 void SpringGenerator::apply_force() const
 {   
     vector2 anchor_pos1 = m_b1->get_anchor_position(anchor1);
@@ -81,5 +121,554 @@ void SpringGenerator::apply_force() const
 
 double SpringGenerator::compute_energy() const 
 {
-    return 0 ;
-}
\ No newline at end of file
+    vector2 delta = m_b2->get_anchor_position(anchor2) - m_b1->get_anchor_position(anchor1);
+    double stretch = delta.norm() - m_spring_length;
+
+    return 0.5 * m_spring_constant * stretch * stretch;
+}
+
+void SpringGenerator::write_state(BinaryWriter& writer, const BodyIndexMap& indices) const
+{
+    writer.write(checkpoint_index(indices, m_b1));
+    writer.write(checkpoint_index(indices, m_b2));
+    writer.write(m_spring_length);
+    writer.write(m_spring_constant);
+    writer.write(anchor1);
+    writer.write(anchor2);
+    write_bodies(writer, indices);
+}
+
+
+void SpringGenerator::remap_bodies(const BodyRemap& remap)
+{
+    ForceGenerator::remap_bodies(remap);
+    m_b1 = remapped(remap, m_b1);
+    m_b2 = remapped(remap, m_b2);
+}
+
+
+std::unique_ptr<SpringGenerator> SpringGenerator::read_state(BinaryReader& reader, const std::vector<RigidBody*>& bodies)
+{
+    RigidBody* b1 = checkpoint_body(bodies, reader.read<uint32_t>());
+    RigidBody* b2 = checkpoint_body(bodies, reader.read<uint32_t>());
+    auto spring_length = reader.read<double>();
+    auto spring_constant = reader.read<double>();
+    auto a1 = reader.read<AnchorType>();
+    auto a2 = reader.read<AnchorType>();
+
+    auto spring = std::make_unique<SpringGenerator>(std::pair { b1, b2 }, spring_length, spring_constant, a1, a2);
+    spring->read_bodies(reader, bodies);
+    return spring;
+}
+
+
+uint32_t SpringNetwork::body_index(RigidBody* body)
+{
+    if (body == nullptr) {
+        throw std::runtime_error("ERROR::SPRING_NETWORK::NULL_BODY\n");
+    }
+
+    auto [it, inserted] = m_body_indices.try_emplace(body, static_cast<uint32_t>(m_bodies.size()));
+    if (inserted) {
+        m_bodies.push_back(body);
+        ++m_max_nbodies;
+        ++m_bodies_version;
+    }
+
+    return it->second;
+}
+
+
+void SpringNetwork::add_spring(RigidBody* a, RigidBody* b, const vector2& local_anchor_a, const vector2& local_anchor_b,
+                               double rest_length, double stiffness, double damping)
+{
+    if (a == b) {
+        throw std::runtime_error("ERROR::SPRING_NETWORK::SPRING_TO_ITSELF\n");
+    }
+
+    if (rest_length < 0) {
+        throw std::runtime_error("ERROR::SPRING_NETWORK::SPRING_LENGTH_NEGATIVE\n");
+    }
+
+    if (stiffness <= 0) {
+        throw std::runtime_error("ERROR::SPRING_NETWORK::SPRING_CONSTANT_NON_POSITIVE\n");
+    }
+
+    if (damping < 0) {
+        throw std::runtime_error("ERROR::SPRING_NETWORK::DAMPING_NEGATIVE\n");
+    }
+
+    m_body_a.push_back(body_index(a));
+    m_body_b.push_back(body_index(b));
+    m_anchor_ax.push_back(local_anchor_a.x);
+    m_anchor_ay.push_back(local_anchor_a.y);
+    m_anchor_bx.push_back(local_anchor_b.x);
+    m_anchor_by.push_back(local_anchor_b.y);
+    m_rest_length.push_back(rest_length);
+    m_stiffness.push_back(stiffness);
+    m_damping.push_back(damping);
+
+    m_colouring_dirty = true;
+}
+
+
+void SpringNetwork::add_spring(RigidBody* a, RigidBody* b, AnchorType anchor_a, AnchorType anchor_b,
+                               double rest_length, double stiffness, double damping)
+{
+    if (a == nullptr || b == nullptr) {
+        throw std::runtime_error("ERROR::SPRING_NETWORK::NULL_BODY\n");
+    }
+
+    add_spring(a, b, a->get_local_anchor(anchor_a), b->get_local_anchor(anchor_b), rest_length, stiffness, damping);
+}
+
+
+void SpringNetwork::reserve(size_t nsprings)
+{
+    for (auto* array : { &m_body_a, &m_body_b }) {
+        array->reserve(nsprings);
+    }
+
+    for (auto* array : { &m_anchor_ax, &m_anchor_ay, &m_anchor_bx, &m_anchor_by, 
+                         &m_rest_length, &m_stiffness, &m_damping }) {
+        array->reserve(nsprings);
+    }
+}
+
+
+void SpringNetwork::update_colouring() const
+{
+    if (m_colouring_dirty) {
+        colour_springs();
+    }
+}
+
+
+size_t SpringNetwork::num_colours() const
+{
+    update_colouring();
+
+    return m_colour_offsets.empty() ? 0 : m_colour_offsets.size() - 1;
+}
+
+
+void SpringNetwork::colour_springs() const
+{   
+    /* Greedy edge colouring: every spring takes the lowest colour neither of its bodies
+       has yet, at most 2*max_degree - 1 colours. The spring arrays are then permuted into
+       colour order. */
+    size_t n = m_body_a.size();
+    std::vector<std::vector<uint32_t>> body_colours(m_bodies.size());
+    std::vector<uint32_t> colours(n);
+    uint32_t ncolours = 0;
+
+    for (size_t i = 0; i < n; ++i) {
+        const auto& used_a = body_colours[m_body_a[i]];
+        const auto& used_b = body_colours[m_body_b[i]];
+
+        uint32_t colour = 0;
+        while (std::find(used_a.begin(), used_a.end(), colour) != used_a.end() ||
+               std::find(used_b.begin(), used_b.end(), colour) != used_b.end()) {
+            ++colour;
+        }
+
+        colours[i] = colour;
+        body_colours[m_body_a[i]].push_back(colour);
+        body_colours[m_body_b[i]].push_back(colour);
+        ncolours = std::max(ncolours, colour + 1);
+    }
+
+    // Counting sort by colour, stable so springs keep their relative order
+    m_colour_offsets.assign(ncolours + 1, 0);
+    for (uint32_t c : colours) {
+        ++m_colour_offsets[c + 1];
+    }
+    for (size_t c = 0; c < ncolours; ++c) {
+        m_colour_offsets[c + 1] += m_colour_offsets[c];
+    }
+
+    std::vector<size_t> new_to_old(n);
+    std::vector<size_t> next(m_colour_offsets.begin(), m_colour_offsets.end() - 1);
+    for (size_t i = 0; i < n; ++i) {
+        new_to_old[next[colours[i]]++] = i;
+    }
+
+    auto permute = [&](auto& array)
+    {
+        std::remove_reference_t<decltype(array)> sorted(n);
+        for (size_t i = 0; i < n; ++i) {
+            sorted[i] = array[new_to_old[i]];
+        }
+        array = std::move(sorted);
+    };
+
+    permute(m_body_a);
+    permute(m_body_b);
+    permute(m_anchor_ax);
+    permute(m_anchor_ay);
+    permute(m_anchor_bx);
+    permute(m_anchor_by);
+    permute(m_rest_length);
+    permute(m_stiffness);
+    permute(m_damping);
+
+    m_colouring_dirty = false;
+}
+
+
+void SpringNetwork::gather_bodies() const
+{   
+    /* The rotation is taken from the angle, the cached one of the body lags behind it 
+       between the stages of an integrator step. */
+    size_t nbodies = m_bodies.size();
+
+    for (auto* array : { &m_px, &m_py, &m_cos, &m_sin, &m_vx, &m_vy, &m_omega }) {
+        array->resize(nbodies);
+    }
+    m_fx.assign(nbodies, 0);
+    m_fy.assign(nbodies, 0);
+    m_torque.assign(nbodies, 0);
+
+    for (size_t j = 0; j < nbodies; ++j) {
+        const RigidBody* b = m_bodies[j];
+        m_px[j] = b->position.x;
+        m_py[j] = b->position.y;
+        m_cos[j] = std::cos(b->angle);
+        m_sin[j] = std::sin(b->angle);
+        m_vx[j] = b->velocity.x;
+        m_vy[j] = b->velocity.y;
+        m_omega[j] = b->angular_velocity;
+    }
+}
+
+
+void SpringNetwork::compute_spring_forces(size_t begin, size_t end) const
+{   
+    /* Force on body a along the unit vector from anchor a to anchor b, the opposite one on
+       body b. The damping acts on the rate of change of the spring length. */
+    for (size_t i = begin; i < end; ++i) {
+        uint32_t a = m_body_a[i];
+        uint32_t b = m_body_b[i];
+
+        double rax = m_cos[a] * m_anchor_ax[i] - m_sin[a] * m_anchor_ay[i];
+        double ray = m_sin[a] * m_anchor_ax[i] + m_cos[a] * m_anchor_ay[i];
+        double rbx = m_cos[b] * m_anchor_bx[i] - m_sin[b] * m_anchor_by[i];
+        double rby = m_sin[b] * m_anchor_bx[i] + m_cos[b] * m_anchor_by[i];
+
+        double dx = (m_px[b] + rbx) - (m_px[a] + rax);
+        double dy = (m_py[b] + rby) - (m_py[a] + ray);
+        double length = std::sqrt(dx * dx + dy * dy);
+        double inv_length = (length > 0) ? 1 / length : 0;
+        double nx = dx * inv_length;
+        double ny = dy * inv_length;
+
+        double dvx = (m_vx[b] - m_omega[b] * rby) - (m_vx[a] - m_omega[a] * ray);
+        double dvy = (m_vy[b] + m_omega[b] * rbx) - (m_vy[a] + m_omega[a] * rax);
+
+        double magnitude = m_stiffness[i] * (length - m_rest_length[i]) + m_damping[i] * (dvx * nx + dvy * ny);
+        double fx = magnitude * nx;
+        double fy = magnitude * ny;
+
+        m_spring_fx[i] = fx;
+        m_spring_fy[i] = fy;
+        m_spring_ta[i] = rax * fy - ray * fx;
+        m_spring_tb[i] = rby * fx - rbx * fy;
+    }
+}
+
+
+void SpringNetwork::scatter_spring_forces(size_t begin, size_t end, double* fx, double* fy, double* torque) const
+{
+    for (size_t i = begin; i < end; ++i) {
+        uint32_t a = m_body_a[i];
+        uint32_t b = m_body_b[i];
+
+        fx[a] += m_spring_fx[i];
+        fy[a] += m_spring_fy[i];
+        torque[a] += m_spring_ta[i];
+
+        fx[b] -= m_spring_fx[i];
+        fy[b] -= m_spring_fy[i];
+        torque[b] += m_spring_tb[i];
+    }
+}
+
+
+template <typename Kernel>
+static void run_in_chunks(size_t begin, size_t end, Kernel&& kernel)
+{   
+    /* Kernels take whole ranges so their loops stay vectorisable, the threads get chunks. */
+    size_t count = end - begin;
+    if (count < 2 * G_SPRING_NETWORK_CHUNK) {
+        kernel(begin, end);
+        return;
+    }
+
+    size_t nchunks = (count + G_SPRING_NETWORK_CHUNK - 1) / G_SPRING_NETWORK_CHUNK;
+    parallel_for(0, nchunks, [&](size_t k)
+    {
+        size_t first = begin + k * G_SPRING_NETWORK_CHUNK;
+        kernel(first, std::min(end, first + G_SPRING_NETWORK_CHUNK));
+    }, 1);
+}
+
+
+void SpringNetwork::accumulate_buffered() const
+{   
+    /* Every worker takes a contiguous range of springs and owns a full set of body
+       accumulators, the sets are summed per body afterwards. Costs memory proportional
+       to workers times bodies but needs no colouring. */
+    size_t n = m_body_a.size();
+    size_t nbodies = m_bodies.size();
+    size_t threads = m_deterministic ? G_DETERMINISTIC_PARTITIONS : parallel_concurrency();
+    size_t workers = std::clamp<size_t>(n / G_SPRING_NETWORK_CHUNK, 1, threads);
+    size_t chunk = (n + workers - 1) / workers;
+
+    m_thread_buffers.resize(workers);
+
+    parallel_for(0, workers, [&](size_t w)
+    {
+        std::vector<double>& buffer = m_thread_buffers[w];
+        buffer.assign(3 * nbodies, 0);
+
+        size_t first = std::min(n, w * chunk);
+        size_t last = std::min(n, first + chunk);
+
+        compute_spring_forces(first, last);
+        scatter_spring_forces(first, last, buffer.data(), buffer.data() + nbodies, buffer.data() + 2 * nbodies);
+    }, 1);
+
+    run_in_chunks(0, nbodies, [&](size_t begin, size_t end)
+    {
+        for (auto& buffer : m_thread_buffers) {
+            for (size_t j = begin; j < end; ++j) {
+                m_fx[j] += buffer[j];
+                m_fy[j] += buffer[nbodies + j];
+                m_torque[j] += buffer[2 * nbodies + j];
+            }
+        }
+    });
+}
+
+
+void SpringNetwork::apply_force() const
+{
+    size_t n = m_body_a.size();
+    for (auto* array : { &m_spring_fx, &m_spring_fy, &m_spring_ta, &m_spring_tb }) {
+        array->resize(n);
+    }
+
+    gather_bodies();
+
+    switch (m_accumulation) {
+        case SERIAL_ACCUMULATION:
+            compute_spring_forces(0, n);
+            scatter_spring_forces(0, n, m_fx.data(), m_fy.data(), m_torque.data());
+            break;
+
+        case COLOURED_ACCUMULATION:
+            update_colouring();
+            run_in_chunks(0, n, [this](size_t begin, size_t end) { compute_spring_forces(begin, end); });
+
+            for (size_t c = 0; c + 1 < m_colour_offsets.size(); ++c) {
+                run_in_chunks(m_colour_offsets[c], m_colour_offsets[c + 1], [this](size_t begin, size_t end)
+                {
+                    scatter_spring_forces(begin, end, m_fx.data(), m_fy.data(), m_torque.data());
+                });
+            }
+            break;
+
+        case BUFFERED_ACCUMULATION:
+            accumulate_buffered();
+            break;
+    }
+
+    for (size_t j = 0; j < m_bodies.size(); ++j) {
+        m_bodies[j]->force_accumulator.x += m_fx[j];
+        m_bodies[j]->force_accumulator.y += m_fy[j];
+        m_bodies[j]->torque_accumulator += m_torque[j];
+    }
+}
+
+
+double SpringNetwork::compute_energy() const
+{
+    double energy = 0;
+
+    for (size_t i = 0; i < m_body_a.size(); ++i) {
+        const RigidBody* a = m_bodies[m_body_a[i]];
+        const RigidBody* b = m_bodies[m_body_b[i]];
+
+        vector2 anchor_a = a->position + rotate(vector2 { m_anchor_ax[i], m_anchor_ay[i] }, a->angle);
+        vector2 anchor_b = b->position + rotate(vector2 { m_anchor_bx[i], m_anchor_by[i] }, b->angle);
+        double stretch = (anchor_b - anchor_a).norm() - m_rest_length[i];
+
+        energy += 0.5 * m_stiffness[i] * stretch * stretch;
+    }
+
+    return energy;
+}
+
+
+void SpringNetwork::remove_springs_if(const std::vector<bool>& removed_bodies)
+{   
+    /* Compacts the spring arrays and the body table in place, preserving the order. */
+    size_t kept = 0;
+
+    for (size_t i = 0; i < m_body_a.size(); ++i) {
+        if (removed_bodies[m_body_a[i]] || removed_bodies[m_body_b[i]]) {
+            continue;
+        }
+
+        m_body_a[kept] = m_body_a[i];
+        m_body_b[kept] = m_body_b[i];
+        m_anchor_ax[kept] = m_anchor_ax[i];
+        m_anchor_ay[kept] = m_anchor_ay[i];
+        m_anchor_bx[kept] = m_anchor_bx[i];
+        m_anchor_by[kept] = m_anchor_by[i];
+        m_rest_length[kept] = m_rest_length[i];
+        m_stiffness[kept] = m_stiffness[i];
+        m_damping[kept] = m_damping[i];
+        ++kept;
+    }
+
+    for (auto* array : { &m_body_a, &m_body_b }) {
+        array->resize(kept);
+    }
+    for (auto* array : { &m_anchor_ax, &m_anchor_ay, &m_anchor_bx, &m_anchor_by, 
+                         &m_rest_length, &m_stiffness, &m_damping }) {
+        array->resize(kept);
+    }
+
+    std::vector<uint32_t> remap(m_bodies.size());
+    size_t kept_bodies = 0;
+
+    for (size_t j = 0; j < m_bodies.size(); ++j) {
+        if (removed_bodies[j]) {
+            m_body_indices.erase(m_bodies[j]);
+            continue;
+        }
+
+        remap[j] = static_cast<uint32_t>(kept_bodies);
+        m_body_indices[m_bodies[j]] = remap[j];
+        m_bodies[kept_bodies++] = m_bodies[j];
+    }
+    m_bodies.resize(kept_bodies);
+    m_max_nbodies = kept_bodies;
+    ++m_bodies_version;
+
+    for (size_t i = 0; i < kept; ++i) {
+        m_body_a[i] = remap[m_body_a[i]];
+        m_body_b[i] = remap[m_body_b[i]];
+    }
+
+    m_colouring_dirty = true;
+}
+
+
+bool SpringNetwork::del_body(const RigidBody* body)
+{
+    auto it = m_body_indices.find(body);
+    if (it == m_body_indices.end()) {
+        return false;
+    }
+
+    std::vector<bool> removed(m_bodies.size(), false);
+    removed[it->second] = true;
+    remove_springs_if(removed);
+
+    return m_body_a.empty();
+}
+
+
+bool SpringNetwork::del_pending_bodies()
+{
+    std::vector<bool> removed(m_bodies.size(), false);
+    bool any = false;
+
+    for (size_t j = 0; j < m_bodies.size(); ++j) {
+        removed[j] = m_bodies[j]->is_pending_removal();
+        any = any || removed[j];
+    }
+
+    if (any) {
+        remove_springs_if(removed);
+    }
+
+    return any && m_body_a.empty();
+}
+
+
+void SpringNetwork::write_state(BinaryWriter& writer, const BodyIndexMap& indices) const
+{
+    // Springs are written in their current order with the colouring, nothing is recoloured
+    write_bodies(writer, indices);
+
+    writer.write_array(m_body_a);
+    writer.write_array(m_body_b);
+    writer.write_array(m_anchor_ax);
+    writer.write_array(m_anchor_ay);
+    writer.write_array(m_anchor_bx);
+    writer.write_array(m_anchor_by);
+    writer.write_array(m_rest_length);
+    writer.write_array(m_stiffness);
+    writer.write_array(m_damping);
+
+    writer.write_array(m_colour_offsets);
+    writer.write(m_colouring_dirty);
+}
+
+
+void SpringNetwork::remap_bodies(const BodyRemap& remap)
+{
+    ForceGenerator::remap_bodies(remap);
+
+    m_body_indices.clear();
+    for (size_t j = 0; j < m_bodies.size(); ++j) {
+        m_body_indices.emplace(m_bodies[j], static_cast<uint32_t>(j));
+    }
+}
+
+
+std::unique_ptr<SpringNetwork> SpringNetwork::read_state(BinaryReader& reader, const std::vector<RigidBody*>& bodies)
+{
+    auto network = std::make_unique<SpringNetwork>();
+    network->read_bodies(reader, bodies);
+
+    for (size_t j = 0; j < network->m_bodies.size(); ++j) {
+        network->m_body_indices.emplace(network->m_bodies[j], static_cast<uint32_t>(j));
+    }
+
+    reader.read_array(network->m_body_a);
+    reader.read_array(network->m_body_b);
+    reader.read_array(network->m_anchor_ax);
+    reader.read_array(network->m_anchor_ay);
+    reader.read_array(network->m_anchor_bx);
+    reader.read_array(network->m_anchor_by);
+    reader.read_array(network->m_rest_length);
+    reader.read_array(network->m_stiffness);
+    reader.read_array(network->m_damping);
+
+    reader.read_array(network->m_colour_offsets);
+    network->m_colouring_dirty = reader.read<bool>();
+
+    size_t n = network->m_body_a.size();
+    if (network->m_body_b.size() != n) {
+        throw std::runtime_error("ERROR::SPRING_NETWORK::READ_STATE::SIZE_MISMATCH\n");
+    }
+
+    for (auto* array : { &network->m_anchor_ax, &network->m_anchor_ay, &network->m_anchor_bx, &network->m_anchor_by,
+                         &network->m_rest_length, &network->m_stiffness, &network->m_damping }) {
+        if (array->size() != n) {
+            throw std::runtime_error("ERROR::SPRING_NETWORK::READ_STATE::SIZE_MISMATCH\n");
+        }
+    }
+
+    for (size_t i = 0; i < n; ++i) {
+        if (network->m_body_a[i] >= network->m_bodies.size() || network->m_body_b[i] >= network->m_bodies.size()) {
+            throw std::runtime_error("ERROR::SPRING_NETWORK::READ_STATE::BODY_INDEX_OUT_OF_RANGE\n");
+        }
+    }
+
+    return network;
+}
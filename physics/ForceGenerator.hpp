@@ -4,9 +4,12 @@
 #include <string>
 #include <memory>
 #include <vector>
+#include <cstdint>
 #include <string_view>
 #include <unordered_map>
 
+#include "handle.hpp"
+#include "serialize.hpp"
 #include "vector2.hpp"
 #include "RigidBody.hpp"
 
@@ -16,77 +19,108 @@ enum ForceGeneratorType
     GLOBAL_GRAVITY,
     GLOBAL_VISCOUS_DRAG,
     SPRING_CONNECTOR,
+    SPRING_NETWORK,
+    BARNES_HUT,
+    PAIR_POTENTIAL,
     NUM_FORCE_TYPES,
 };
 
 
+/* How a generator may run alongside others in compute_forces_and_torques(). Serial ones run
+   one after the other on the calling thread. The others are coloured by the bodies they touch
+   and the generators of one colour run in parallel. Batched generators additionally split
+   their own work over threads: coloured ones scatter colour by colour, buffered ones into 
+   per-thread accumulators summed at the end. */
+enum AccumulationMode
+{
+    SERIAL_ACCUMULATION,
+    COLOURED_ACCUMULATION,
+    BUFFERED_ACCUMULATION,
+};
+
+
+/* Buffered accumulators of a deterministic System, their sums are then added in the same
+   order on every machine. */
+constexpr size_t G_DETERMINISTIC_PARTITIONS { 8 };
+
+
 const std::unordered_map<ForceGeneratorType, std::string> G_FORCE_GENERATOR_STRINGS_MAP 
 {
     { GLOBAL_GRAVITY,      "Global gravity" },
     { SPRING_CONNECTOR,    "Spring-connector" },
+    { SPRING_NETWORK,      "Spring network" },
+    { BARNES_HUT,          "Barnes-Hut pair force" },
+    { PAIR_POTENTIAL,      "Short range pair potential" },
     { GLOBAL_VISCOUS_DRAG, "Global viscous drag" },
 };
 
 
+// Dense index of every body of a System, generators refer to bodies by it in checkpoints
+using BodyIndexMap = std::unordered_map<const RigidBody*, uint32_t>;
+
+// Old to new address of every body moved by System::reorder_bodies()
+using BodyRemap = std::unordered_map<const RigidBody*, RigidBody*>;
+
+
 class ForceGenerator
 {
+    friend class System;
+
     protected:
         ForceGeneratorType m_type {};
 
-        static inline int s_instance_counter {}; 
-        const std::string m_id { generate_force_id() };
+        static inline size_t s_instance_counter {}; 
+        const size_t m_serial { s_instance_counter++ };
+        ForceHandle m_handle {};
+        bool m_pending_removal { false };
+
+        AccumulationMode m_accumulation { SERIAL_ACCUMULATION };
 
         size_t m_max_nbodies {};
         std::vector<RigidBody*> m_bodies {};
 
-        static std::string generate_force_id()
-        {
-            return "fid" + std::to_string(s_instance_counter++);
-        }
+        // Bumped whenever m_bodies changes, so the System knows when to recolour
+        size_t m_bodies_version {};
+
+        // Set by the System, buffered accumulation then splits into G_DETERMINISTIC_PARTITIONS
+        bool m_deterministic { false };
 
         ForceGenerator() = default;
+
+        // Accumulation mode and body list, shared by the checkpoints of every generator
+        void write_bodies(BinaryWriter& writer, const BodyIndexMap& indices) const;
+        void read_bodies(BinaryReader& reader, const std::vector<RigidBody*>& bodies);
         
     public:
         virtual ~ForceGenerator() = default;
 
         ForceGeneratorType get_type() const { return m_type; }
-        std::string        get_id()   const { return m_id; }
+        std::string        get_id()   const { return "fid" + std::to_string(m_serial); }
+        ForceHandle        get_handle() const { return m_handle; }
+        bool               is_pending_removal() const { return m_pending_removal; }
     
         const std::vector<RigidBody*>& get_bodies() const { return m_bodies; }
+        size_t get_bodies_version() const { return m_bodies_version; }
+
+        AccumulationMode get_accumulation_mode() const { return m_accumulation; }
 
         void increase_max_nbodies() { ++m_max_nbodies; }
         void decrease_max_nbodies() { --m_max_nbodies; }
 
         void         add_body(RigidBody* body);
-        virtual bool del_body(std::string_view id) = 0;
+        // Both return true when the generator is left without purpose and should be deleted
+        virtual bool del_body(const RigidBody* body) = 0;
+        virtual bool del_pending_bodies() = 0;
         
         virtual void apply_force() const = 0;
         virtual double compute_energy() const = 0;
-};
-
-
-class GravityGenerator : public ForceGenerator
-{   
-    private:
-        double m_g {};
-
-    public:
-        GravityGenerator(const std::vector<std::unique_ptr<RigidBody>>& bodies, double g): m_g(g)
-        { 
-            m_type = GLOBAL_GRAVITY;
 
-            m_max_nbodies = bodies.size();
-            for (const auto& b : bodies) {
-                m_bodies.emplace_back(b.get());
-            }
-        }
+        /* Parameters and state, read back by the static read_state() of the same class. */
+        virtual void write_state(BinaryWriter& writer, const BodyIndexMap& indices) const = 0;
 
-        void set_g(double g) { m_g = g; }
-
-        bool del_body(std::string_view id) override;
-
-        void apply_force() const override;
-        double compute_energy() const  override;
+        /* Points every body reference at the new address of a relocated body, bodies missing
+           from the map stay where they are. */
+        virtual void remap_bodies(const BodyRemap& remap);
 };
 
 
@@ -121,10 +155,98 @@ class SpringGenerator : public ForceGenerator
             }
         }
         
-        bool del_body(std::string_view id) override;
+        bool del_body(const RigidBody* body) override;
+        bool del_pending_bodies() override;
+
+        void apply_force() const override;
+        double compute_energy() const override;
+
+        void write_state(BinaryWriter& writer, const BodyIndexMap& indices) const override;
+        void remap_bodies(const BodyRemap& remap) override;
+        static std::unique_ptr<SpringGenerator> read_state(BinaryReader& reader, const std::vector<RigidBody*>& bodies);
+};
+
+// Springs per thread in a parallel evaluation
+constexpr size_t G_SPRING_NETWORK_CHUNK { 4096 };
+
+// Generators per thread when the generators of a colour run in parallel
+constexpr size_t G_FORCE_COLOUR_CHUNK { 256 };
+
+
+class SpringNetwork : public ForceGenerator
+{   
+    /* Brief: Many damped springs in one generator, stored as flat arrays over a local table of
+              bodies. An evaluation gathers the state of every body once, computes all spring
+              forces in one loop and scatters them onto the bodies. Coloured networks scatter
+              colour by colour, springs of one colour share no body so a colour is scattered
+              in parallel without atomics. Springs are kept sorted by colour, the colouring is
+              rebuilt lazily after edits. Buffered networks give every thread its own body
+              accumulators instead. */
+    private:
+        std::unordered_map<const RigidBody*, uint32_t> m_body_indices {};
+
+        /* The order of the springs is private, colour_springs() permutes them on a const
+           network the first time it is evaluated after an edit. */
+        mutable std::vector<uint32_t> m_body_a {};
+        mutable std::vector<uint32_t> m_body_b {};
+        mutable std::vector<double> m_anchor_ax {};
+        mutable std::vector<double> m_anchor_ay {};
+        mutable std::vector<double> m_anchor_bx {};
+        mutable std::vector<double> m_anchor_by {};
+        mutable std::vector<double> m_rest_length {};
+        mutable std::vector<double> m_stiffness {};
+        mutable std::vector<double> m_damping {};
+
+        // Springs of colour c are [m_colour_offsets[c], m_colour_offsets[c + 1])
+        mutable std::vector<size_t> m_colour_offsets {};
+        mutable bool m_colouring_dirty { false };
+
+        /* Scratch state of the bodies and of the springs, reused between evaluations. */
+        mutable std::vector<double> m_px {}, m_py {}, m_cos {}, m_sin {};
+        mutable std::vector<double> m_vx {}, m_vy {}, m_omega {};
+        mutable std::vector<double> m_fx {}, m_fy {}, m_torque {};
+        mutable std::vector<double> m_spring_fx {}, m_spring_fy {};
+        mutable std::vector<double> m_spring_ta {}, m_spring_tb {};
+        mutable std::vector<std::vector<double>> m_thread_buffers {};
+
+        uint32_t body_index(RigidBody* body);
+        void colour_springs() const;
+        void update_colouring() const;
+        void gather_bodies() const;
+        void compute_spring_forces(size_t begin, size_t end) const;
+        void scatter_spring_forces(size_t begin, size_t end, double* fx, double* fy, double* torque) const;
+        void accumulate_buffered() const;
+        void remove_springs_if(const std::vector<bool>& removed_bodies);
+
+    public:
+        explicit SpringNetwork(AccumulationMode mode = SERIAL_ACCUMULATION)
+        {
+            m_type = SPRING_NETWORK;
+            m_accumulation = mode;
+        }
+
+        size_t size() const { return m_body_a.size(); }
+        size_t num_colours() const;
+
+        /* Anchors are given in the body frames, relative to the centres of mass. */
+        void add_spring(RigidBody* a, RigidBody* b, const vector2& local_anchor_a, const vector2& local_anchor_b,
+                        double rest_length, double stiffness, double damping = 0);
+
+        void add_spring(RigidBody* a, RigidBody* b, AnchorType anchor_a, AnchorType anchor_b,
+                        double rest_length, double stiffness, double damping = 0);
+
+        void reserve(size_t nsprings);
+
+        // Both drop the springs of the removed bodies and return true once no spring is left
+        bool del_body(const RigidBody* body) override;
+        bool del_pending_bodies() override;
 
         void apply_force() const override;
         double compute_energy() const override;
+
+        void write_state(BinaryWriter& writer, const BodyIndexMap& indices) const override;
+        void remap_bodies(const BodyRemap& remap) override;
+        static std::unique_ptr<SpringNetwork> read_state(BinaryReader& reader, const std::vector<RigidBody*>& bodies);
 };
 
-#endif
\ No newline at end of file
+#endif
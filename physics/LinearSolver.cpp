@@ -1,4 +1,5 @@
 #include "LinearSolver.hpp"
+#include "profiling.hpp"
 
 std::vector<double> ConjugateGradSleSolver::solve()
 {
@@ -39,5 +40,7 @@ std::vector<double> ConjugateGradSleSolver::solve()
         }
     }
 
+    MECSIM_PROFILE_COUNT(COUNTER_CG_ITERATIONS, i);
+
     return m_solution;
 }
\ No newline at end of file
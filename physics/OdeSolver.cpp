@@ -38,6 +38,29 @@ void OdeSolver::backtrack(double time_step)
 }
 
 
+void OdeSolver::drift(double h)
+{
+    for (auto& b : m_sys->get_rigid_bodies()) {
+        b->position += h * b->velocity;
+        b->angle    += h * b->angular_velocity;
+    }
+
+    m_sys->accumulate_time(h);
+}
+
+
+void OdeSolver::kick(double h)
+{
+    m_sys->clear_forces_and_torques();
+    m_sys->compute_forces_and_torques();
+
+    for (auto& b : m_sys->get_rigid_bodies()) {
+        b->velocity         += h * b->force_accumulator  * b->get_inverse_mass();
+        b->angular_velocity += h * b->torque_accumulator * b->get_inverse_inertia();
+    }
+}
+
+
 void ForwardEuler::step(double time_step)
 {   
     fill_body_state_buffer();
@@ -53,7 +76,7 @@ void ForwardEuler::step(double time_step)
         b->position += h * b->velocity;
         b->velocity += h * b->force_accumulator * b->get_inverse_mass();
 
-        b->update_polygon_features();
+        b->update_transform();
     }
     
     m_sys->accumulate_time(h);
@@ -199,7 +222,54 @@ void LeapFrog::step(double time_step)
     for (auto& b : m_sys->get_rigid_bodies()) {
         b->velocity         += 0.5 * h * b->force_accumulator  * b->get_inverse_mass();
         b->angular_velocity += 0.5 * h * b->torque_accumulator * b->get_inverse_inertia();
-        b->update_polygon_features();
+        b->update_transform();
+    }
+}
+
+
+// Triple jump weights: w1 = 1/(2 - 2^(1/3)), w0 = 1 - 2*w1
+static const double G_TRIPLE_JUMP_W1 = 1.0 / (2.0 - std::cbrt(2.0));
+static const double G_TRIPLE_JUMP_W0 = 1.0 - 2.0 * G_TRIPLE_JUMP_W1;
+
+
+void ForestRuth::step(double time_step)
+{
+    fill_body_state_buffer();
+    double h = time_step;
+    double w0 = G_TRIPLE_JUMP_W0;
+    double w1 = G_TRIPLE_JUMP_W1;
+
+    drift(0.5 * w1 * h);
+    kick(w1 * h);
+    drift(0.5 * (w0 + w1) * h);
+    kick(w0 * h);
+    drift(0.5 * (w0 + w1) * h);
+    kick(w1 * h);
+    drift(0.5 * w1 * h);
+
+    for (auto& b : m_sys->get_rigid_bodies()) {
+        b->update_transform();
+    }
+}
+
+
+void Yoshida4::step(double time_step)
+{
+    fill_body_state_buffer();
+    double h = time_step;
+    double w0 = G_TRIPLE_JUMP_W0;
+    double w1 = G_TRIPLE_JUMP_W1;
+
+    kick(0.5 * w1 * h);
+    drift(w1 * h);
+    kick(0.5 * (w0 + w1) * h);
+    drift(w0 * h);
+    kick(0.5 * (w0 + w1) * h);
+    drift(w1 * h);
+    kick(0.5 * w1 * h);
+
+    for (auto& b : m_sys->get_rigid_bodies()) {
+        b->update_transform();
     }
 }
 
@@ -213,6 +283,8 @@ std::unique_ptr<OdeSolver> ode_solver_make_unique(OdeSolverType type, System* sy
         case OdeSolverType::IMPROVED_EULER: return nullptr;
         case OdeSolverType::RUNGE_KUTTA4:   return nullptr;
         case OdeSolverType::LEAPFROG:       return std::make_unique<LeapFrog>(sys);
+        case OdeSolverType::FOREST_RUTH:    return std::make_unique<ForestRuth>(sys);
+        case OdeSolverType::YOSHIDA4:       return std::make_unique<Yoshida4>(sys);
     }
 
     return nullptr;
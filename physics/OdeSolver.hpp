@@ -13,6 +13,8 @@ enum OdeSolverType
     IMPROVED_EULER,
     RUNGE_KUTTA4,
     LEAPFROG,
+    FOREST_RUTH,
+    YOSHIDA4,
 };
 
 
@@ -21,6 +23,9 @@ const std::unordered_map<OdeSolverType, std::string> G_ODE_SOLVER_STRINGS_MAP
     { FORWARD_EULER,  "Forward Euler" },
     { IMPROVED_EULER, "Improved Euler" },
     { RUNGE_KUTTA4,   "Runge Kutta 4" },
+    { LEAPFROG,       "Leapfrog" },
+    { FOREST_RUTH,    "Forest-Ruth" },
+    { YOSHIDA4,       "Yoshida 4" },
 };
 
 
@@ -41,6 +46,11 @@ class OdeSolver
         void fill_body_state_buffer();
         void scatter_body_state_buffer();
 
+        // Splitting sub-steps shared by the symplectic integrators: drift advances the
+        // configuration with the current velocities, kick evaluates forces and updates them.
+        void drift(double h);
+        void kick(double h);
+
         // void fill_rigid_body_position_buffer();
         // void fill_rigid_body_velocity_buffer();
         // void fill_angular_velocity_buffer();
@@ -87,6 +97,31 @@ class LeapFrog : public OdeSolver
 };
 
 
+/* Fourth order symplectic integrators built by composing three second order steps of 
+   lengths w1*h, w0*h, w1*h (Yoshida's triple jump). Energy error stays bounded over long runs 
+   and scales as h^4, against h^2 for LeapFrog. */
+
+class ForestRuth : public OdeSolver
+{   
+    /* Brief: Drift-kick-drift form, three force evaluations per step. */
+
+    public:
+        ForestRuth(System* sys) : OdeSolver(sys) {}
+        void step(double time_step) override;
+};
+
+
+class Yoshida4 : public OdeSolver
+{   
+    /* Brief: Kick-drift-kick form, four force evaluations per step. Velocities are 
+              synchronised with positions at the end of each step. */
+
+    public:
+        Yoshida4(System* sys) : OdeSolver(sys) {}
+        void step(double time_step) override;
+};
+
+
 std::unique_ptr<OdeSolver> ode_solver_make_unique(OdeSolverType type, System* sys); 
 
 #endif 
\ No newline at end of file
@@ -0,0 +1,346 @@
+#include "PairPotential.hpp"
+#include "parallel.hpp"
+
+#include <cmath>
+#include <algorithm>
+
+
+PairPotentialGenerator::PairPotentialGenerator(PairPotential potential, double epsilon, double sigma,
+                                               double cutoff, double skin, AccumulationMode mode) :
+m_potential(potential), m_epsilon(epsilon), m_sigma(sigma), m_cutoff(cutoff), m_skin(skin)
+{
+    m_type = PAIR_POTENTIAL;
+    m_accumulation = mode;
+
+    if (epsilon <= 0) {
+        throw std::runtime_error("ERROR::PAIR_POTENTIAL_GENERATOR::NON_POSITIVE_EPSILON\n");
+    }
+
+    if (sigma <= 0) {
+        throw std::runtime_error("ERROR::PAIR_POTENTIAL_GENERATOR::NON_POSITIVE_SIGMA\n");
+    }
+
+    if (skin < 0) {
+        throw std::runtime_error("ERROR::PAIR_POTENTIAL_GENERATOR::NEGATIVE_SKIN\n");
+    }
+
+    if (m_potential == SOFT_SPHERE_POTENTIAL) {
+        m_cutoff = sigma;
+    }
+
+    if (m_cutoff <= 0) {
+        throw std::runtime_error("ERROR::PAIR_POTENTIAL_GENERATOR::NON_POSITIVE_CUTOFF\n");
+    }
+
+    // Shifting by the value at the cutoff keeps the energy continuous when pairs cross it
+    m_energy_shift = 0;
+    m_energy_shift = pair_energy(m_cutoff * m_cutoff);
+}
+
+
+double PairPotentialGenerator::pair_energy(double r2) const
+{
+    switch (m_potential) {
+        case LENNARD_JONES_POTENTIAL: {
+            double s2 = m_sigma * m_sigma / r2;
+            double s6 = s2 * s2 * s2;
+            return 4 * m_epsilon * (s6 * s6 - s6) - m_energy_shift;
+        }
+
+        case SOFT_SPHERE_POTENTIAL: {
+            double overlap = 1 - std::sqrt(r2) / m_sigma;
+            return m_epsilon * overlap * overlap;
+        }
+    }
+
+    return 0;
+}
+
+
+double PairPotentialGenerator::pair_force(double r2) const
+{
+    switch (m_potential) {
+        case LENNARD_JONES_POTENTIAL: {
+            double s2 = m_sigma * m_sigma / r2;
+            double s6 = s2 * s2 * s2;
+            return 24 * m_epsilon * (2 * s6 * s6 - s6) / r2;
+        }
+
+        case SOFT_SPHERE_POTENTIAL: {
+            // Coincident centres have no direction to push along
+            double r = std::sqrt(r2);
+            return (r > 0) ? 2 * m_epsilon * (1 - r / m_sigma) / (m_sigma * r) : 0;
+        }
+    }
+
+    return 0;
+}
+
+
+void PairPotentialGenerator::add_body(RigidBody* body)
+{
+    if (body == nullptr) {
+        throw std::runtime_error("ERROR::PAIR_POTENTIAL_GENERATOR::NULL_BODY\n");
+    }
+
+    m_bodies.push_back(body);
+    ++m_max_nbodies;
+    ++m_bodies_version;
+}
+
+
+bool PairPotentialGenerator::del_body(const RigidBody* body)
+{
+    auto it = std::find(m_bodies.begin(), m_bodies.end(), body);
+    if (it != m_bodies.end()) {
+        m_bodies.erase(it);
+        --m_max_nbodies;
+        ++m_bodies_version;
+    }
+
+    return false;
+}
+
+
+bool PairPotentialGenerator::del_pending_bodies()
+{
+    auto removed = std::erase_if(m_bodies, [](const RigidBody* b) { return b->is_pending_removal(); });
+
+    if (removed != 0) {
+        m_max_nbodies = m_bodies.size();
+        ++m_bodies_version;
+    }
+
+    return false;
+}
+
+
+void PairPotentialGenerator::gather_positions() const
+{
+    size_t n = m_bodies.size();
+    m_x.resize(n);
+    m_y.resize(n);
+
+    for (size_t i = 0; i < n; ++i) {
+        m_x[i] = m_bodies[i]->position.x;
+        m_y[i] = m_bodies[i]->position.y;
+    }
+}
+
+
+bool PairPotentialGenerator::list_is_stale() const
+{
+    /* No pair can have come closer than cutoff unseen while the two largest displacements
+       since the build sum to less than the skin. */
+    if (m_list_version != m_bodies_version) {
+        return true;
+    }
+
+    double first = 0;
+    double second = 0;
+
+    for (size_t i = 0; i < m_x.size(); ++i) {
+        double dx = m_x[i] - m_build_x[i];
+        double dy = m_y[i] - m_build_y[i];
+        double d2 = dx * dx + dy * dy;
+
+        if (d2 > second) {
+            second = std::min(d2, first);
+            first = std::max(d2, first);
+        }
+    }
+
+    return std::sqrt(first) + std::sqrt(second) > m_skin;
+}
+
+
+void PairPotentialGenerator::build_neighbour_list() const
+{
+    double range = m_cutoff + m_skin;
+    double range2 = range * range;
+
+    m_grid.build(m_x.data(), m_y.data(), m_x.size(), range);
+
+    m_pair_i.clear();
+    m_pair_j.clear();
+
+    m_grid.for_each_candidate_pair([&](uint32_t i, uint32_t j)
+    {
+        double dx = m_x[i] - m_x[j];
+        double dy = m_y[i] - m_y[j];
+
+        if (dx * dx + dy * dy < range2) {
+            m_pair_i.push_back(i);
+            m_pair_j.push_back(j);
+        }
+    });
+
+    m_build_x = m_x;
+    m_build_y = m_y;
+    m_list_version = m_bodies_version;
+    ++m_rebuilds;
+}
+
+
+void PairPotentialGenerator::update_neighbour_list() const
+{
+    gather_positions();
+
+    if (list_is_stale()) {
+        build_neighbour_list();
+    }
+}
+
+
+void PairPotentialGenerator::accumulate_pairs(size_t begin, size_t end, double* fx, double* fy) const
+{
+    double cutoff2 = m_cutoff * m_cutoff;
+
+    for (size_t k = begin; k < end; ++k) {
+        uint32_t i = m_pair_i[k];
+        uint32_t j = m_pair_j[k];
+
+        double dx = m_x[i] - m_x[j];
+        double dy = m_y[i] - m_y[j];
+        double r2 = dx * dx + dy * dy;
+
+        if (r2 >= cutoff2) {
+            continue;
+        }
+
+        double scale = pair_force(r2);
+        fx[i] += scale * dx;
+        fy[i] += scale * dy;
+        fx[j] -= scale * dx;
+        fy[j] -= scale * dy;
+    }
+}
+
+
+void PairPotentialGenerator::apply_force() const
+{
+    update_neighbour_list();
+
+    size_t n = m_bodies.size();
+    size_t npairs = m_pair_i.size();
+    m_fx.assign(n, 0);
+    m_fy.assign(n, 0);
+
+    size_t threads = m_deterministic ? G_DETERMINISTIC_PARTITIONS : parallel_concurrency();
+    size_t workers = (m_accumulation == SERIAL_ACCUMULATION) ? 1
+                   : std::clamp<size_t>(npairs / G_PAIR_POTENTIAL_CHUNK, 1, threads);
+
+    if (workers == 1) {
+        accumulate_pairs(0, npairs, m_fx.data(), m_fy.data());
+    } else {
+        /* The pair list changes with every rebuild, so instead of colouring it every worker
+           owns a full set of accumulators, summed afterwards. */
+        size_t chunk = (npairs + workers - 1) / workers;
+        m_thread_buffers.resize(workers);
+
+        parallel_for(0, workers, [&](size_t w)
+        {
+            std::vector<double>& buffer = m_thread_buffers[w];
+            buffer.assign(2 * n, 0);
+
+            size_t first = std::min(npairs, w * chunk);
+            size_t last = std::min(npairs, first + chunk);
+            accumulate_pairs(first, last, buffer.data(), buffer.data() + n);
+        }, 1);
+
+        for (auto& buffer : m_thread_buffers) {
+            for (size_t i = 0; i < n; ++i) {
+                m_fx[i] += buffer[i];
+                m_fy[i] += buffer[n + i];
+            }
+        }
+    }
+
+    for (size_t i = 0; i < n; ++i) {
+        m_bodies[i]->force_accumulator.x += m_fx[i];
+        m_bodies[i]->force_accumulator.y += m_fy[i];
+    }
+}
+
+
+double PairPotentialGenerator::compute_energy() const
+{
+    update_neighbour_list();
+
+    double cutoff2 = m_cutoff * m_cutoff;
+    double energy = 0;
+
+    for (size_t k = 0; k < m_pair_i.size(); ++k) {
+        double dx = m_x[m_pair_i[k]] - m_x[m_pair_j[k]];
+        double dy = m_y[m_pair_i[k]] - m_y[m_pair_j[k]];
+        double r2 = dx * dx + dy * dy;
+
+        if (r2 < cutoff2) {
+            energy += pair_energy(r2);
+        }
+    }
+
+    return energy;
+}
+
+
+void PairPotentialGenerator::write_state(BinaryWriter& writer, const BodyIndexMap& indices) const
+{
+    writer.write(m_potential);
+    writer.write(m_epsilon);
+    writer.write(m_sigma);
+    writer.write(m_cutoff);
+    writer.write(m_skin);
+    write_bodies(writer, indices);
+
+    // The neighbour list goes along, a rebuild could order the pairs differently
+    bool list_current = (m_list_version == m_bodies_version);
+    writer.write(list_current);
+    writer.write<uint64_t>(m_rebuilds);
+
+    if (list_current) {
+        writer.write_array(m_pair_i);
+        writer.write_array(m_pair_j);
+        writer.write_array(m_build_x);
+        writer.write_array(m_build_y);
+    }
+}
+
+
+std::unique_ptr<PairPotentialGenerator> PairPotentialGenerator::read_state(BinaryReader& reader, const std::vector<RigidBody*>& bodies)
+{
+    auto potential = reader.read<PairPotential>();
+    auto epsilon = reader.read<double>();
+    auto sigma = reader.read<double>();
+    auto cutoff = reader.read<double>();
+    auto skin = reader.read<double>();
+
+    auto generator = std::make_unique<PairPotentialGenerator>(potential, epsilon, sigma, cutoff, skin);
+    generator->read_bodies(reader, bodies);
+
+    bool list_current = reader.read<bool>();
+    generator->m_rebuilds = reader.read<uint64_t>();
+
+    if (list_current) {
+        reader.read_array(generator->m_pair_i);
+        reader.read_array(generator->m_pair_j);
+        reader.read_array(generator->m_build_x);
+        reader.read_array(generator->m_build_y);
+
+        size_t n = generator->m_bodies.size();
+        if (generator->m_pair_j.size() != generator->m_pair_i.size() ||
+            generator->m_build_x.size() != n || generator->m_build_y.size() != n) {
+            throw std::runtime_error("ERROR::PAIR_POTENTIAL_GENERATOR::READ_STATE::SIZE_MISMATCH\n");
+        }
+
+        for (size_t k = 0; k < generator->m_pair_i.size(); ++k) {
+            if (generator->m_pair_i[k] >= n || generator->m_pair_j[k] >= n) {
+                throw std::runtime_error("ERROR::PAIR_POTENTIAL_GENERATOR::READ_STATE::BODY_INDEX_OUT_OF_RANGE\n");
+            }
+        }
+
+        generator->m_list_version = generator->m_bodies_version;
+    }
+
+    return generator;
+}
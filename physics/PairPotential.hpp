@@ -0,0 +1,83 @@
+#ifndef PAIR_POTENTIAL_HPP
+#define PAIR_POTENTIAL_HPP
+
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#include "RigidBody.hpp"
+#include "CellGrid.hpp"
+#include "ForceGenerator.hpp"
+
+
+enum PairPotential
+{
+    LENNARD_JONES_POTENTIAL,  // 4*eps*((sigma/r)^12 - (sigma/r)^6), shifted to zero at the cutoff
+    SOFT_SPHERE_POTENTIAL,    // eps*(1 - r/sigma)^2 for r < sigma, purely repulsive
+};
+
+
+// Pairs per worker below which the buffered evaluation stays on one thread
+constexpr size_t G_PAIR_POTENTIAL_CHUNK { 8192 };
+
+
+class PairPotentialGenerator : public ForceGenerator
+{
+    /* Brief: Short range central pair force between all bodies of the generator, acting at
+              the centres of mass. Pairs closer than cutoff + skin are kept in a Verlet
+              neighbour list built from a cell list, and the list is reused until two bodies
+              may have closed the skin, i.e. until the two largest displacements since the
+              build add up to more than the skin. Soft spheres end at sigma, their cutoff is
+              sigma whatever is passed. Non-serial accumulation modes sum per-thread buffers. */
+    private:
+        PairPotential m_potential {};
+        double m_epsilon {};
+        double m_sigma {};
+        double m_cutoff {};
+        double m_skin {};
+        double m_energy_shift {};
+
+        /* Neighbour list and the positions it was built at, in body order. */
+        mutable CellGrid m_grid {};
+        mutable std::vector<uint32_t> m_pair_i {}, m_pair_j {};
+        mutable std::vector<double> m_build_x {}, m_build_y {};
+        mutable size_t m_list_version { SIZE_MAX };
+        mutable size_t m_rebuilds {};
+
+        mutable std::vector<double> m_x {}, m_y {}, m_fx {}, m_fy {};
+        mutable std::vector<std::vector<double>> m_thread_buffers {};
+
+        double pair_energy(double r2) const;
+        // Force on the first body of the pair divided by the separation
+        double pair_force(double r2) const;
+
+        void gather_positions() const;
+        bool list_is_stale() const;
+        void build_neighbour_list() const;
+        void update_neighbour_list() const;
+
+        void accumulate_pairs(size_t begin, size_t end, double* fx, double* fy) const;
+
+    public:
+        PairPotentialGenerator(PairPotential potential, double epsilon, double sigma, double cutoff, double skin,
+                               AccumulationMode mode = SERIAL_ACCUMULATION);
+
+        void add_body(RigidBody* body);
+
+        bool del_body(const RigidBody* body) override;
+        bool del_pending_bodies() override;
+
+        void apply_force() const override;
+        double compute_energy() const override;
+
+        void write_state(BinaryWriter& writer, const BodyIndexMap& indices) const override;
+        static std::unique_ptr<PairPotentialGenerator> read_state(BinaryReader& reader, const std::vector<RigidBody*>& bodies);
+
+        double get_cutoff() const { return m_cutoff; }
+        double get_skin() const { return m_skin; }
+        size_t get_num_pairs() const { return m_pair_i.size(); }
+        size_t get_rebuild_count() const { return m_rebuilds; }
+};
+
+#endif
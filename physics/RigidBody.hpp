@@ -4,11 +4,14 @@
 #include <array>
 #include <vector>
 #include <memory>
+#include <cstdint>
 #include <sstream>
 
 #include "util.hpp"
+#include "handle.hpp"
 #include "vector2.hpp"
 #include "collisions.hpp"
+#include "ConvexPolygon.hpp"
 
 
 enum RigidBodyType 
@@ -19,6 +22,18 @@ enum RigidBodyType
 };
 
 
+// Bits of a body field mask, a body feels the force fields whose mask shares a bit with it
+enum FieldFlag : uint32_t
+{
+    FIELD_GRAVITY = 1u << 0,
+    FIELD_DRAG    = 1u << 1,
+    FIELD_WIND    = 1u << 2,
+    FIELD_UNIFORM = 1u << 3,
+    FIELD_RADIAL  = 1u << 4,
+    ALL_FIELDS    = 0xffffffffu,
+};
+
+
 enum AnchorType
 {
     OFFSET_0_ANGLE_0,
@@ -52,64 +67,182 @@ constexpr std::array<std::pair<double, double>, NUM_ANCHOR_TYPES> anchor_data {
     std::pair { 1.0, 0.0 },
 };
 
+struct ShapeData
+{   
+    /* Brief: Mass independent geometry of a body, derived once from a ShapeDefinition: the 
+              validated core centred on its centroid and wound clockwise, the inertia per 
+              unit mass, the anchor table and the local bounds. Immutable once built and
+              shared by every body of the same shape, see ShapeLibrary. */
+    CollisionShapeType type { POLYGON_SHAPE };
+    double radius {};
+
+    ConvexPolygon polygon {};
+    double inertia_per_unit_mass {};
+
+    std::vector<double> anchor_angles {};
+    std::vector<double> anchor_offsets {};
+
+    AABB local_box {};
+    double bounding_radius {};
+
+    explicit ShapeData(ShapeDefinition&& shape) : type(shape.type), radius(shape.radius)
+    {
+        std::vector<vector2>& vertices = shape.vertices;
+
+        switch (type) {
+            case CollisionShapeType::POLYGON_SHAPE:
+                if (vertices.size() < 3 || !is_convex(vertices.data(), vertices.size())) {
+                    throw std::runtime_error("ERROR::SHAPE_DATA::CONSTRUCTOR::ONLY_CONVEX_POLYGONS_SUPPORTED");
+                }
+
+                // The narrowphase relies on clockwise winding for outward edge normals
+                if (signed_area(vertices.data(), vertices.size()) > 0) {
+                    std::reverse(vertices.begin(), vertices.end());
+                }
+
+                center_vertices_to_centroid(vertices);
+                inertia_per_unit_mass = moment_of_inertia_per_unit_mass_about_origin(vertices.data(), vertices.size());
+                break;
+
+            case CollisionShapeType::CIRCLE_SHAPE:
+            case CollisionShapeType::CAPSULE_SHAPE:
+                if (vertices.size() != (type == CIRCLE_SHAPE ? 1 : 2) ||
+                   (vertices.size() == 2 && (vertices[1] - vertices[0]).norm() == 0)) {
+                    throw std::runtime_error("ERROR::SHAPE_DATA::CONSTRUCTOR::DEGENERATE_ROUNDED_SHAPE");
+                }
+
+                if (radius <= 0) {
+                    throw std::runtime_error("ERROR::SHAPE_DATA::CONSTRUCTOR::NON_POSITIVE_RADIUS");
+                }
+
+                inertia_per_unit_mass = rounded_moment_of_inertia_per_unit_mass(vertices.data(), vertices.size(), radius);
+                break;
+
+            default:
+                throw std::runtime_error("ERROR::SHAPE_DATA::CONSTRUCTOR::UNKNOWN_SHAPE_TYPE");
+        }
+
+        for (auto& p : anchor_data) {
+            double angle = p.second;
+            double distance_factor = p.first;
+            double distance = (type == POLYGON_SHAPE) ?
+                distance_to_edge(angle, vertices.data(), vertices.size()) :
+                distance_to_rounded_edge(angle, vertices.data(), vertices.size(), radius);
+
+            anchor_angles.push_back(angle);
+            anchor_offsets.push_back(distance_factor * distance);
+        }
+        
+        local_box = compute_bouding_box(vertices.data(), vertices.size());
+        local_box.min_x -= radius;
+        local_box.max_x += radius;
+        local_box.min_y -= radius;
+        local_box.max_y += radius;
+
+        for (auto& v : vertices) {
+            bounding_radius = std::max(bounding_radius, v.norm() + radius);
+        }
+        
+        polygon = ConvexPolygon(std::move(vertices));
+    }
+};
+
+
 class RigidBody {
+    friend class System;
+
     protected:
         double m_inv_mass { 1 };
         double m_inv_inertia { 1 };
 
-        std::vector<double> m_anchor_angles {};
-        std::vector<double> m_anchor_offsets {};
-        
-        std::vector<vector2> m_vertices {};
-        std::vector<vector2> m_world_vertices {};
+        /* Bodies are rounded convex polygons: a core polygon swept by a radius. Polygons have 
+           no radius, circles have a single core point and capsules a core segment. The 
+           geometry is shared with every other body of the same shape. */
+        std::shared_ptr<const ShapeData> m_shape {};
+        ShapeHandle m_shape_handle {};
+
+        // Anchors added to this body only, indexed after the ones of the shape
+        std::vector<std::pair<double, double>> m_extra_anchors {};
 
-        std::vector<vector2> m_normals {};
-        std::vector<vector2> m_rotated_normals {};
+        /* World space features are derived lazily: update_transform() only refreshes the 
+           rotation and the AABB and bumps m_transform_version. Vertices and normals are 
+           recomputed on first access when their version lags behind, their storage is 
+           only allocated then as most bodies never need it. */
+        mutable std::vector<vector2> m_world_vertices {};
+        mutable std::vector<vector2> m_rotated_normals {};
+        mutable size_t m_features_version { 0 };
+        size_t m_transform_version { 1 };
+
+        double m_cos_angle { 1 };
+        double m_sin_angle { 0 };
 
         AABB m_bounding_box {};
 
-        std::string m_id { generate_id() };    
-        inline static int m_instance_id { 0 }; 
-        
-        static std::string generate_id() 
-        {
-            return "rbid" + std::to_string(m_instance_id++);
-        }
+        inline static size_t m_instance_id { 0 }; 
+        size_t m_serial { m_instance_id++ };
 
-        void compute_normals()
-        {   
-            size_t n = m_vertices.size();
-            m_normals.resize(n);
+        // Assigned by the owning System, lookups go through the handle instead of the name
+        BodyHandle m_handle {};
+        bool m_pending_removal { false };
 
-            for (size_t i = 0; i < n; ++i) {
-                vector2 a = m_vertices[i];
-                vector2 b = m_vertices[(i + 1) % n];
+        uint32_t m_field_mask { ALL_FIELDS };
 
-                vector2 ab = b - a;
-                vector2 normal = vector2 { -ab.y, ab.x };
-                normal = normal/normal.norm();
+        // Optional debug name, ids default to "rbid<serial>" and are only built on request
+        std::string m_name {};
 
-                m_normals[i] = normal;
-            }
+        void covert_aabb_to_world_space() 
+        {   
+            /* Tightest of the rotated local box and the bounding circle, both conservative. */
+            const AABB& local_box = m_shape->local_box;
+            double bounding_radius = m_shape->bounding_radius;
+
+            double c = std::abs(m_cos_angle);
+            double s = std::abs(m_sin_angle);
+
+            vector2 half   { 0.5 * (local_box.max_x - local_box.min_x), 
+                             0.5 * (local_box.max_y - local_box.min_y) };
+            vector2 center { 0.5 * (local_box.max_x + local_box.min_x), 
+                             0.5 * (local_box.max_y + local_box.min_y) };
+
+            center = position + rotate(center, m_cos_angle, m_sin_angle);
+            double hx = c * half.x + s * half.y;
+            double hy = s * half.x + c * half.y;
+
+            m_bounding_box.min_x = std::max(center.x - hx, position.x - bounding_radius);
+            m_bounding_box.max_x = std::min(center.x + hx, position.x + bounding_radius);
+            m_bounding_box.min_y = std::max(center.y - hy, position.y - bounding_radius);
+            m_bounding_box.max_y = std::min(center.y + hy, position.y + bounding_radius);
         }
 
+        void rotate_normals() const
+        {
+            const std::vector<vector2>& normals = m_shape->polygon.normals();
+            m_rotated_normals.resize(normals.size());
 
-        void covert_aabb_to_world_space() {
-            m_bounding_box = compute_bouding_box(m_world_vertices.data(), m_world_vertices.size());
+            for (size_t i = 0; i < normals.size();  ++i) {
+                m_rotated_normals[i] = rotate(normals[i], m_cos_angle, m_sin_angle);
+            }
         }
 
-        void rotate_normals() 
+        void convert_vertices_to_world_space() const
         {
-            for (size_t i = 0; i < m_normals.size();  ++i) {
-                m_rotated_normals[i] = rotate(m_normals[i], angle);
+            const std::vector<vector2>& vertices = m_shape->polygon.vertices();
+            m_world_vertices.resize(vertices.size());
+
+            for (size_t i = 0; i < vertices.size(); ++i) {
+                m_world_vertices[i] = position + rotate(vertices[i], m_cos_angle, m_sin_angle);
             }
         }
 
-        void convert_vertices_to_world_space() 
+        void update_polygon_features() const
         {
-            for (size_t i = 0; i < m_vertices.size(); ++i) {
-                m_world_vertices[i] = position + rotate(m_vertices[i], angle);
+            if (m_features_version == m_transform_version) {
+                return;
             }
+
+            convert_vertices_to_world_space();
+            rotate_normals();
+            m_features_version = m_transform_version;
         }
     
     public:
@@ -124,33 +257,30 @@ class RigidBody {
 
         RigidBodyType type { DYNAMIC_BODY };
         
-        RigidBody(double mass, std::vector<vector2>&& vertices, double angle, double angular_velocity, 
+        RigidBody(double mass, std::shared_ptr<const ShapeData> shape, double angle, double angular_velocity, 
                   vector2& pos, vector2& velocity, RigidBodyType _type) : 
-                  m_vertices(std::move(vertices)), angle(angle), angular_velocity(angular_velocity),
-                  position(std::move(pos)), velocity(std::move(velocity)), type(_type)
+                  m_shape(std::move(shape)), angle(angle), angular_velocity(angular_velocity), position(std::move(pos)), 
+                  velocity(std::move(velocity)), type(_type)
         {   
+            if (!m_shape) {
+                throw std::runtime_error("ERROR::RIGID_BODY::CONSTRUCTOR::NULL_SHAPE");
+            }
+
             if (mass <= 0) {
                 throw std::runtime_error("ERROR::RIGID_BODY::CONSTRUCTOR::NON_POSITVE_MASS");
             }
 
-            if (!is_convex(vertices.data(), vertices.size())) {
-                std::ostringstream oss;
-                oss << "ERROR::RIGID_BODY(" << m_id << ")::CONSTRUCTOR::ONLY_CONVEX_POLYGONS_SUPPORTED";
-                throw std::runtime_error(oss.str());
-            }   
-
-            center_vertices_to_centroid(m_vertices);
-            double inertia = moment_of_inertia_per_unit_mass_about_origin(m_vertices.data(), m_vertices.size());
+            double inertia = mass * m_shape->inertia_per_unit_mass;
 
             switch (_type) {
                 case RigidBodyType::DYNAMIC_BODY:
                     m_inv_mass = 1/mass;
-                    m_inv_inertia = 1/(mass * inertia);
+                    m_inv_inertia = 1/inertia;
                     break;
 
                 case RigidBodyType::ROTATIONAL_ONLY:
                     m_inv_mass = 0;
-                    m_inv_inertia = 1/(mass * inertia);
+                    m_inv_inertia = 1/inertia;
                     break;
 
                 case RigidBodyType::STATIC_BODY:
@@ -159,58 +289,127 @@ class RigidBody {
                     break;
             }
 
-            for (auto& p : anchor_data) {
-                double angle = p.second;
-                double distance_factor = p.first;
-                double distance = distance_to_edge(angle, m_vertices.data(), m_vertices.size());
+            update_transform();
+        }
 
-                m_anchor_angles.push_back(angle);
-                m_anchor_offsets.push_back(distance_factor * distance);
-            }
-            
-            compute_normals(); 
-            m_bounding_box = compute_bouding_box(m_vertices.data(), m_vertices.size());
-            
-            m_world_vertices.resize(m_vertices.size());
-            m_rotated_normals.resize(m_normals.size());
+        RigidBody(double mass, ShapeDefinition&& shape, double angle, double angular_velocity, 
+                  vector2& pos, vector2& velocity, RigidBodyType _type) : 
+                  RigidBody(mass, std::make_shared<const ShapeData>(std::move(shape)), angle, angular_velocity, pos, velocity, _type)
+        {}
 
-            update_polygon_features();
-        }
+        RigidBody(double mass, std::vector<vector2>&& vertices, double angle, double angular_velocity, 
+                  vector2& pos, vector2& velocity, RigidBodyType _type) : 
+                  RigidBody(mass, polygon_shape(std::move(vertices)), angle, angular_velocity, pos, velocity, _type)
+        {}
 
         double get_inverse_mass()    const { return m_inv_mass; }
         double get_inverse_inertia() const { return m_inv_inertia; }
-        std::string get_id() const { return m_id; }
+        std::string get_id() const { return m_name.empty() ? "rbid" + std::to_string(m_serial) : m_name; }
+        void set_name(std::string name) { m_name = std::move(name); }
+
+        BodyHandle get_handle() const { return m_handle; }
+        bool is_pending_removal() const { return m_pending_removal; }
+        size_t get_serial() const { return m_serial; }
+
+        uint32_t get_field_mask() const { return m_field_mask; }
+        void set_field_mask(uint32_t mask) { m_field_mask = mask; }
 
         const AABB& get_aabb() const { return m_bounding_box; }
 
-        const std::vector<vector2>& get_vertices() const { return m_vertices; }
-        const std::vector<vector2>& get_world_vertices() const { return m_world_vertices; }
-        const std::vector<vector2>& get_normals()  const { return m_rotated_normals; }
+        const std::shared_ptr<const ShapeData>& get_shape() const { return m_shape; }
+        ShapeHandle get_shape_handle() const { return m_shape_handle; }
+
+        CollisionShapeType get_shape_type() const { return m_shape->type; }
+        double get_radius() const { return m_shape->radius; }
+
+        double get_bounding_radius() const { return m_shape->bounding_radius; }
+        size_t get_transform_version() const { return m_transform_version; }
+
+        const std::vector<vector2>& get_vertices() const { return m_shape->polygon.vertices(); }
+        const ConvexPolygon& get_polygon() const { return m_shape->polygon; }
+
+        ConvexProxy proxy() const 
+        { 
+            return ConvexProxy { &m_shape->polygon, position, m_cos_angle, m_sin_angle }; 
+        }
+
+        vector2 to_local_direction(const vector2& direction) const
+        {
+            return rotate(direction, m_cos_angle, -m_sin_angle);
+        }
+
+        vector2 world_vertex(size_t i) const 
+        { 
+            return position + rotate(m_shape->polygon.vertices()[i], m_cos_angle, m_sin_angle); 
+        }
+
+        vector2 world_normal(size_t i) const 
+        { 
+            return rotate(m_shape->polygon.normals()[i], m_cos_angle, m_sin_angle); 
+        }
+
+        const std::vector<vector2>& get_world_vertices() const 
+        { 
+            update_polygon_features();
+            return m_world_vertices; 
+        }
+
+        const std::vector<vector2>& get_normals() const 
+        { 
+            update_polygon_features();
+            return m_rotated_normals; 
+        }
 
 
-        vector2 get_anchor_position(AnchorType anchor)
+        // Anchor relative to the centre of mass in the body frame
+        vector2 get_local_anchor(AnchorType anchor) const
         {   
-            try {
-                return position + m_anchor_offsets.at(anchor) * direction(angle + m_anchor_angles.at(anchor));
-            } catch (const std::out_of_range& e) {
-                std::cerr << "WARNING::RIGID_BODY(" << m_id << ")::INVALID_ANCHOR_INDEX\n";
-                return position;
+            size_t index = anchor;
+            const std::vector<double>& offsets = m_shape->anchor_offsets;
+
+            if (index < offsets.size()) {
+                return offsets[index] * direction(m_shape->anchor_angles[index]);
             }
+
+            index -= offsets.size();
+            if (index < m_extra_anchors.size()) {
+                auto [offset, anchor_angle] = m_extra_anchors[index];
+                return offset * direction(anchor_angle);
+            }
+
+            std::cerr << "WARNING::RIGID_BODY(" << get_id() << ")::INVALID_ANCHOR_INDEX\n";
+            return vector2 { 0, 0 };
         }
 
-        void update_polygon_features() 
-        {
-            convert_vertices_to_world_space();
+        vector2 get_anchor_position(AnchorType anchor) const
+        {   
+            return position + rotate(get_local_anchor(anchor), angle);
+        }
+
+        void update_transform() 
+        {   
+            m_cos_angle = std::cos(angle);
+            m_sin_angle = std::sin(angle);
+            ++m_transform_version;
+
             covert_aabb_to_world_space();
-            rotate_normals();
         }
 
         void add_anchor(double relative_offset, double angle) 
         {
-            m_anchor_angles.emplace_back(angle);
-            m_anchor_offsets.emplace_back(relative_offset);
+            m_extra_anchors.emplace_back(relative_offset, angle);
         }
 };
 
 
+inline void BodyDeleter::operator()(RigidBody* body) const
+{
+    if (in_arena) {
+        body->~RigidBody();
+    } else {
+        delete body;
+    }
+}
+
+
 #endif
\ No newline at end of file
@@ -0,0 +1,160 @@
+#include "ShapeLibrary.hpp"
+
+#include <functional>
+
+
+size_t ShapeLibrary::hash(const ShapeDefinition& definition)
+{
+    auto combine = [](size_t seed, double value)
+    {
+        return seed ^ (std::hash<double>{}(value) + 0x9e3779b97f4a7c15ull + (seed << 6) + (seed >> 2));
+    };
+
+    size_t seed = static_cast<size_t>(definition.type);
+    seed = combine(seed, definition.radius);
+
+    for (auto& v : definition.vertices) {
+        seed = combine(seed, v.x);
+        seed = combine(seed, v.y);
+    }
+
+    return seed;
+}
+
+
+bool ShapeLibrary::equal(const ShapeDefinition& a, const ShapeDefinition& b)
+{
+    if (a.type != b.type || a.radius != b.radius || a.vertices.size() != b.vertices.size()) {
+        return false;
+    }
+
+    for (size_t i = 0; i < a.vertices.size(); ++i) {
+        if (a.vertices[i].x != b.vertices[i].x || a.vertices[i].y != b.vertices[i].y) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+ShapeHandle ShapeLibrary::find(const ShapeDefinition& definition) const
+{
+    auto [first, last] = m_lookup.equal_range(hash(definition));
+
+    for (auto it = first; it != last; ++it) {
+        if (equal(m_entries[m_slots.index(it->second)].definition, definition)) {
+            return it->second;
+        }
+    }
+
+    return ShapeHandle {};
+}
+
+
+ShapeHandle ShapeLibrary::add(ShapeDefinition&& definition)
+{
+    ShapeHandle handle = find(definition);
+    if (handle.is_valid()) {
+        return handle;
+    }
+
+    ShapeData data { ShapeDefinition(definition) };
+    return add(std::move(definition), std::move(data));
+}
+
+
+ShapeHandle ShapeLibrary::add(ShapeDefinition&& definition, ShapeData&& data)
+{
+    ShapeHandle handle = find(definition);
+    if (handle.is_valid()) {
+        return handle;
+    }
+
+    size_t key = hash(definition);
+    handle = m_slots.push_back();
+
+    m_entries.push_back(Entry { std::move(definition), std::make_shared<const ShapeData>(std::move(data)), key });
+    m_lookup.emplace(key, handle);
+
+    return handle;
+}
+
+
+size_t ShapeLibrary::release_unused()
+{
+    size_t released = 0;
+
+    for (size_t i = m_entries.size(); i-- > 0;) {
+        if (m_entries[i].data.use_count() > 1) {
+            continue;
+        }
+
+        ShapeHandle handle = m_slots.handle(i);
+
+        auto [first, last] = m_lookup.equal_range(m_entries[i].hash);
+        for (auto it = first; it != last; ++it) {
+            if (it->second == handle) {
+                m_lookup.erase(it);
+                break;
+            }
+        }
+
+        // Mirrors the swap and pop of the slot map
+        m_slots.swap_remove(handle);
+        if (i + 1 != m_entries.size()) {
+            m_entries[i] = std::move(m_entries.back());
+        }
+        m_entries.pop_back();
+        ++released;
+    }
+
+    return released;
+}
+
+
+void ShapeLibrary::clear()
+{
+    m_entries.clear();
+    m_slots.clear();
+    m_lookup.clear();
+}
+
+
+void ShapeLibrary::write(BinaryWriter& writer) const
+{
+    m_slots.write(writer);
+    writer.write<uint64_t>(m_entries.size());
+
+    for (auto& entry : m_entries) {
+        writer.write(entry.definition.type);
+        writer.write(entry.definition.radius);
+        writer.write_array(entry.definition.vertices);
+    }
+}
+
+
+void ShapeLibrary::read(BinaryReader& reader)
+{
+    clear();
+    m_slots.read(reader);
+
+    auto count = reader.read<uint64_t>();
+    if (count != m_slots.size()) {
+        throw std::runtime_error("ERROR::SHAPE_LIBRARY::READ::SIZE_MISMATCH\n");
+    }
+
+    m_entries.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        ShapeDefinition definition;
+        definition.type = reader.read<CollisionShapeType>();
+        definition.radius = reader.read<double>();
+        reader.read_array(definition.vertices);
+
+        size_t key = hash(definition);
+        ShapeData data { ShapeDefinition(definition) };
+
+        m_entries.push_back(Entry { std::move(definition), std::make_shared<const ShapeData>(std::move(data)), key });
+        m_lookup.emplace(key, m_slots.handle(i));
+    }
+}
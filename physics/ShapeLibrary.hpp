@@ -0,0 +1,65 @@
+#ifndef SHAPE_LIBRARY_HPP
+#define SHAPE_LIBRARY_HPP
+
+#include <memory>
+#include <vector>
+#include <cstddef>
+#include <unordered_map>
+
+#include "handle.hpp"
+#include "serialize.hpp"
+#include "RigidBody.hpp"
+
+
+class ShapeLibrary
+{
+    /* Brief: Interned, immutable shapes shared by the bodies of a System. Adding a definition
+              equal to a registered one returns the existing handle, so a scene of identical
+              bodies keeps a single copy of the geometry. Bodies hold shared ownership of their
+              ShapeData, shapes released from the library stay alive while still in use. */
+    private:
+        struct Entry
+        {
+            ShapeDefinition definition {};
+            std::shared_ptr<const ShapeData> data {};
+            size_t hash {};
+        };
+
+        std::vector<Entry> m_entries {};
+        SlotMap<ShapeTag> m_slots {};
+        std::unordered_multimap<size_t, ShapeHandle> m_lookup {};
+
+        static size_t hash(const ShapeDefinition& definition);
+        static bool equal(const ShapeDefinition& a, const ShapeDefinition& b);
+
+    public:
+        size_t size() const { return m_entries.size(); }
+
+        bool contains(ShapeHandle handle) const { return m_slots.contains(handle); }
+
+        // Invalid handle if no equal definition is registered
+        ShapeHandle find(const ShapeDefinition& definition) const;
+
+        /* Registers the shape unless an equal one exists. Throws on invalid definitions. */
+        ShapeHandle add(ShapeDefinition&& definition);
+
+        /* Registers data already derived from definition, used to build shapes in parallel. */
+        ShapeHandle add(ShapeDefinition&& definition, ShapeData&& data);
+
+        const std::shared_ptr<const ShapeData>& get(ShapeHandle handle) const
+        {
+            return m_entries[m_slots.index(handle)].data;
+        }
+
+        /* Drops the shapes no body refers to anymore, returns how many were dropped. */
+        size_t release_unused();
+
+        void clear();
+
+        /* Definitions and handles only, the derived data is rebuilt on read. Reading replaces
+           the contents of the library. */
+        void write(BinaryWriter& writer) const;
+        void read(BinaryReader& reader);
+};
+
+#endif
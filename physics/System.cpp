@@ -1,4 +1,8 @@
 #include "System.hpp"
+#include "parallel.hpp"
+
+#include <new>
+#include <optional>
 
 
 void System::set_global_gravity_flag(bool flag)
@@ -30,6 +34,12 @@ void System::set_time_step(double time_step)
     m_config.time_step = time_step;
 }
 
+void System::set_deterministic(bool deterministic)
+{
+    m_config.deterministic = deterministic;
+    m_force_colours_dirty = true;
+}
+
 void System::set_global_gravity_acceleration(double gravity_acceleration) 
 {
     m_config.gravitational_g = gravity_acceleration;
@@ -38,7 +48,12 @@ void System::set_global_gravity_acceleration(double gravity_acceleration)
 
 void System::set_global_vdrag_constant(double vdrag_constant) 
 {
+    if (vdrag_constant < 0) {
+        throw std::runtime_error("ERROR::SYSTEM::IN_MEMBER_FUNCTION:\nSET_GLOBAL_VDRAG_CONSTANT::NEGATIVE_CONSTANT\n");
+    }
+
     m_config.viscous_drag_coef = vdrag_constant;
+    global_viscous_drag->set_coefficient(vdrag_constant);
 }
 
 
@@ -93,6 +108,8 @@ void System::backtrack_time(double delta_time)
 
 void System::compute_constraints()
 {
+    MECSIM_PROFILE_STAGE(STAGE_CONSTRAINTS);
+
     size_t np = m_bodies.size();
     size_t nc = m_constraints.size();
 
@@ -110,11 +127,18 @@ void System::compute_constraints()
         return;
     }
 
+    // The constraint interface addresses bodies and constraints by name
+    std::unordered_map<std::string, size_t> body_indices = get_rigid_body_indices();
+    std::unordered_map<std::string, size_t> constraint_indices {};
+    for (size_t k = 0; k < m_constraints.size(); ++k) {
+        constraint_indices[m_constraints[k]->get_id()] = k;
+    }
+
     size_t i = 0;
     for (auto& constraint : m_constraints) 
     {   
         m_constraint_buffer[i++] = constraint->evaluate_constraint();
-        auto blocks = constraint->jacobian_blocks(m_body_indices, m_constraint_indices);
+        auto blocks = constraint->jacobian_blocks(body_indices, constraint_indices);
 
         jacobian.add_block_row(std::move(blocks.first));
         jaco_dot.add_block_row(std::move(blocks.second));
@@ -182,55 +206,263 @@ void System::clear_forces_and_torques()
     }
 }
 
+void System::gather_body_arrays()
+{   
+    /* Only dynamic bodies are moved by fields, the others get no flags. */
+    m_body_arrays.resize(m_bodies.size());
+
+    for (size_t i = 0; i < m_bodies.size(); ++i) {
+        const RigidBody& b = *m_bodies[i];
+        bool is_dynamic = (b.type == DYNAMIC_BODY);
+
+        m_body_arrays.mass[i]  = is_dynamic ? 1/b.get_inverse_mass() : 0;
+        m_body_arrays.x[i]     = b.position.x;
+        m_body_arrays.y[i]     = b.position.y;
+        m_body_arrays.vx[i]    = b.velocity.x;
+        m_body_arrays.vy[i]    = b.velocity.y;
+        m_body_arrays.fx[i]    = 0;
+        m_body_arrays.fy[i]    = 0;
+        m_body_arrays.flags[i] = is_dynamic ? b.get_field_mask() : 0;
+    }
+}
+
 void System::compute_forces_and_torques() 
 {   
-    if (m_config.global_gravity_flag) {
-        global_gravity->apply_force();
+    MECSIM_PROFILE_STAGE(STAGE_FORCES);
+
+    if (m_config.global_gravity_flag || m_config.global_viscous_drag_flag || !m_fields.empty()) {
+        gather_body_arrays();
+
+        if (m_config.global_gravity_flag) {
+            global_gravity->apply(m_body_arrays);
+        }
+
+        if (m_config.global_viscous_drag_flag) {
+            global_viscous_drag->apply(m_body_arrays);
+        }
+
+        for (auto& field : m_fields) {
+            field->apply(m_body_arrays);
+        }
+
+        for (size_t i = 0; i < m_bodies.size(); ++i) {
+            m_bodies[i]->force_accumulator.x += m_body_arrays.fx[i];
+            m_bodies[i]->force_accumulator.y += m_body_arrays.fy[i];
+        }
     }
 
+    /* Serial generators run in order, the others one colour after the other with the
+       generators of a colour in parallel. Recoloured whenever a body set changed. */
+    size_t version = 0;
     for (auto& f : m_forces) {
-        f->apply_force();
+        if (f->get_accumulation_mode() == SERIAL_ACCUMULATION) {
+            f->apply_force();
+        } else {
+            version += f->get_bodies_version();
+        }
+    }
+
+    if (m_force_colours_dirty || version != m_force_colours_version) {
+        colour_forces(version);
+    }
+
+    for (auto& colour : m_force_colours) {
+        parallel_for(0, colour.size(), [&colour](size_t i) { colour[i]->apply_force(); }, G_FORCE_COLOUR_CHUNK);
     }
 
     //compute_constraints();
 }
 
+void System::colour_forces(size_t version)
+{   
+    /* Greedy colouring, every generator takes the lowest colour none of its bodies has
+       been given yet. A generator touching many bodies usually ends up alone. */
+    m_force_colours.clear();
+
+    // Generators that partition their own work learn here whether it may follow the thread count
+    for (auto& f : m_forces) {
+        f->m_deterministic = m_config.deterministic;
+    }
+
+    std::unordered_map<const RigidBody*, std::vector<uint32_t>> body_colours {};
+    std::vector<bool> taken {};
+
+    for (auto& f : m_forces) {
+        if (f->get_accumulation_mode() == SERIAL_ACCUMULATION) {
+            continue;
+        }
+
+        taken.assign(m_force_colours.size() + 1, false);
+        for (const RigidBody* b : f->get_bodies()) {
+            for (uint32_t c : body_colours[b]) {
+                taken[c] = true;
+            }
+        }
+
+        size_t colour = std::find(taken.begin(), taken.end(), false) - taken.begin();
+        if (colour == m_force_colours.size()) {
+            m_force_colours.emplace_back();
+        }
+
+        m_force_colours[colour].push_back(f.get());
+        for (const RigidBody* b : f->get_bodies()) {
+            body_colours[b].push_back(static_cast<uint32_t>(colour));
+        }
+    }
+
+    m_force_colours_version = version;
+    m_force_colours_dirty = false;
+}
+
+
 double System::step()
 {   
+    MECSIM_PROFILE_STEP(m_stats);
+    MECSIM_PROFILE_STAGE(STAGE_STEP);
+
+    flush_deletions();
+
     double time_step = m_config.time_step;
-    m_solver->step(time_step);
-    bool penetration = detect_collisions(m_bodies, m_contacts, m_config.penetration_threshhold);
+    {
+        MECSIM_PROFILE_STAGE(STAGE_INTEGRATION);
+        m_solver->step(time_step);
+    }
+    bool penetration = detect_collisions(m_bodies, m_contacts, m_config.penetration_threshhold, &m_collision_cache,
+                                        m_config.deterministic);
     
     size_t i = 0;
     while (penetration) {
-        m_solver->backtrack(time_step);
-        time_step = time_step / 2;
-        m_solver->step(time_step);
-        penetration = detect_collisions(m_bodies, m_contacts, m_config.penetration_threshhold);
+        MECSIM_TRACE_INSTANT("Penetration retry");
+        {
+            MECSIM_PROFILE_STAGE(STAGE_INTEGRATION);
+            m_solver->backtrack(time_step);
+            time_step = time_step / 2;
+            m_solver->step(time_step);
+        }
+        penetration = detect_collisions(m_bodies, m_contacts, m_config.penetration_threshhold, &m_collision_cache,
+                                        m_config.deterministic);
         ++i;
     }
 
-    if (m_contacts.empty()) {
-        return time_step; 
-    } 
+    MECSIM_PROFILE_COUNT(COUNTER_PENETRATION_RETRIES, i);
+    MECSIM_PROFILE_COUNT(COUNTER_CONTACTS, m_contacts.size());
+
+    {
+        MECSIM_PROFILE_STAGE(STAGE_CONTACT_RESOLUTION);
+        for (auto contact : m_contacts) {
+            resolve_contact(contact);
+        }
+    }
 
-    for (auto contact : m_contacts) {
-        resolve_contact(contact);
+    if (m_config.reorder_interval > 0 && ++m_steps_since_reorder >= m_config.reorder_interval) {
+        reorder_bodies();
     }
 
     return time_step;
 }
 
 
+void System::reorder_bodies()
+{   
+    /* Sorts the body store along a Z-order curve of the positions, quantised to 16 bits per
+       axis over the bounding box of all bodies, and moves the bodies into one block of memory
+       in that order. Neighbours in space end up next to each other in memory, and so in the
+       integrator, force and broadphase loops. Handles are remapped, force generators and 
+       contacts are pointed at the new addresses. */
+    m_steps_since_reorder = 0;
+
+    if (m_bodies.size() < 2) {
+        return;
+    }
+
+    double min_x = std::numeric_limits<double>::max();
+    double min_y = std::numeric_limits<double>::max();
+    double max_x = std::numeric_limits<double>::lowest();
+    double max_y = std::numeric_limits<double>::lowest();
+
+    for (auto& b : m_bodies) {
+        min_x = std::min(min_x, b->position.x);
+        min_y = std::min(min_y, b->position.y);
+        max_x = std::max(max_x, b->position.x);
+        max_y = std::max(max_y, b->position.y);
+    }
+
+    double scale_x = (max_x > min_x) ? 65535 / (max_x - min_x) : 0;
+    double scale_y = (max_y > min_y) ? 65535 / (max_y - min_y) : 0;
+
+    // Ties keep the current order
+    std::vector<std::pair<uint32_t, size_t>> codes(m_bodies.size());
+    for (size_t i = 0; i < m_bodies.size(); ++i) {
+        auto x = static_cast<uint16_t>((m_bodies[i]->position.x - min_x) * scale_x);
+        auto y = static_cast<uint16_t>((m_bodies[i]->position.y - min_y) * scale_y);
+        codes[i] = { morton_code(x, y), i };
+    }
+
+    std::sort(codes.begin(), codes.end());
+
+    std::vector<BodyPtr> sorted;
+    std::vector<size_t> new_to_old;
+    sorted.reserve(m_bodies.size());
+    new_to_old.reserve(m_bodies.size());
+
+    for (auto& [code, i] : codes) {
+        sorted.push_back(std::move(m_bodies[i]));
+        new_to_old.push_back(i);
+    }
+    m_bodies = std::move(sorted);
+    m_body_slots.permute(new_to_old);
+
+    // Constraints hold body pointers the System cannot update, their bodies have to stay put
+    if (m_constraints.empty()) {
+        relocate_bodies();
+    }
+}
+
+
+void System::relocate_bodies()
+{
+    /* Everything that can fail is allocated before the first body moves. Bodies deleted from
+       the arena later are only destroyed, the block is released by the next relocation. */
+    size_t n = m_bodies.size();
+    BodyArena arena { std::allocator<RigidBody>().allocate(n), BodyArenaDeleter { n } };
+
+    BodyRemap remap {};
+    remap.reserve(n);
+    for (size_t i = 0; i < n; ++i) {
+        remap.emplace(m_bodies[i].get(), arena.get() + i);
+    }
+
+    for (size_t i = 0; i < n; ++i) {
+        RigidBody* body = new (arena.get() + i) RigidBody(std::move(*m_bodies[i]));
+        m_bodies[i] = BodyPtr(body, BodyDeleter { true });
+    }
+
+    // Every body of the previous block has been destroyed above
+    m_body_arena = std::move(arena);
+
+    for (auto& f : m_forces) {
+        f->remap_bodies(remap);
+    }
+    m_force_colours_dirty = true;
+
+    for (Contact& contact : m_contacts) {
+        contact.a = remap.at(contact.a);
+        contact.b = remap.at(contact.b);
+    }
+}
+
+
 double System::compute_angular_momentum()
 {   
+    /* Angular momentum about the origin: orbital part for translating bodies plus the spin
+       of every body that can rotate. */
     double angular_momentum = 0;
 
     for (auto& b : m_bodies) {
-        if (b->type == DYNAMIC_BODY) {
+        if (b->get_inverse_mass() > 0) {
             angular_momentum += cross2d(b->position, 1/b->get_inverse_mass() * b->velocity);
         }
-        if (b->type == ROTATIONAL_ONLY) {
+        if (b->get_inverse_inertia() > 0) {
             angular_momentum += 1/b->get_inverse_inertia() * b->angular_velocity; 
         }
     }
@@ -239,49 +471,243 @@ double System::compute_angular_momentum()
 }
 
 
+double System::compute_kinetic_energy()
+{
+    double energy = 0;
+
+    for (auto& b : m_bodies) {
+        if (b->get_inverse_mass() > 0) {
+            energy += 0.5/b->get_inverse_mass() * (b->velocity * b->velocity);
+        }
+        if (b->get_inverse_inertia() > 0) {
+            energy += 0.5/b->get_inverse_inertia() * b->angular_velocity * b->angular_velocity;
+        }
+    }
+
+    return energy;
+}
+
+
+double System::compute_potential_energy()
+{
+    double energy = 0;
+
+    if (m_config.global_gravity_flag || !m_fields.empty()) {
+        gather_body_arrays();
+
+        if (m_config.global_gravity_flag) {
+            energy += global_gravity->compute_energy(m_body_arrays);
+        }
+
+        for (auto& field : m_fields) {
+            energy += field->compute_energy(m_body_arrays);
+        }
+    }
+
+    for (auto& f : m_forces) {
+        energy += f->compute_energy();
+    }
+
+    return energy;
+}
+
+
+double System::compute_energy()
+{
+    return compute_kinetic_energy() + compute_potential_energy();
+}
+
+
+RigidBody* System::push_body(std::unique_ptr<RigidBody>&& body)
+{
+    body->m_handle = m_body_slots.push_back();
+    m_bodies.emplace_back(body.release());
+
+    return m_bodies.back().get();
+}
+
+
 RigidBody* System::add_dynamic_body(double mass, std::vector<vector2>&& vertices, double angle, 
                             double angular_velocity, vector2& position, 
                             vector2& velocity)
 {   
-    RigidBodyType type = DYNAMIC_BODY;
-    m_bodies.emplace_back(
-    std::make_unique<RigidBody>(mass, std::move(vertices), angle, angular_velocity, position, 
+    return add_dynamic_body(mass, polygon_shape(std::move(vertices)), angle, angular_velocity, 
+                            position, velocity);
+}
+
+
+RigidBody* System::add_rotational_body(double mass, std::vector<vector2>&& vertices, double angle, 
+                               double angular_velocity, vector2& position) 
+{
+    return add_rotational_body(mass, polygon_shape(std::move(vertices)), angle, angular_velocity, position);
+}
+
+
+RigidBody* System::add_static_body(std::vector<vector2>&& vertices, double angle, vector2& position)
+{   
+    return add_static_body(polygon_shape(std::move(vertices)), angle, position);
+}
+
+
+RigidBody* System::push_body(double mass, ShapeHandle shape, double angle, double angular_velocity, 
+                             vector2& position, vector2& velocity, RigidBodyType type)
+{
+    if (!m_shapes.contains(shape)) {
+        throw std::runtime_error("ERROR::SYSTEM::IN_MEMBER_FUNCTION:\nPUSH_BODY::UNKNOWN_SHAPE\n");
+    }
+
+    RigidBody* body = push_body(
+    std::make_unique<RigidBody>(mass, m_shapes.get(shape), angle, angular_velocity, position, 
                                 velocity, type));
-    m_body_indices[m_bodies.back()->get_id()] = m_bodies.size() - 1;
 
-    global_gravity->increase_max_nbodies();
-    global_gravity->add_body(m_bodies.back().get());
+    body->m_shape_handle = shape;
+    return body;
+}
 
-    // global_viscous_drag->increase_max_nparticles();
-    // global_viscous_drag->add_particle(m_particles.back());
 
-    return m_bodies.back().get();
+ShapeHandle System::add_shape(ShapeDefinition&& shape)
+{
+    return m_shapes.add(std::move(shape));
 }
 
 
-RigidBody* System::add_rotational_body(double mass, std::vector<vector2>&& vertices, double angle, 
+size_t System::release_unused_shapes()
+{
+    return m_shapes.release_unused();
+}
+
+
+RigidBody* System::add_dynamic_body(double mass, ShapeDefinition&& shape, double angle, 
+                            double angular_velocity, vector2& position, 
+                            vector2& velocity)
+{   
+    return add_dynamic_body(mass, add_shape(std::move(shape)), angle, angular_velocity, position, velocity);
+}
+
+
+RigidBody* System::add_rotational_body(double mass, ShapeDefinition&& shape, double angle, 
                                double angular_velocity, vector2& position) 
 {
-    RigidBodyType type = ROTATIONAL_ONLY;
-    vector2 velocity { 0, 0 };
-    m_bodies.emplace_back(
-    std::make_unique<RigidBody>(mass, std::move(vertices), angle, angular_velocity, position, 
-                                velocity, type));
-    m_body_indices[m_bodies.back()->get_id()] = m_bodies.size() - 1;
+    return add_rotational_body(mass, add_shape(std::move(shape)), angle, angular_velocity, position);
+}
 
-    return m_bodies.back().get();
+
+RigidBody* System::add_static_body(ShapeDefinition&& shape, double angle, vector2& position)
+{   
+    return add_static_body(add_shape(std::move(shape)), angle, position);
 }
 
 
-RigidBody* System::add_static_body(std::vector<vector2>&& vertices, double angle, vector2& position)
+RigidBody* System::add_dynamic_body(double mass, ShapeHandle shape, double angle, 
+                            double angular_velocity, vector2& position, 
+                            vector2& velocity)
 {   
-    RigidBodyType type = RigidBodyType::STATIC_BODY;
+    return push_body(mass, shape, angle, angular_velocity, position, velocity, DYNAMIC_BODY);
+}
+
+
+RigidBody* System::add_rotational_body(double mass, ShapeHandle shape, double angle, 
+                               double angular_velocity, vector2& position) 
+{
     vector2 velocity { 0, 0 };
-    m_bodies.emplace_back(
-    std::make_unique<RigidBody>(1, std::move(vertices), angle, 0, position, velocity, type));
-    m_body_indices[m_bodies.back()->get_id()] = m_bodies.size() - 1;
+    return push_body(mass, shape, angle, angular_velocity, position, velocity, ROTATIONAL_ONLY);
+}
 
-    return m_bodies.back().get();
+
+RigidBody* System::add_static_body(ShapeHandle shape, double angle, vector2& position)
+{   
+    vector2 velocity { 0, 0 };
+    return push_body(1, shape, angle, 0, position, velocity, STATIC_BODY);
+}
+
+
+std::vector<BodyHandle> System::add_bodies(std::span<const BodyDescriptor> descriptors, bool parallel)
+{   
+    /* Every distinct definition is looked up in the shape library once, the new ones are
+       validated and precomputed, optionally in parallel, before any body is created. Storage
+       grows once for the whole batch. */
+    std::unordered_map<const ShapeDefinition*, size_t> shape_indices {};
+    std::vector<const ShapeDefinition*> definitions {};
+    std::vector<size_t> body_shapes(descriptors.size());
+
+    for (size_t i = 0; i < descriptors.size(); ++i) {
+        const BodyDescriptor& d = descriptors[i];
+
+        if (d.shape == nullptr && !m_shapes.contains(d.shape_handle)) {
+            throw std::runtime_error("ERROR::SYSTEM::IN_MEMBER_FUNCTION:\nADD_BODIES::UNKNOWN_SHAPE\n");
+        }
+        if (d.type != STATIC_BODY && d.mass <= 0) {
+            throw std::runtime_error("ERROR::SYSTEM::IN_MEMBER_FUNCTION:\nADD_BODIES::NON_POSITIVE_MASS\n");
+        }
+        if (d.shape == nullptr) {
+            continue;
+        }
+
+        auto [it, inserted] = shape_indices.try_emplace(d.shape, definitions.size());
+        if (inserted) {
+            definitions.push_back(d.shape);
+        }
+        body_shapes[i] = it->second;
+    }
+
+    std::vector<ShapeHandle> handles_of_definitions(definitions.size());
+    std::vector<size_t> missing {};
+
+    for (size_t k = 0; k < definitions.size(); ++k) {
+        handles_of_definitions[k] = m_shapes.find(*definitions[k]);
+        if (!handles_of_definitions[k].is_valid()) {
+            missing.push_back(k);
+        }
+    }
+
+    std::vector<std::optional<ShapeData>> shapes(missing.size());
+    auto build_shape = [&](size_t m) { shapes[m].emplace(ShapeDefinition(*definitions[missing[m]])); };
+
+    if (parallel) {
+        parallel_for(0, missing.size(), build_shape, 16);
+    } else {
+        for (size_t m = 0; m < missing.size(); ++m) {
+            build_shape(m);
+        }
+    }
+
+    for (size_t m = 0; m < missing.size(); ++m) {
+        size_t k = missing[m];
+        handles_of_definitions[k] = m_shapes.add(ShapeDefinition(*definitions[k]), std::move(*shapes[m]));
+    }
+
+    m_bodies.reserve(m_bodies.size() + descriptors.size());
+    m_body_slots.reserve(m_bodies.size() + descriptors.size());
+
+    std::vector<BodyHandle> handles {};
+    handles.reserve(descriptors.size());
+
+    for (size_t i = 0; i < descriptors.size(); ++i) {
+        const BodyDescriptor& d = descriptors[i];
+        bool is_static = (d.type == STATIC_BODY);
+
+        ShapeHandle shape = (d.shape != nullptr) ? handles_of_definitions[body_shapes[i]] : d.shape_handle;
+        vector2 position = d.position;
+        vector2 velocity = (d.type == DYNAMIC_BODY) ? d.velocity : vector2 { 0, 0 };
+
+        RigidBody* body = push_body(is_static ? 1 : d.mass, shape, d.angle, 
+                                    is_static ? 0 : d.angular_velocity, position, velocity, d.type);
+
+        handles.push_back(body->get_handle());
+    }
+
+    return handles;
+}
+
+
+ForceField* System::add_field(std::unique_ptr<ForceField>&& field)
+{
+    if (!field) {
+        throw std::runtime_error("ERROR::SYSTEM::IN_MEMBER_FUNCTION:\nADD_FIELD::NULL_FIELD\n");
+    }
+
+    m_fields.push_back(std::move(field));
+    return m_fields.back().get();
 }
 
 
@@ -293,54 +719,177 @@ SpringGenerator* System::add_spring_connector(RigidBody* body1, RigidBody* body2
                                           anchor1, anchor2)
     );
 
-    m_force_indices[m_forces.back()->get_id()] = m_forces.size() - 1;
+    m_forces.back()->m_handle = m_force_slots.push_back();
+    m_force_colours_dirty = true;
     return dynamic_cast<SpringGenerator*>(m_forces.back().get());
 }
 
 
+SpringNetwork* System::add_spring_network(AccumulationMode mode)
+{
+    m_forces.emplace_back(std::make_unique<SpringNetwork>(mode));
 
+    m_forces.back()->m_handle = m_force_slots.push_back();
+    m_force_colours_dirty = true;
+    return dynamic_cast<SpringNetwork*>(m_forces.back().get());
+}
 
 
-void System::del_rigid_body(std::string&& id)
+BarnesHutGenerator* System::add_barnes_hut_generator(PairLaw law, double constant, double softening, 
+                                                     double opening_angle)
 {
-    global_gravity->decrease_max_nbodies();
-    global_gravity->del_body(id);
+    m_forces.emplace_back(std::make_unique<BarnesHutGenerator>(law, constant, softening, opening_angle));
 
-    m_bodies.erase(m_bodies.begin() + m_body_indices.at(id));
+    m_forces.back()->m_handle = m_force_slots.push_back();
+    m_force_colours_dirty = true;
+    return dynamic_cast<BarnesHutGenerator*>(m_forces.back().get());
+}
 
-    for (auto& f : m_forces) {
-        if (f->del_body(id)) {
-            del_force(f->get_id());
+
+PairPotentialGenerator* System::add_pair_potential_generator(PairPotential potential, double epsilon, double sigma,
+                                                             double cutoff, double skin, AccumulationMode mode)
+{
+    m_forces.emplace_back(std::make_unique<PairPotentialGenerator>(potential, epsilon, sigma, cutoff, skin, mode));
+
+    m_forces.back()->m_handle = m_force_slots.push_back();
+    m_force_colours_dirty = true;
+    return dynamic_cast<PairPotentialGenerator*>(m_forces.back().get());
+}
+
+
+void System::set_accumulation_mode(ForceHandle handle, AccumulationMode mode)
+{
+    m_forces[m_force_slots.index(handle)]->m_accumulation = mode;
+    m_force_colours_dirty = true;
+}
+
+
+
+
+
+RigidBody* System::get_rigid_body(BodyHandle handle) const
+{
+    return m_body_slots.contains(handle) ? m_bodies[m_body_slots.index(handle)].get() : nullptr;
+}
+
+
+ForceGenerator* System::get_force(ForceHandle handle) const
+{
+    return m_force_slots.contains(handle) ? m_forces[m_force_slots.index(handle)].get() : nullptr;
+}
+
+
+std::unordered_map<std::string, size_t> System::get_rigid_body_indices() const
+{
+    std::unordered_map<std::string, size_t> indices {};
+    for (size_t i = 0; i < m_bodies.size(); ++i) {
+        indices[m_bodies[i]->get_id()] = i;
+    }
+
+    return indices;
+}
+
+
+std::unordered_map<std::string, size_t> System::get_force_indices() const
+{
+    std::unordered_map<std::string, size_t> indices {};
+    for (size_t i = 0; i < m_forces.size(); ++i) {
+        indices[m_forces[i]->get_id()] = i;
+    }
+
+    return indices;
+}
+
+
+void System::del_rigid_body(BodyHandle handle)
+{
+    if (!m_body_slots.contains(handle)) {
+        throw std::runtime_error("ERROR::SYSTEM::IN_MEMBER_FUNCTION:\nDEL_RIGID_BODY::STALE_HANDLE\n");
+    }
+
+    RigidBody* body = m_bodies[m_body_slots.index(handle)].get();
+    if (!body->m_pending_removal) {
+        body->m_pending_removal = true;
+        m_body_removals.push_back(handle);
+    }
+}
+
+
+void System::del_rigid_body(std::string&& id)
+{
+    for (auto& b : m_bodies) {
+        if (b->get_id() == id) {
+            del_rigid_body(b->get_handle());
+            return;
         }
     }
 
-    size_t i = 0;
-    m_body_indices.clear();
-    for (auto& p : m_bodies) {
-        m_body_indices[p->get_id()] = i;
-        ++i; 
+    throw std::runtime_error("ERROR::SYSTEM::IN_MEMBER_FUNCTION:\nDEL_RIGID_BODY::ID_NOT_FOUND\n");
+}
+
+
+void System::del_force(ForceHandle handle) 
+{
+    if (!m_force_slots.contains(handle)) {
+        throw std::runtime_error("ERROR::SYSTEM::IN_MEMBER_FUNCTION:\nDEL_FORCE::STALE_HANDLE\n");
+    }
+
+    ForceGenerator* force = m_forces[m_force_slots.index(handle)].get();
+    if (!force->m_pending_removal) {
+        force->m_pending_removal = true;
+        m_force_removals.push_back(handle);
     }
 }
 
 
 void System::del_force(std::string&& id) 
 {
-    m_forces.erase(m_forces.begin() + m_force_indices.at(id));
-
-    size_t i = 0;
-    m_force_indices.clear();
     for (auto& f : m_forces) {
-        m_body_indices[f->get_id()] = i;
-        ++i; 
+        if (f->get_id() == id) {
+            del_force(f->get_handle());
+            return;
+        }
     }
+
+    throw std::runtime_error("ERROR::SYSTEM::IN_MEMBER_FUNCTION:\nDEL_FORCE::ID_NOT_FOUND\n");
 }
 
 
+void System::flush_deletions()
+{   
+    /* One sweep over the force generators detaches every queued body, then bodies and forces
+       are swap-and-popped out of their arrays. Linear in the number of generators plus the 
+       number of deletions, instead of a full rebuild per deleted element. */
+    if (!m_body_removals.empty()) {
+        for (auto& f : m_forces) {
+            if (!f->m_pending_removal && f->del_pending_bodies()) {
+                f->m_pending_removal = true;
+                m_force_removals.push_back(f->get_handle());
+            }
+        }
+
+        for (BodyHandle handle : m_body_removals) {
+            size_t index = m_body_slots.swap_remove(handle);
+            m_bodies[index] = std::move(m_bodies.back());
+            m_bodies.pop_back();
+        }
+        m_body_removals.clear();
+    }
+
+    for (ForceHandle handle : m_force_removals) {
+        size_t index = m_force_slots.swap_remove(handle);
+        m_forces[index] = std::move(m_forces.back());
+        m_forces.pop_back();
+        m_force_colours_dirty = true;
+    }
+    m_force_removals.clear();
+}
+
 
-void System::add_constraint(std::unique_ptr<Constraint>&& constraint)
+ConstraintHandle System::add_constraint(std::unique_ptr<Constraint>&& constraint)
 {
-    m_constraint_indices[constraint->get_id()] = m_constraints.size();
     m_constraints.push_back(std::move(constraint));
+    return m_constraint_slots.push_back();
 }
 
 
@@ -352,6 +901,8 @@ void System::print_config()
     std::cout << "  Time step     : " << 1000*m_config.time_step << " ms\n";
     std::cout << "  Global Gravity: " << m_config.global_gravity_flag << " (" 
               << m_config.gravitational_g << " m/s^2)\n";
+    std::cout << "  Viscous drag  : " << m_config.global_viscous_drag_flag << " (" 
+              << m_config.viscous_drag_coef << " kg/s)\n";
     std::cout << "---------------------------------------\n";
 }
 
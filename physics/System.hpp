@@ -1,6 +1,8 @@
 #ifndef SYSTEM_HPP
 #define SYSTEM_HPP
 
+#include <span>
+#include <string>
 #include <vector>
 #include <memory>
 #include <iomanip>
@@ -8,14 +10,21 @@
 #include <unordered_map>
 
 #include "util.hpp"
+#include "handle.hpp"
+#include "serialize.hpp"
 #include "sparse.hpp"
 #include "sparse.hpp"
 #include "RigidBody.hpp"
+#include "ShapeLibrary.hpp"
 #include "OdeSolver.hpp"
 #include "collisions.hpp"
+#include "BarnesHut.hpp"
+#include "PairPotential.hpp"
+#include "ForceField.hpp"
 #include "Constraint.hpp"
 #include "ForceGenerator.hpp"
 #include "LinearSolver.hpp"
+#include "profiling.hpp"
 
 
 struct SystemConfig
@@ -31,6 +40,15 @@ struct SystemConfig
 
     double penetration_threshhold { 0.01 };
 
+    // Steps between spatial reorderings of the body store, 0 disables them, see reorder_bodies()
+    size_t reorder_interval { 0 };
+
+    /* Results that only depend on the initial state, bit for bit, whatever the number of
+       threads or the storage order of the bodies: contacts are resolved in the order of the
+       serials of their bodies and generators that split their own work over threads do so
+       into a fixed number of partitions. Costs a sort of the broadphase pairs per detection. */
+    bool deterministic { false };
+
     float xi = 1.0;
     float N = 30;
     double stabilization_freq = 2*M_PI/(N * time_step);
@@ -39,32 +57,94 @@ struct SystemConfig
 };
 
 
+// Leading bytes and format version of a checkpoint, bumped whenever the layout changes
+constexpr char G_CHECKPOINT_MAGIC[8] { 'M', 'E', 'C', 'S', 'I', 'M', 'C', 'P' };
+constexpr uint32_t G_CHECKPOINT_VERSION { 2 };
+
+
+struct BodyDescriptor
+{   
+    /* Brief: Parameters of one body for System::add_bodies(). The shape is either a definition,
+              interned into the shape library, or a handle to a registered shape when shape is
+              null. Static bodies ignore mass and velocities, rotational ones the linear velocity. */
+    const ShapeDefinition* shape {};
+    ShapeHandle shape_handle {};
+    RigidBodyType type { DYNAMIC_BODY };
+
+    double mass { 1 };
+    double angle {};
+    double angular_velocity {};
+
+    vector2 position {};
+    vector2 velocity {};
+};
+
+
+struct BodyArenaDeleter
+{
+    size_t capacity {};
+
+    void operator()(RigidBody* bodies) const { std::allocator<RigidBody>().deallocate(bodies, capacity); }
+};
+
+// Uninitialised storage for the bodies of one reorder_bodies(), constructed in place
+using BodyArena = std::unique_ptr<RigidBody, BodyArenaDeleter>;
+
+
 class System
 {   
     private:
         double m_time { 0 };
         SystemConfig m_config {};
         double m_variable_step { m_config.time_step };
+        size_t m_steps_since_reorder { 0 };
+
+        // Only filled when built with MECSIM_ENABLE_PROFILING
+        ProfileStats m_stats {};
+
+        ShapeLibrary m_shapes {};
 
         std::vector<Contact> m_contacts {};
+        CollisionCache m_collision_cache {};
 
         std::vector<std::unique_ptr<RigidBody>> m_anchors {};
         std::unordered_map<std::string, size_t> m_anchor_indices {};
 
-        std::vector<std::unique_ptr<RigidBody>> m_bodies {};
-        std::unordered_map<std::string, size_t> m_body_indices {};
+        /* Bodies live on the heap until reorder_bodies() moves them into the arena, declared
+           first so that it outlives them. */
+        BodyArena m_body_arena {};
+        std::vector<BodyPtr> m_bodies {};
+        SlotMap<BodyTag> m_body_slots {};
 
         std::vector<std::unique_ptr<ForceGenerator>> m_forces {};
-        std::unordered_map<std::string, size_t> m_force_indices {};
+        SlotMap<ForceTag> m_force_slots {};
+
+        // Non serial generators grouped so that no two of a group touch the same body
+        std::vector<std::vector<ForceGenerator*>> m_force_colours {};
+        bool m_force_colours_dirty { true };
+        size_t m_force_colours_version {};
+
+        void colour_forces(size_t version);
+        void relocate_bodies();
 
         std::vector<std::unique_ptr<Constraint>> m_constraints {};
-        std::unordered_map<std::string, size_t> m_constraint_indices {};
+        SlotMap<ConstraintTag> m_constraint_slots {};
+
+        // Deletions are queued and applied together by flush_deletions()
+        std::vector<BodyHandle> m_body_removals {};
+        std::vector<ForceHandle> m_force_removals {};
 
-        std::unique_ptr<GravityGenerator> global_gravity = 
-        std::make_unique<GravityGenerator>(m_bodies, m_config.gravitational_g);
+        /* Fields act on the gathered body arrays, bodies opt out through their field mask. */
+        std::unique_ptr<GravityField> global_gravity = 
+        std::make_unique<GravityField>(m_config.gravitational_g);
         
-        // std::unique_ptr<VDragGenerator> global_viscous_drag = 
-        // std::make_unique<VDragGenerator>(m_particles, m_config.viscous_drag_coef);
+        std::unique_ptr<ViscousDragField> global_viscous_drag = 
+        std::make_unique<ViscousDragField>(m_config.viscous_drag_coef);
+
+        std::vector<std::unique_ptr<ForceField>> m_fields {};
+        BodyArrays m_body_arrays {};
+
+        void gather_body_arrays();
 
         std::vector<double> m_mass_buffer {};
         std::vector<double> m_constraint_buffer {};
@@ -76,6 +156,10 @@ class System
         void fill_mass_buffer();
         void fill_angular_and_linear_velocity_buffer();
         void fill_torque_and_force_buffer();
+
+        RigidBody* push_body(std::unique_ptr<RigidBody>&& body);
+        RigidBody* push_body(double mass, ShapeHandle shape, double angle, double angular_velocity, 
+                             vector2& position, vector2& velocity, RigidBodyType type);
         
         std::unique_ptr<OdeSolver> m_solver { std::make_unique<LeapFrog>(this) };
         
@@ -83,23 +167,38 @@ class System
         static constexpr uint8_t dimension { 2 };
         
         System() = default;
-        System(SystemConfig&& configuration) : m_config(std::move(configuration)) {}
+        System(SystemConfig&& configuration) : m_config(std::move(configuration)) 
+        {
+            set_ode_solver(m_config.ode_solver_type);
+        }
         
         double get_time() const { return m_time; }
         const SystemConfig& get_config() const { return m_config; }
         
-        const std::vector<std::unique_ptr<RigidBody>>& get_rigid_bodies() const { return m_bodies; }
-        const std::unordered_map<std::string, size_t>& get_rigid_body_indices() const { return m_body_indices; }
+        const std::vector<BodyPtr>& get_rigid_bodies() const { return m_bodies; }
+        const SlotMap<BodyTag>& get_rigid_body_slots() const { return m_body_slots; }
         
         const std::vector<std::unique_ptr<RigidBody>>& get_anchors() const { return m_anchors; }
         const std::unordered_map<std::string, size_t>& get_anchor_indices() const { return m_anchor_indices; }
         
+        const ShapeLibrary& get_shape_library() const { return m_shapes; }
+
         const std::vector<std::unique_ptr<ForceGenerator>>& get_forces()  const { return m_forces; }
-        const std::unordered_map<std::string, size_t> get_force_indices() const { return m_force_indices; }
+        const std::vector<std::unique_ptr<ForceField>>& get_fields() const { return m_fields; }
+        const SlotMap<ForceTag>& get_force_slots() const { return m_force_slots; }
+
+        // Null for handles of deleted elements
+        RigidBody*      get_rigid_body(BodyHandle handle) const;
+        ForceGenerator* get_force(ForceHandle handle) const;
+
+        /* Name to index maps built on request, for debugging and the constraint interface. */
+        std::unordered_map<std::string, size_t> get_rigid_body_indices() const;
+        std::unordered_map<std::string, size_t> get_force_indices() const;
         
         
         void set_ode_solver(OdeSolverType type);
         void set_time_step(double time_step);
+        void set_deterministic(bool deterministic);
         
         void set_global_gravity_flag(bool flag);
         void set_global_vdrag_flag(bool flag);
@@ -117,9 +216,38 @@ class System
         void compute_constraints();
         
         double compute_angular_momentum();
+        double compute_kinetic_energy();
+        double compute_potential_energy();
+        double compute_energy();
         
 
         double step();
+
+        /* Stage times and counters of the last step and summed over all steps since the last
+           reset. All zero unless built with MECSIM_ENABLE_PROFILING. */
+        const ProfileStats& stats() const { return m_stats; }
+        void reset_stats() { m_stats = {}; }
+
+        /* Moves the bodies in memory, pointers to them are invalidated unless constraints are
+           present. Hold handles across calls, or set reorder_interval only when nothing
+           outside the System keeps body pointers. */
+        void reorder_bodies();
+
+        /* Checkpoints hold the complete state of the simulation in a versioned binary snapshot:
+           configuration, shapes, bodies, force generators, fields and the collision cache.
+           Restoring one continues the run bit for bit and keeps every body, force and shape
+           handle valid, force generator ids are renumbered. Pending deletions are flushed
+           before saving. Constraints are not part of the snapshot, saving with constraints
+           throws and restoring drops them. A failed restore leaves the system unchanged. */
+        std::vector<char> save_state();
+        void restore_state(std::span<const char> data);
+
+        void save_checkpoint(const std::string& path);
+        void load_checkpoint(const std::string& path);
+
+        /* Hash of the time and of the position and velocity bits of every body, in order of
+           creation. Equal hashes after the same steps verify a run against a golden one. */
+        uint64_t state_hash() const;
         
         RigidBody* add_dynamic_body(double mass, std::vector<vector2>&& vertices, double angle, 
                            double angular_velocity, vector2& position, vector2& velocity);
@@ -129,15 +257,59 @@ class System
                            
         RigidBody* add_static_body(std::vector<vector2>&& vertices, double angle, vector2& position);
 
+        RigidBody* add_dynamic_body(double mass, ShapeDefinition&& shape, double angle, 
+                           double angular_velocity, vector2& position, vector2& velocity);
+
+        RigidBody* add_rotational_body(double mass, ShapeDefinition&& shape, double angle, 
+                                       double angular_velocity, vector2& position);
+                           
+        RigidBody* add_static_body(ShapeDefinition&& shape, double angle, vector2& position);
+
+        /* Equal definitions are interned, every body of a shape shares one ShapeData. */
+        ShapeHandle add_shape(ShapeDefinition&& shape);
+        size_t release_unused_shapes();
+
+        RigidBody* add_dynamic_body(double mass, ShapeHandle shape, double angle, 
+                           double angular_velocity, vector2& position, vector2& velocity);
+
+        RigidBody* add_rotational_body(double mass, ShapeHandle shape, double angle, 
+                                       double angular_velocity, vector2& position);
+                           
+        RigidBody* add_static_body(ShapeHandle shape, double angle, vector2& position);
+
+        std::vector<BodyHandle> add_bodies(std::span<const BodyDescriptor> descriptors, bool parallel = false);
+
+        ForceField* add_field(std::unique_ptr<ForceField>&& field);
+
         SpringGenerator* add_spring_connector(RigidBody* body1, RigidBody* body2, AnchorType anchor1, 
                                               AnchorType anchor2, double spring_constant, double spring_length);
+
+        // Empty network, springs are added to it directly
+        SpringNetwork* add_spring_network(AccumulationMode mode = SERIAL_ACCUMULATION);
+
+        // Empty pair force generator, bodies are added to it directly
+        BarnesHutGenerator* add_barnes_hut_generator(PairLaw law, double constant, double softening, 
+                                                     double opening_angle = 0.5);
+
+        // Empty short range generator, its neighbour list is kept across steps
+        PairPotentialGenerator* add_pair_potential_generator(PairPotential potential, double epsilon, double sigma,
+                                                             double cutoff, double skin,
+                                                             AccumulationMode mode = SERIAL_ACCUMULATION);
+
+        void set_accumulation_mode(ForceHandle handle, AccumulationMode mode);
                            
 
+        /* Deletions are deferred: the element stays in place until the next step starts or
+           flush_deletions() is called, then all queued ones are removed in a single pass. */
+        void del_rigid_body(BodyHandle handle);
         void del_rigid_body(std::string&& id);
 
+        void del_force(ForceHandle handle);
         void del_force(std::string&& id);
 
-        void add_constraint(std::unique_ptr<Constraint>&& constraint);
+        void flush_deletions();
+
+        ConstraintHandle add_constraint(std::unique_ptr<Constraint>&& constraint);
 
         void print_config();
         void print_rigid_body_info();
@@ -0,0 +1,545 @@
+#include "TrajectoryRecorder.hpp"
+
+#include <bit>
+#include <cstring>
+#include <iostream>
+#include <algorithm>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+/* File layout: a header, then one chunk per frame. A chunk starts with its own header and
+   holds the body serials when they differ from the previous frame, then the columns in
+   TrajectoryColumn order, each prefixed by its size in bytes. Keyframe columns are plain
+   arrays, the others are delta coded: a control byte per two values with the number of
+   significant bytes of each XOR, then those bytes, lowest first. Native byte order, files
+   of the other byte order are rejected. */
+
+constexpr uint32_t G_TRAJECTORY_BYTE_ORDER { 0x01020304 };
+constexpr uint32_t G_TRAJECTORY_CHUNK_MAGIC { 0x4b4e4843 };
+
+constexpr size_t G_TRAJECTORY_HEADER_SIZE { sizeof(G_TRAJECTORY_MAGIC) + 4 * sizeof(uint32_t) + 2 * sizeof(uint64_t) };
+constexpr size_t G_TRAJECTORY_CHUNK_HEADER_SIZE { 2 * sizeof(uint32_t) + 4 * sizeof(uint64_t) };
+
+// File flags
+constexpr uint32_t G_TRAJECTORY_FLOAT32 { 1u << 0 };
+constexpr uint32_t G_TRAJECTORY_DELTA   { 1u << 1 };
+
+// Chunk flags
+constexpr uint32_t G_CHUNK_KEYFRAME { 1u << 0 };
+constexpr uint32_t G_CHUNK_HAS_IDS  { 1u << 1 };
+
+
+template <typename T>
+static void put(char*& out, const T& value)
+{
+    std::memcpy(out, &value, sizeof(T));
+    out += sizeof(T);
+}
+
+
+template <typename T>
+static T get(const char*& in)
+{
+    T value;
+    std::memcpy(&value, in, sizeof(T));
+    in += sizeof(T);
+    return value;
+}
+
+
+template <typename W>
+static W to_word(double value)
+{
+    if constexpr (sizeof(W) == sizeof(float)) {
+        return std::bit_cast<W>(static_cast<float>(value));
+    } else {
+        return std::bit_cast<W>(value);
+    }
+}
+
+
+template <typename W>
+static double from_word(W word)
+{
+    if constexpr (sizeof(W) == sizeof(float)) {
+        return static_cast<double>(std::bit_cast<float>(word));
+    } else {
+        return std::bit_cast<double>(word);
+    }
+}
+
+
+template <typename W>
+static size_t max_column_bytes(size_t n)
+{
+    // Control bytes, every value whole, and slack for the full word stores of the encoder
+    return (n + 1) / 2 + n * sizeof(W) + sizeof(W);
+}
+
+
+template <typename W>
+static size_t encode_column(const double* values, uint64_t* previous, size_t n, bool keyframe, char* out)
+{
+    if (keyframe) {
+        for (size_t i = 0; i < n; ++i) {
+            W word = to_word<W>(values[i]);
+            std::memcpy(out + i * sizeof(W), &word, sizeof(W));
+            previous[i] = word;
+        }
+        return n * sizeof(W);
+    }
+
+    auto* control = reinterpret_cast<uint8_t*>(out);
+    char* data = out + (n + 1) / 2;
+    std::memset(control, 0, (n + 1) / 2);
+
+    for (size_t i = 0; i < n; ++i) {
+        W word = to_word<W>(values[i]);
+        W delta = word ^ static_cast<W>(previous[i]);
+        previous[i] = word;
+
+        // The whole word is stored, only its significant low bytes are kept
+        auto bytes = static_cast<uint8_t>((std::bit_width(delta) + 7) / 8);
+        control[i / 2] |= static_cast<uint8_t>(bytes << (4 * (i % 2)));
+        std::memcpy(data, &delta, sizeof(W));
+        data += bytes;
+    }
+
+    return static_cast<size_t>(data - out);
+}
+
+
+template <typename W>
+static void decode_column(const char* in, size_t size, uint64_t* previous, size_t n, bool keyframe, double* values)
+{
+    if (keyframe) {
+        if (size != n * sizeof(W)) {
+            throw std::runtime_error("ERROR::TRAJECTORY_READER::CORRUPT_COLUMN\n");
+        }
+
+        for (size_t i = 0; i < n; ++i) {
+            W word;
+            std::memcpy(&word, in + i * sizeof(W), sizeof(W));
+            previous[i] = word;
+            values[i] = from_word(word);
+        }
+        return;
+    }
+
+    size_t control_size = (n + 1) / 2;
+    if (size < control_size) {
+        throw std::runtime_error("ERROR::TRAJECTORY_READER::CORRUPT_COLUMN\n");
+    }
+
+    auto* control = reinterpret_cast<const uint8_t*>(in);
+    const char* data = in + control_size;
+    const char* end = in + size;
+
+    for (size_t i = 0; i < n; ++i) {
+        size_t bytes = (control[i / 2] >> (4 * (i % 2))) & 0xf;
+        if (bytes > sizeof(W) || bytes > static_cast<size_t>(end - data)) {
+            throw std::runtime_error("ERROR::TRAJECTORY_READER::CORRUPT_COLUMN\n");
+        }
+
+        W delta = 0;
+        std::memcpy(&delta, data, bytes);
+        data += bytes;
+
+        W word = static_cast<W>(previous[i]) ^ delta;
+        previous[i] = word;
+        values[i] = from_word(word);
+    }
+
+    if (data != end) {
+        throw std::runtime_error("ERROR::TRAJECTORY_READER::CORRUPT_COLUMN\n");
+    }
+}
+
+
+TrajectoryRecorder::TrajectoryRecorder(const std::string& path, TrajectoryOptions options) : m_options(options)
+{
+    m_options.keyframe_interval = std::max<size_t>(1, m_options.keyframe_interval);
+
+    m_fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (m_fd < 0) {
+        throw std::runtime_error("ERROR::TRAJECTORY_RECORDER::CANNOT_OPEN_" + path + "\n");
+    }
+
+    try {
+        reserve(G_TRAJECTORY_HEADER_SIZE);
+    } catch (...) {
+        ::close(m_fd);
+        throw;
+    }
+
+    // The header is written by finish(), once the number of frames is known
+    m_used = G_TRAJECTORY_HEADER_SIZE;
+
+    for (size_t i = 0; i < G_TRAJECTORY_QUEUE_DEPTH; ++i) {
+        m_free.push_back(std::make_unique<TrajectoryFrame>());
+    }
+
+    m_writer = std::thread(&TrajectoryRecorder::write_frames, this);
+}
+
+
+TrajectoryRecorder::~TrajectoryRecorder()
+{
+    try {
+        finish();
+    } catch (const std::exception& error) {
+        std::cerr << "WARNING::TRAJECTORY_RECORDER::DESTRUCTOR::" << error.what();
+    }
+}
+
+
+void TrajectoryRecorder::reserve(size_t bytes)
+{
+    /* Grows the file and maps it again as a whole, the old mapping is written back by the
+       kernel in the background. */
+    if (m_used + bytes <= m_capacity) {
+        return;
+    }
+
+    size_t capacity = m_used + bytes + G_TRAJECTORY_MAP_EXTENT;
+
+    if (m_map != nullptr) {
+        ::munmap(m_map, m_capacity);
+        m_map = nullptr;
+        m_capacity = 0;
+    }
+
+    if (::ftruncate(m_fd, static_cast<off_t>(capacity)) != 0) {
+        throw std::runtime_error("ERROR::TRAJECTORY_RECORDER::CANNOT_GROW_FILE\n");
+    }
+
+    void* map = ::mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+    if (map == MAP_FAILED) {
+        throw std::runtime_error("ERROR::TRAJECTORY_RECORDER::CANNOT_MAP_FILE\n");
+    }
+
+    m_map = static_cast<char*>(map);
+    m_capacity = capacity;
+}
+
+
+void TrajectoryRecorder::write_header()
+{
+    uint32_t flags = (m_options.float32 ? G_TRAJECTORY_FLOAT32 : 0) | (m_options.delta ? G_TRAJECTORY_DELTA : 0);
+
+    char* out = m_map;
+    std::memcpy(out, G_TRAJECTORY_MAGIC, sizeof(G_TRAJECTORY_MAGIC));
+    out += sizeof(G_TRAJECTORY_MAGIC);
+
+    put(out, G_TRAJECTORY_VERSION);
+    put(out, G_TRAJECTORY_BYTE_ORDER);
+    put(out, flags);
+    put(out, static_cast<uint32_t>(NUM_TRAJECTORY_COLUMNS));
+    put(out, m_written);
+    put(out, static_cast<uint64_t>(m_options.keyframe_interval));
+}
+
+
+void TrajectoryRecorder::write_frame(const TrajectoryFrame& frame)
+{
+    size_t n = frame.size();
+    bool float32 = m_options.float32;
+
+    bool same_bodies = (m_written > 0 && frame.ids == m_previous_ids);
+    bool keyframe = !m_options.delta || !same_bodies || m_written % m_options.keyframe_interval == 0;
+
+    size_t column_bytes = float32 ? max_column_bytes<uint32_t>(n) : max_column_bytes<uint64_t>(n);
+    reserve(G_TRAJECTORY_CHUNK_HEADER_SIZE + (same_bodies ? 0 : n * sizeof(uint64_t)) +
+            NUM_TRAJECTORY_COLUMNS * (sizeof(uint64_t) + column_bytes));
+
+    char* chunk = m_map + m_used;
+    char* out = chunk + G_TRAJECTORY_CHUNK_HEADER_SIZE;
+
+    if (!same_bodies) {
+        std::memcpy(out, frame.ids.data(), n * sizeof(uint64_t));
+        out += n * sizeof(uint64_t);
+        m_previous_ids = frame.ids;
+    }
+
+    for (size_t c = 0; c < NUM_TRAJECTORY_COLUMNS; ++c) {
+        std::vector<uint64_t>& previous = m_previous[c];
+        previous.resize(n);
+
+        char* size_field = out;
+        out += sizeof(uint64_t);
+
+        const double* values = frame.columns[c].data();
+        uint64_t bytes = float32 ? encode_column<uint32_t>(values, previous.data(), n, keyframe, out) :
+                                   encode_column<uint64_t>(values, previous.data(), n, keyframe, out);
+        put(size_field, bytes);
+        out += bytes;
+    }
+
+    uint32_t flags = (keyframe ? G_CHUNK_KEYFRAME : 0) | (same_bodies ? 0 : G_CHUNK_HAS_IDS);
+    uint64_t payload = static_cast<uint64_t>(out - chunk) - G_TRAJECTORY_CHUNK_HEADER_SIZE;
+
+    put(chunk, G_TRAJECTORY_CHUNK_MAGIC);
+    put(chunk, flags);
+    put(chunk, frame.index);
+    put(chunk, frame.time);
+    put(chunk, static_cast<uint64_t>(n));
+    put(chunk, payload);
+
+    m_used += G_TRAJECTORY_CHUNK_HEADER_SIZE + payload;
+    ++m_written;
+}
+
+
+void TrajectoryRecorder::write_frames()
+{
+    /* Writer thread: encodes queued frames in order and returns their buffers to the pool,
+       until finish() closes the queue and it is drained. */
+    try {
+        while (true) {
+            std::unique_ptr<TrajectoryFrame> frame;
+            {
+                std::unique_lock lock { m_mutex };
+                m_frame_ready.wait(lock, [this] { return !m_queue.empty() || m_closing; });
+
+                if (m_queue.empty()) {
+                    return;
+                }
+
+                frame = std::move(m_queue.front());
+                m_queue.pop_front();
+            }
+
+            write_frame(*frame);
+
+            {
+                std::lock_guard lock { m_mutex };
+                m_free.push_back(std::move(frame));
+            }
+            m_frame_free.notify_one();
+        }
+    } catch (...) {
+        std::lock_guard lock { m_mutex };
+        m_error = std::current_exception();
+        m_frame_free.notify_all();
+    }
+}
+
+
+void TrajectoryRecorder::record(const System& system)
+{
+    if (m_fd < 0) {
+        throw std::runtime_error("ERROR::TRAJECTORY_RECORDER::RECORD::ALREADY_FINISHED\n");
+    }
+
+    std::unique_ptr<TrajectoryFrame> frame;
+    {
+        std::unique_lock lock { m_mutex };
+        m_frame_free.wait(lock, [this] { return !m_free.empty() || m_error; });
+
+        if (m_error) {
+            std::rethrow_exception(m_error);
+        }
+
+        frame = std::move(m_free.back());
+        m_free.pop_back();
+    }
+
+    const auto& bodies = system.get_rigid_bodies();
+    size_t n = bodies.size();
+
+    frame->index = m_recorded++;
+    frame->time = system.get_time();
+    frame->ids.resize(n);
+    for (auto& column : frame->columns) {
+        column.resize(n);
+    }
+
+    uint64_t* ids = frame->ids.data();
+    double* x     = frame->columns[COLUMN_X].data();
+    double* y     = frame->columns[COLUMN_Y].data();
+    double* angle = frame->columns[COLUMN_ANGLE].data();
+    double* vx    = frame->columns[COLUMN_VX].data();
+    double* vy    = frame->columns[COLUMN_VY].data();
+    double* omega = frame->columns[COLUMN_OMEGA].data();
+
+    for (size_t i = 0; i < n; ++i) {
+        const RigidBody& b = *bodies[i];
+        ids[i]   = b.get_serial();
+        x[i]     = b.position.x;
+        y[i]     = b.position.y;
+        angle[i] = b.angle;
+        vx[i]    = b.velocity.x;
+        vy[i]    = b.velocity.y;
+        omega[i] = b.angular_velocity;
+    }
+
+    {
+        std::lock_guard lock { m_mutex };
+        m_queue.push_back(std::move(frame));
+    }
+    m_frame_ready.notify_one();
+}
+
+
+void TrajectoryRecorder::finish()
+{
+    if (m_fd < 0) {
+        return;
+    }
+
+    {
+        std::lock_guard lock { m_mutex };
+        m_closing = true;
+    }
+    m_frame_ready.notify_one();
+
+    if (m_writer.joinable()) {
+        m_writer.join();
+    }
+
+    std::exception_ptr error = m_error;
+    if (!error) {
+        write_header();
+    }
+
+    if (m_map != nullptr) {
+        ::munmap(m_map, m_capacity);
+        m_map = nullptr;
+    }
+
+    bool trimmed = ::ftruncate(m_fd, static_cast<off_t>(m_used)) == 0;
+    ::close(m_fd);
+    m_fd = -1;
+
+    if (error) {
+        std::rethrow_exception(error);
+    }
+
+    if (!trimmed) {
+        throw std::runtime_error("ERROR::TRAJECTORY_RECORDER::FINISH::CANNOT_TRIM_FILE\n");
+    }
+}
+
+
+TrajectoryReader::TrajectoryReader(const std::string& path)
+{
+    m_fd = ::open(path.c_str(), O_RDONLY);
+    if (m_fd < 0) {
+        throw std::runtime_error("ERROR::TRAJECTORY_READER::CANNOT_OPEN_" + path + "\n");
+    }
+
+    struct stat status {};
+    if (::fstat(m_fd, &status) != 0 || static_cast<size_t>(status.st_size) < G_TRAJECTORY_HEADER_SIZE) {
+        ::close(m_fd);
+        throw std::runtime_error("ERROR::TRAJECTORY_READER::NOT_A_TRAJECTORY\n");
+    }
+
+    m_size = static_cast<size_t>(status.st_size);
+    void* map = ::mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, m_fd, 0);
+    if (map == MAP_FAILED) {
+        ::close(m_fd);
+        throw std::runtime_error("ERROR::TRAJECTORY_READER::CANNOT_MAP_FILE\n");
+    }
+    m_map = static_cast<const char*>(map);
+
+    const char* in = m_map;
+    bool valid = std::memcmp(in, G_TRAJECTORY_MAGIC, sizeof(G_TRAJECTORY_MAGIC)) == 0;
+    in += sizeof(G_TRAJECTORY_MAGIC);
+
+    valid = valid && get<uint32_t>(in) == G_TRAJECTORY_VERSION;
+    valid = valid && get<uint32_t>(in) == G_TRAJECTORY_BYTE_ORDER;
+
+    auto flags = get<uint32_t>(in);
+    valid = valid && get<uint32_t>(in) == NUM_TRAJECTORY_COLUMNS;
+    m_num_frames = get<uint64_t>(in);
+
+    if (!valid) {
+        ::munmap(const_cast<char*>(m_map), m_size);
+        ::close(m_fd);
+        throw std::runtime_error("ERROR::TRAJECTORY_READER::NOT_A_TRAJECTORY\n");
+    }
+
+    m_float32 = (flags & G_TRAJECTORY_FLOAT32) != 0;
+    m_delta = (flags & G_TRAJECTORY_DELTA) != 0;
+    m_offset = G_TRAJECTORY_HEADER_SIZE;
+}
+
+
+TrajectoryReader::~TrajectoryReader()
+{
+    ::munmap(const_cast<char*>(m_map), m_size);
+    ::close(m_fd);
+}
+
+
+bool TrajectoryReader::read_frame(TrajectoryFrame& frame)
+{
+    if (m_read == m_num_frames) {
+        return false;
+    }
+
+    if (m_size - m_offset < G_TRAJECTORY_CHUNK_HEADER_SIZE) {
+        throw std::runtime_error("ERROR::TRAJECTORY_READER::TRUNCATED_FILE\n");
+    }
+
+    const char* in = m_map + m_offset;
+    auto magic   = get<uint32_t>(in);
+    auto flags   = get<uint32_t>(in);
+    frame.index  = get<uint64_t>(in);
+    frame.time   = get<double>(in);
+    auto n       = get<uint64_t>(in);
+    auto payload = get<uint64_t>(in);
+
+    size_t available = m_size - m_offset - G_TRAJECTORY_CHUNK_HEADER_SIZE;
+    if (magic != G_TRAJECTORY_CHUNK_MAGIC || payload > available) {
+        throw std::runtime_error("ERROR::TRAJECTORY_READER::CORRUPT_CHUNK\n");
+    }
+
+    const char* end = in + payload;
+    bool keyframe = (flags & G_CHUNK_KEYFRAME) != 0;
+
+    if (flags & G_CHUNK_HAS_IDS) {
+        if (n > static_cast<size_t>(end - in) / sizeof(uint64_t)) {
+            throw std::runtime_error("ERROR::TRAJECTORY_READER::CORRUPT_CHUNK\n");
+        }
+        m_previous_ids.resize(n);
+        std::memcpy(m_previous_ids.data(), in, n * sizeof(uint64_t));
+        in += n * sizeof(uint64_t);
+    }
+
+    // Delta coded frames need the bodies of the previous frame
+    if (n != m_previous_ids.size() || (!keyframe && m_previous[0].size() != n)) {
+        throw std::runtime_error("ERROR::TRAJECTORY_READER::CORRUPT_CHUNK\n");
+    }
+    frame.ids = m_previous_ids;
+
+    for (size_t c = 0; c < NUM_TRAJECTORY_COLUMNS; ++c) {
+        if (static_cast<size_t>(end - in) < sizeof(uint64_t)) {
+            throw std::runtime_error("ERROR::TRAJECTORY_READER::CORRUPT_CHUNK\n");
+        }
+
+        auto bytes = get<uint64_t>(in);
+        if (bytes > static_cast<size_t>(end - in)) {
+            throw std::runtime_error("ERROR::TRAJECTORY_READER::CORRUPT_CHUNK\n");
+        }
+
+        std::vector<uint64_t>& previous = m_previous[c];
+        previous.resize(n);
+        frame.columns[c].resize(n);
+
+        if (m_float32) {
+            decode_column<uint32_t>(in, bytes, previous.data(), n, keyframe, frame.columns[c].data());
+        } else {
+            decode_column<uint64_t>(in, bytes, previous.data(), n, keyframe, frame.columns[c].data());
+        }
+        in += bytes;
+    }
+
+    m_offset += G_TRAJECTORY_CHUNK_HEADER_SIZE + payload;
+    ++m_read;
+    return true;
+}
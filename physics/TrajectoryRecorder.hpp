@@ -0,0 +1,165 @@
+#ifndef TRAJECTORY_RECORDER_HPP
+#define TRAJECTORY_RECORDER_HPP
+
+#include <array>
+#include <deque>
+#include <mutex>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <exception>
+#include <unordered_map>
+#include <condition_variable>
+
+#include "System.hpp"
+
+
+enum TrajectoryColumn
+{
+    COLUMN_X,
+    COLUMN_Y,
+    COLUMN_ANGLE,
+    COLUMN_VX,
+    COLUMN_VY,
+    COLUMN_OMEGA,
+    NUM_TRAJECTORY_COLUMNS,
+};
+
+
+const std::unordered_map<TrajectoryColumn, std::string> G_TRAJECTORY_COLUMN_STRINGS_MAP
+{
+    { COLUMN_X,     "x" },
+    { COLUMN_Y,     "y" },
+    { COLUMN_ANGLE, "angle" },
+    { COLUMN_VX,    "vx" },
+    { COLUMN_VY,    "vy" },
+    { COLUMN_OMEGA, "omega" },
+};
+
+
+constexpr char G_TRAJECTORY_MAGIC[8] { 'M', 'E', 'C', 'S', 'I', 'M', 'T', 'R' };
+constexpr uint32_t G_TRAJECTORY_VERSION { 1 };
+
+// The file grows by at least this much at a time and is trimmed when the recorder finishes
+constexpr size_t G_TRAJECTORY_MAP_EXTENT { size_t(64) << 20 };
+
+// Captured frames waiting for the writer thread before record() blocks
+constexpr size_t G_TRAJECTORY_QUEUE_DEPTH { 4 };
+
+
+struct TrajectoryOptions
+{
+    // Values are rounded to float32 before they are written
+    bool float32 { false };
+
+    /* Frames store the XOR of every value with the one of the same body in the previous
+       frame, keeping only its significant bytes. Values that barely change, such as bodies
+       at rest, shrink to a few bits. Every keyframe_interval-th frame is stored whole. */
+    bool delta { false };
+    size_t keyframe_interval { 64 };
+};
+
+
+struct TrajectoryFrame
+{
+    /* Brief: State of every body at one instant, one column per quantity in the storage order
+              of the system. Bodies are identified by their serials. */
+    uint64_t index {};
+    double time {};
+    std::vector<uint64_t> ids {};
+    std::array<std::vector<double>, NUM_TRAJECTORY_COLUMNS> columns {};
+
+    size_t size() const { return ids.size(); }
+};
+
+
+class TrajectoryRecorder
+{
+    /* Brief: Streams body trajectories into a chunked binary file, one chunk per frame with
+              the columns stored one after the other. record() only copies the body state
+              into a free frame buffer and hands it over, a background thread encodes the
+              frames straight into a memory mapping of the file. Stepping only waits when the
+              writer falls G_TRAJECTORY_QUEUE_DEPTH frames behind. Linux and other POSIX
+              systems only. Errors of the writer thread are rethrown by the next call. */
+    private:
+        TrajectoryOptions m_options {};
+
+        int m_fd { -1 };
+        char* m_map { nullptr };
+        size_t m_capacity {};
+        size_t m_used {};
+
+        uint64_t m_recorded {};
+        uint64_t m_written {};
+
+        // Values of the previous frame as written, the reference of the delta encoding
+        std::vector<uint64_t> m_previous_ids {};
+        std::array<std::vector<uint64_t>, NUM_TRAJECTORY_COLUMNS> m_previous {};
+
+        std::mutex m_mutex {};
+        std::condition_variable m_frame_ready {};
+        std::condition_variable m_frame_free {};
+        std::deque<std::unique_ptr<TrajectoryFrame>> m_queue {};
+        std::vector<std::unique_ptr<TrajectoryFrame>> m_free {};
+        bool m_closing { false };
+        std::exception_ptr m_error {};
+        std::thread m_writer {};
+
+        void reserve(size_t bytes);
+        void write_header();
+        void write_frame(const TrajectoryFrame& frame);
+        void write_frames();
+
+    public:
+        explicit TrajectoryRecorder(const std::string& path, TrajectoryOptions options = {});
+        ~TrajectoryRecorder();
+
+        TrajectoryRecorder(const TrajectoryRecorder&) = delete;
+        TrajectoryRecorder& operator=(const TrajectoryRecorder&) = delete;
+
+        void record(const System& system);
+
+        /* Writes the queued frames, trims the file and closes it. Called by the destructor,
+           which only reports errors instead of throwing them. */
+        void finish();
+
+        size_t get_num_frames() const { return m_recorded; }
+};
+
+
+class TrajectoryReader
+{
+    /* Brief: Decodes a trajectory file frame by frame from a read only memory mapping. */
+    private:
+        int m_fd { -1 };
+        const char* m_map { nullptr };
+        size_t m_size {};
+        size_t m_offset {};
+
+        bool m_float32 {};
+        bool m_delta {};
+        uint64_t m_num_frames {};
+        uint64_t m_read {};
+
+        std::vector<uint64_t> m_previous_ids {};
+        std::array<std::vector<uint64_t>, NUM_TRAJECTORY_COLUMNS> m_previous {};
+
+    public:
+        explicit TrajectoryReader(const std::string& path);
+        ~TrajectoryReader();
+
+        TrajectoryReader(const TrajectoryReader&) = delete;
+        TrajectoryReader& operator=(const TrajectoryReader&) = delete;
+
+        bool is_float32() const { return m_float32; }
+        bool is_delta() const { return m_delta; }
+        size_t get_num_frames() const { return m_num_frames; }
+
+        // False once every frame was read
+        bool read_frame(TrajectoryFrame& frame);
+};
+
+#endif
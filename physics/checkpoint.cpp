@@ -0,0 +1,536 @@
+#include "System.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <type_traits>
+
+
+/* Layout of a checkpoint: magic, format version, byte order marker, payload size and payload
+   checksum, then the payload. Everything is in native byte order, a checkpoint written on a
+   machine of the other byte order is rejected instead of being swapped. */
+
+constexpr uint32_t G_CHECKPOINT_BYTE_ORDER { 0x01020304 };
+constexpr size_t G_CHECKPOINT_HEADER_SIZE { sizeof(G_CHECKPOINT_MAGIC) + 2 * sizeof(uint32_t) + 2 * sizeof(uint64_t) };
+
+
+static uint64_t checkpoint_checksum(std::span<const char> data)
+{
+    // FNV-1a over 64 bit words and then the trailing bytes, catches truncation and corruption
+    uint64_t hash = 0xcbf29ce484222325ull;
+    size_t words = data.size() / sizeof(uint64_t);
+
+    for (size_t i = 0; i < words; ++i) {
+        uint64_t word;
+        std::memcpy(&word, data.data() + i * sizeof(uint64_t), sizeof(uint64_t));
+        hash = (hash ^ word) * 0x100000001b3ull;
+    }
+
+    for (size_t i = words * sizeof(uint64_t); i < data.size(); ++i) {
+        hash = (hash ^ static_cast<unsigned char>(data[i])) * 0x100000001b3ull;
+    }
+
+    return hash;
+}
+
+
+static void write_config(BinaryWriter& writer, const SystemConfig& config)
+{
+    // Field by field, so that padding never ends up in the checkpoint
+    writer.write(config.gravitational_g);
+    writer.write(config.global_gravity_flag);
+    writer.write(config.viscous_drag_coef);
+    writer.write(config.global_viscous_drag_flag);
+    writer.write(config.time_step);
+    writer.write(config.ode_solver_type);
+    writer.write(config.penetration_threshhold);
+    writer.write<uint64_t>(config.reorder_interval);
+    writer.write(config.deterministic);
+    writer.write(config.xi);
+    writer.write(config.N);
+    writer.write(config.stabilization_freq);
+    writer.write(config.ks);
+    writer.write(config.kd);
+}
+
+
+static SystemConfig read_config(BinaryReader& reader)
+{
+    SystemConfig config;
+    config.gravitational_g = reader.read<double>();
+    config.global_gravity_flag = reader.read<bool>();
+    config.viscous_drag_coef = reader.read<double>();
+    config.global_viscous_drag_flag = reader.read<bool>();
+    config.time_step = reader.read<double>();
+    config.ode_solver_type = reader.read<OdeSolverType>();
+    config.penetration_threshhold = reader.read<double>();
+    config.reorder_interval = reader.read<uint64_t>();
+    config.deterministic = reader.read<bool>();
+    config.xi = reader.read<float>();
+    config.N = reader.read<float>();
+    config.stabilization_freq = reader.read<double>();
+    config.ks = reader.read<double>();
+    config.kd = reader.read<double>();
+
+    return config;
+}
+
+
+static void write_collision_cache(BinaryWriter& writer, const CollisionCache& cache)
+{
+    writer.write<uint64_t>(cache.frame);
+    writer.write<uint64_t>(cache.pairs.size());
+
+    for (auto& [key, pair] : cache.pairs) {
+        writer.write(key);
+        writer.write<uint64_t>(pair.axis_owner);
+        writer.write(pair.axis_face);
+        writer.write(pair.axis_valid);
+        writer.write<uint64_t>(pair.gjk.count);
+        writer.write(pair.gjk.index_a);
+        writer.write(pair.gjk.index_b);
+        writer.write<uint64_t>(pair.last_frame);
+    }
+}
+
+
+static CollisionCache read_collision_cache(BinaryReader& reader)
+{
+    CollisionCache cache;
+    cache.frame = reader.read<uint64_t>();
+
+    auto count = reader.read<uint64_t>();
+    cache.pairs.reserve(std::min<uint64_t>(count, reader.remaining()));
+
+    for (uint64_t i = 0; i < count; ++i) {
+        auto key = reader.read<uint64_t>();
+
+        PairCache pair;
+        pair.axis_owner = reader.read<uint64_t>();
+        pair.axis_face = reader.read<uint32_t>();
+        pair.axis_valid = reader.read<bool>();
+        pair.gjk.count = reader.read<uint64_t>();
+        pair.gjk.index_a = reader.read<std::array<size_t, 3>>();
+        pair.gjk.index_b = reader.read<std::array<size_t, 3>>();
+        pair.last_frame = reader.read<uint64_t>();
+
+        cache.pairs.emplace(key, pair);
+    }
+
+    return cache;
+}
+
+
+template <typename T>
+static std::vector<T> read_column(BinaryReader& reader, size_t size)
+{
+    std::vector<T> column = reader.read_array<T>();
+    if (column.size() != size) {
+        throw std::runtime_error("ERROR::SYSTEM::IN_MEMBER_FUNCTION:\nRESTORE_STATE::COLUMN_SIZE_MISMATCH\n");
+    }
+    return column;
+}
+
+
+std::vector<char> System::save_state()
+{
+    if (!m_constraints.empty()) {
+        throw std::runtime_error("ERROR::SYSTEM::IN_MEMBER_FUNCTION:\nSAVE_STATE::CONSTRAINTS_NOT_SUPPORTED\n");
+    }
+
+    flush_deletions();
+
+    size_t n = m_bodies.size();
+
+    BinaryWriter writer;
+    writer.reserve(G_CHECKPOINT_HEADER_SIZE + 1024 + n * 128);
+
+    // Payload size and checksum are filled in once the payload is written
+    writer.write_bytes(G_CHECKPOINT_MAGIC, sizeof(G_CHECKPOINT_MAGIC));
+    writer.write(G_CHECKPOINT_VERSION);
+    writer.write(G_CHECKPOINT_BYTE_ORDER);
+    writer.write<uint64_t>(0);
+    writer.write<uint64_t>(0);
+
+    write_config(writer, m_config);
+    writer.write(m_time);
+    writer.write(m_variable_step);
+    writer.write<uint64_t>(m_steps_since_reorder);
+
+    m_shapes.write(writer);
+
+    /* Bodies as one array per member in storage order, each written in a single block. */
+    m_body_slots.write(writer);
+    writer.write<uint64_t>(n);
+
+    auto write_column = [&](auto member)
+    {
+        using T = std::decay_t<decltype(member(*m_bodies.front()))>;
+        std::vector<T> column(n);
+
+        for (size_t i = 0; i < n; ++i) {
+            column[i] = member(*m_bodies[i]);
+        }
+        writer.write_array(column);
+    };
+
+    if (n > 0) {
+        write_column([](const RigidBody& b) { return b.angle; });
+        write_column([](const RigidBody& b) { return b.angular_velocity; });
+        write_column([](const RigidBody& b) { return b.position; });
+        write_column([](const RigidBody& b) { return b.velocity; });
+        write_column([](const RigidBody& b) { return b.force_accumulator; });
+        write_column([](const RigidBody& b) { return b.torque_accumulator; });
+        write_column([](const RigidBody& b) { return b.type; });
+        write_column([](const RigidBody& b) { return b.m_inv_mass; });
+        write_column([](const RigidBody& b) { return b.m_inv_inertia; });
+        write_column([](const RigidBody& b) { return b.m_shape_handle; });
+        write_column([](const RigidBody& b) { return b.m_field_mask; });
+        write_column([](const RigidBody& b) { return static_cast<uint64_t>(b.m_serial); });
+    }
+
+    // Names and extra anchors are rare, only the bodies that have them are listed
+    std::vector<uint32_t> named {};
+    std::vector<uint32_t> anchor_owners {}, anchor_counts {};
+    std::vector<double> anchor_offsets {}, anchor_angles {};
+
+    for (size_t i = 0; i < n; ++i) {
+        const RigidBody& b = *m_bodies[i];
+
+        if (!m_shapes.contains(b.m_shape_handle)) {
+            throw std::runtime_error("ERROR::SYSTEM::IN_MEMBER_FUNCTION:\nSAVE_STATE::BODY_SHAPE_NOT_IN_LIBRARY\n");
+        }
+
+        if (!b.m_name.empty()) {
+            named.push_back(static_cast<uint32_t>(i));
+        }
+
+        if (!b.m_extra_anchors.empty()) {
+            anchor_owners.push_back(static_cast<uint32_t>(i));
+            anchor_counts.push_back(static_cast<uint32_t>(b.m_extra_anchors.size()));
+
+            for (auto [offset, angle] : b.m_extra_anchors) {
+                anchor_offsets.push_back(offset);
+                anchor_angles.push_back(angle);
+            }
+        }
+    }
+
+    writer.write_array(named);
+    for (uint32_t i : named) {
+        writer.write_string(m_bodies[i]->m_name);
+    }
+
+    writer.write_array(anchor_owners);
+    writer.write_array(anchor_counts);
+    writer.write_array(anchor_offsets);
+    writer.write_array(anchor_angles);
+
+    /* Force generators refer to bodies by their index in the body store. */
+    BodyIndexMap indices {};
+    if (!m_forces.empty()) {
+        indices.reserve(n);
+        for (size_t i = 0; i < n; ++i) {
+            indices.emplace(m_bodies[i].get(), static_cast<uint32_t>(i));
+        }
+    }
+
+    m_force_slots.write(writer);
+    writer.write<uint64_t>(m_forces.size());
+
+    for (auto& f : m_forces) {
+        writer.write(f->m_type);
+        f->write_state(writer, indices);
+    }
+
+    writer.write<uint64_t>(m_fields.size());
+    for (auto& field : m_fields) {
+        field->write_state(writer);
+    }
+
+    write_collision_cache(writer, m_collision_cache);
+
+    std::vector<char>& data = writer.data();
+    std::span<const char> payload { data.data() + G_CHECKPOINT_HEADER_SIZE, data.size() - G_CHECKPOINT_HEADER_SIZE };
+
+    uint64_t payload_size = payload.size();
+    uint64_t checksum = checkpoint_checksum(payload);
+    std::memcpy(data.data() + G_CHECKPOINT_HEADER_SIZE - 2 * sizeof(uint64_t), &payload_size, sizeof(uint64_t));
+    std::memcpy(data.data() + G_CHECKPOINT_HEADER_SIZE - sizeof(uint64_t), &checksum, sizeof(uint64_t));
+
+    return std::move(data);
+}
+
+
+void System::restore_state(std::span<const char> data)
+{
+    /* Everything is read into locals first and only moved into the system at the end, so a
+       checkpoint that fails to read leaves the system as it was. */
+    BinaryReader header { data };
+
+    char magic[sizeof(G_CHECKPOINT_MAGIC)];
+    header.read_bytes(magic, sizeof(magic));
+    if (std::memcmp(magic, G_CHECKPOINT_MAGIC, sizeof(magic)) != 0) {
+        throw std::runtime_error("ERROR::SYSTEM::IN_MEMBER_FUNCTION:\nRESTORE_STATE::NOT_A_CHECKPOINT\n");
+    }
+
+    if (header.read<uint32_t>() != G_CHECKPOINT_VERSION) {
+        throw std::runtime_error("ERROR::SYSTEM::IN_MEMBER_FUNCTION:\nRESTORE_STATE::UNSUPPORTED_VERSION\n");
+    }
+
+    if (header.read<uint32_t>() != G_CHECKPOINT_BYTE_ORDER) {
+        throw std::runtime_error("ERROR::SYSTEM::IN_MEMBER_FUNCTION:\nRESTORE_STATE::FOREIGN_BYTE_ORDER\n");
+    }
+
+    auto payload_size = header.read<uint64_t>();
+    auto checksum = header.read<uint64_t>();
+    if (payload_size != header.remaining()) {
+        throw std::runtime_error("ERROR::SYSTEM::IN_MEMBER_FUNCTION:\nRESTORE_STATE::TRUNCATED_DATA\n");
+    }
+
+    std::span<const char> payload = data.subspan(G_CHECKPOINT_HEADER_SIZE);
+    if (checkpoint_checksum(payload) != checksum) {
+        throw std::runtime_error("ERROR::SYSTEM::IN_MEMBER_FUNCTION:\nRESTORE_STATE::CHECKSUM_MISMATCH\n");
+    }
+
+    BinaryReader reader { payload };
+
+    SystemConfig config = read_config(reader);
+    auto time = reader.read<double>();
+    auto variable_step = reader.read<double>();
+    auto steps_since_reorder = reader.read<uint64_t>();
+
+    std::unique_ptr<OdeSolver> solver = ode_solver_make_unique(config.ode_solver_type, this);
+    if (!solver) {
+        throw std::runtime_error("ERROR::SYSTEM::IN_MEMBER_FUNCTION:\nRESTORE_STATE::SOLVER_TYPE_NOT_FOUND\n");
+    }
+
+    ShapeLibrary shapes;
+    shapes.read(reader);
+
+    SlotMap<BodyTag> body_slots;
+    body_slots.read(reader);
+
+    auto n = reader.read<uint64_t>();
+    if (n != body_slots.size()) {
+        throw std::runtime_error("ERROR::SYSTEM::IN_MEMBER_FUNCTION:\nRESTORE_STATE::BODY_COUNT_MISMATCH\n");
+    }
+
+    std::vector<BodyPtr> bodies;
+    bodies.reserve(n);
+    size_t next_serial = 0;
+
+    if (n > 0) {
+        auto angle              = read_column<double>(reader, n);
+        auto angular_velocity   = read_column<double>(reader, n);
+        auto position           = read_column<vector2>(reader, n);
+        auto velocity           = read_column<vector2>(reader, n);
+        auto force_accumulator  = read_column<vector2>(reader, n);
+        auto torque_accumulator = read_column<double>(reader, n);
+        auto type               = read_column<RigidBodyType>(reader, n);
+        auto inv_mass           = read_column<double>(reader, n);
+        auto inv_inertia        = read_column<double>(reader, n);
+        auto shape              = read_column<ShapeHandle>(reader, n);
+        auto field_mask         = read_column<uint32_t>(reader, n);
+        auto serial             = read_column<uint64_t>(reader, n);
+
+        for (size_t i = 0; i < n; ++i) {
+            if (!shapes.contains(shape[i])) {
+                throw std::runtime_error("ERROR::SYSTEM::IN_MEMBER_FUNCTION:\nRESTORE_STATE::UNKNOWN_SHAPE\n");
+            }
+
+            // Unit mass only to get through the constructor, the inverse masses are restored
+            bodies.emplace_back(new RigidBody(1, shapes.get(shape[i]), angle[i], angular_velocity[i],
+                                              position[i], velocity[i], type[i]));
+            RigidBody& b = *bodies.back();
+
+            b.force_accumulator = force_accumulator[i];
+            b.torque_accumulator = torque_accumulator[i];
+            b.m_inv_mass = inv_mass[i];
+            b.m_inv_inertia = inv_inertia[i];
+            b.m_shape_handle = shape[i];
+            b.m_field_mask = field_mask[i];
+            b.m_serial = serial[i];
+            b.m_handle = body_slots.handle(i);
+
+            next_serial = std::max<size_t>(next_serial, serial[i] + 1);
+        }
+    }
+
+    auto named = reader.read_array<uint32_t>();
+    for (uint32_t i : named) {
+        if (i >= n) {
+            throw std::runtime_error("ERROR::SYSTEM::IN_MEMBER_FUNCTION:\nRESTORE_STATE::BODY_INDEX_OUT_OF_RANGE\n");
+        }
+        bodies[i]->m_name = reader.read_string();
+    }
+
+    auto anchor_owners = reader.read_array<uint32_t>();
+    auto anchor_counts = read_column<uint32_t>(reader, anchor_owners.size());
+    auto anchor_offsets = reader.read_array<double>();
+    auto anchor_angles = read_column<double>(reader, anchor_offsets.size());
+
+    size_t anchor = 0;
+    for (size_t k = 0; k < anchor_owners.size(); ++k) {
+        if (anchor_owners[k] >= n || anchor_counts[k] > anchor_offsets.size() - anchor) {
+            throw std::runtime_error("ERROR::SYSTEM::IN_MEMBER_FUNCTION:\nRESTORE_STATE::INVALID_ANCHORS\n");
+        }
+
+        for (uint32_t j = 0; j < anchor_counts[k]; ++j, ++anchor) {
+            bodies[anchor_owners[k]]->add_anchor(anchor_offsets[anchor], anchor_angles[anchor]);
+        }
+    }
+
+    std::vector<RigidBody*> body_pointers(n);
+    for (size_t i = 0; i < n; ++i) {
+        body_pointers[i] = bodies[i].get();
+    }
+
+    SlotMap<ForceTag> force_slots;
+    force_slots.read(reader);
+
+    auto nforces = reader.read<uint64_t>();
+    if (nforces != force_slots.size()) {
+        throw std::runtime_error("ERROR::SYSTEM::IN_MEMBER_FUNCTION:\nRESTORE_STATE::FORCE_COUNT_MISMATCH\n");
+    }
+
+    std::vector<std::unique_ptr<ForceGenerator>> forces;
+    forces.reserve(nforces);
+
+    for (size_t i = 0; i < nforces; ++i) {
+        switch (reader.read<ForceGeneratorType>()) {
+            case SPRING_CONNECTOR:
+                forces.push_back(SpringGenerator::read_state(reader, body_pointers));
+                break;
+            case SPRING_NETWORK:
+                forces.push_back(SpringNetwork::read_state(reader, body_pointers));
+                break;
+            case BARNES_HUT:
+                forces.push_back(BarnesHutGenerator::read_state(reader, body_pointers));
+                break;
+            case PAIR_POTENTIAL:
+                forces.push_back(PairPotentialGenerator::read_state(reader, body_pointers));
+                break;
+            default:
+                throw std::runtime_error("ERROR::SYSTEM::IN_MEMBER_FUNCTION:\nRESTORE_STATE::UNKNOWN_FORCE_TYPE\n");
+        }
+
+        forces.back()->m_handle = force_slots.handle(i);
+    }
+
+    auto nfields = reader.read<uint64_t>();
+    std::vector<std::unique_ptr<ForceField>> fields;
+
+    for (uint64_t i = 0; i < nfields; ++i) {
+        fields.push_back(ForceField::read_state(reader));
+    }
+
+    CollisionCache collision_cache = read_collision_cache(reader);
+
+    if (reader.remaining() != 0) {
+        throw std::runtime_error("ERROR::SYSTEM::IN_MEMBER_FUNCTION:\nRESTORE_STATE::TRAILING_DATA\n");
+    }
+
+    // Nothing below throws
+    m_config = config;
+    m_time = time;
+    m_variable_step = variable_step;
+    m_steps_since_reorder = steps_since_reorder;
+    m_solver = std::move(solver);
+
+    global_gravity->set_g(m_config.gravitational_g);
+    global_viscous_drag->set_coefficient(m_config.viscous_drag_coef);
+
+    m_force_colours.clear();
+    m_force_colours_dirty = true;
+    m_forces = std::move(forces);
+    m_force_slots = std::move(force_slots);
+    m_force_removals.clear();
+
+    m_constraints.clear();
+    m_constraint_slots.clear();
+
+    m_bodies = std::move(bodies);
+    m_body_arena.reset();
+    m_body_slots = std::move(body_slots);
+    m_body_removals.clear();
+    RigidBody::m_instance_id = std::max(RigidBody::m_instance_id, next_serial);
+
+    m_shapes = std::move(shapes);
+    m_fields = std::move(fields);
+
+    m_contacts.clear();
+    m_collision_cache = std::move(collision_cache);
+    m_stats = {};
+}
+
+
+void System::save_checkpoint(const std::string& path)
+{
+    std::vector<char> data = save_state();
+
+    std::FILE* file = std::fopen(path.c_str(), "wb");
+    if (file == nullptr) {
+        throw std::runtime_error("ERROR::SYSTEM::IN_MEMBER_FUNCTION:\nSAVE_CHECKPOINT::CANNOT_OPEN_" + path + "\n");
+    }
+
+    bool written = std::fwrite(data.data(), 1, data.size(), file) == data.size();
+    written = (std::fclose(file) == 0) && written;
+
+    if (!written) {
+        throw std::runtime_error("ERROR::SYSTEM::IN_MEMBER_FUNCTION:\nSAVE_CHECKPOINT::WRITE_FAILED\n");
+    }
+}
+
+
+void System::load_checkpoint(const std::string& path)
+{
+    std::FILE* file = std::fopen(path.c_str(), "rb");
+    if (file == nullptr) {
+        throw std::runtime_error("ERROR::SYSTEM::IN_MEMBER_FUNCTION:\nLOAD_CHECKPOINT::CANNOT_OPEN_" + path + "\n");
+    }
+
+    std::vector<char> data;
+    bool read = std::fseek(file, 0, SEEK_END) == 0;
+    long size = read ? std::ftell(file) : -1;
+    read = read && size >= 0 && std::fseek(file, 0, SEEK_SET) == 0;
+
+    if (read) {
+        data.resize(static_cast<size_t>(size));
+        read = std::fread(data.data(), 1, data.size(), file) == data.size();
+    }
+    std::fclose(file);
+
+    if (!read) {
+        throw std::runtime_error("ERROR::SYSTEM::IN_MEMBER_FUNCTION:\nLOAD_CHECKPOINT::READ_FAILED\n");
+    }
+
+    restore_state(data);
+}
+
+
+uint64_t System::state_hash() const
+{
+    /* Serial order rather than storage order, so reordering the bodies leaves the hash alone.
+       The serials themselves count every body ever created in the process and are left out. */
+    std::vector<const RigidBody*> bodies(m_bodies.size());
+    for (size_t i = 0; i < m_bodies.size(); ++i) {
+        bodies[i] = m_bodies[i].get();
+    }
+    std::sort(bodies.begin(), bodies.end(), [](const RigidBody* a, const RigidBody* b) { return a->m_serial < b->m_serial; });
+
+    BinaryWriter writer;
+    writer.reserve(sizeof(double) + bodies.size() * 6 * sizeof(double));
+    writer.write(m_time);
+
+    for (const RigidBody* b : bodies) {
+        writer.write(b->position.x);
+        writer.write(b->position.y);
+        writer.write(b->angle);
+        writer.write(b->velocity.x);
+        writer.write(b->velocity.y);
+        writer.write(b->angular_velocity);
+    }
+
+    return checkpoint_checksum(writer.data());
+}
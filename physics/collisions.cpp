@@ -1,5 +1,8 @@
+#include "gjk.hpp"
+#include "simd.hpp"
 #include "collisions.hpp"
 #include "RigidBody.hpp"
+#include "profiling.hpp"
 
 AABB compute_bouding_box(const vector2* vertices, size_t size) 
 {
@@ -24,14 +27,14 @@ void translate_bounding_box(const vector2& position, AABB& box)
 }
 
 
-std::vector<std::pair<size_t, size_t>> sort_and_sweep_aabb_boxes(const std::vector<std::unique_ptr<RigidBody>>& bodies) 
+std::vector<std::pair<size_t, size_t>> sort_and_sweep_aabb_boxes(const std::vector<BodyPtr>& bodies) 
 {
     std::vector<size_t> sorted_indices(bodies.size());
     std::iota(sorted_indices.begin(), sorted_indices.end(), 0);
 
     std::sort(sorted_indices.begin(), sorted_indices.end(),
     [&](size_t i, size_t j) {
-        return bodies[i]->get_aabb().min_x < bodies[i]->get_aabb().min_x;
+        return bodies[i]->get_aabb().min_x < bodies[j]->get_aabb().min_x;
     });
 
     std::vector<std::pair<size_t, size_t>> candidate_pairs;
@@ -51,39 +54,6 @@ std::vector<std::pair<size_t, size_t>> sort_and_sweep_aabb_boxes(const std::vect
 }
 
 
-std::pair<double, double> project_polygon(const vector2& axis, const vector2* vertices, size_t size) 
-{   
-    double projection = vertices[0]*axis;
-    double max = projection;
-    double min = projection;
-
-    for (size_t i = 1; i < size; ++i) {
-        projection = vertices[i]*axis;
-        max = std::max(max, projection);
-        min = std::min(min, projection);
-    }
-
-    return std::pair<double, double> { min, max };
-}
-
-int find_best_edge(const std::vector<vector2>& verts, const vector2& normal) {
-    int best = 0;
-    double max_dot = -std::numeric_limits<double>::infinity();
-
-    for (int i = 0; i < (int)verts.size(); ++i) {
-        int j = (i + 1) % verts.size();
-        vector2 edge = verts[j] - verts[i];
-        vector2 edge_normal = normalize(perpendicular(edge));
-        double d = edge_normal * normal;
-        if (d > max_dot) {
-            max_dot = d;
-            best = i;
-        }
-    }
-    return best;
-}
-
-
 int clip_edge(std::vector<vector2>& out_pts, vector2 p1, vector2 p2, vector2 normal, double offset) {
     out_pts.clear();
 
@@ -104,137 +74,476 @@ int clip_edge(std::vector<vector2>& out_pts, vector2 p1, vector2 p2, vector2 nor
 }
 
 
-bool detect_collisions(const std::vector<std::unique_ptr<RigidBody>>& bodies, 
-                       std::vector<Contact>& contacts, double epsilon)
+vector2 closest_point_on_segment(const vector2& p, const vector2& a, const vector2& b)
 {
-    contacts.clear();
+    vector2 ab = b - a;
+    double t = (p - a) * ab / (ab * ab);
+    t = std::clamp(t, 0.0, 1.0);
 
-    bool deep_penetration_found = false;
+    return a + t * ab;
+}
 
-    std::vector<std::pair<size_t, size_t>> candidate_pairs = sort_and_sweep_aabb_boxes(bodies);
 
-    if (candidate_pairs.empty()) {
-        return deep_penetration_found; 
+bool collide_points(const vector2& pa, double ra, const vector2& pb, double rb, Contact& contact)
+{   
+    /* Two discs. The normal points from b towards a and the contact point sits halfway 
+       through the overlap. */
+    vector2 delta = pa - pb;
+    double distance = delta.norm();
+    double radius = ra + rb;
+
+    if (distance > radius) {
+        return false;
     }
 
-    for (auto& pair : candidate_pairs) {
-        RigidBody* a = bodies[pair.first].get();
-        RigidBody* b = bodies[pair.second].get();
-            
-        const std::vector<vector2>& vertices_a = a->get_world_vertices();
-        const std::vector<vector2>& vertices_b = b->get_world_vertices();
-        
-        bool separating_found = false;
-        double min_depth = std::numeric_limits<double>::max();
-        vector2 collision_normal;
+    contact.normal = (distance > 0) ? delta/distance : vector2 { 0, 1 };
+    contact.penetration = radius - distance;
+    contact.contact_points.assign(1, pb + (rb - 0.5 * contact.penetration) * contact.normal);
 
-        Contact contact;
-        RigidBody* ref = nullptr;
+    return true;
+}
 
-        // SAT for a's normals
-        for (auto& normal : a->get_normals()) {
-            auto [min_a, max_a] = project_polygon(normal, vertices_a.data(), vertices_a.size());
-            auto [min_b, max_b] = project_polygon(normal, vertices_b.data(), vertices_b.size());
 
-            if (max_a < min_b || min_a > max_b) {
-                separating_found = true;
-                break;
-            } 
+bool collide_polygon_circle(RigidBody* polygon, RigidBody* circle, Contact& contact)
+{   
+    /* Face of maximum separation, then the Voronoi region of the centre against that face 
+       decides between a face and a vertex contact. Runs in the local frame of the polygon, 
+       only the winning features are transformed to world space. */
+    const std::vector<vector2>& vertices = polygon->get_polygon().vertices();
+
+    vector2 center = circle->world_vertex(0);
+    vector2 local_center = polygon->to_local_direction(center - polygon->position);
+    double radius = circle->get_radius();
+    size_t n = vertices.size();
+
+    size_t face = 0;
+    double separation = max_plane_distance(polygon->get_polygon().planes(), local_center, face);
+    if (separation > radius) {
+        return false;
+    }
+
+    size_t next = (face + 1) % n;
+    vector2 v1 = vertices[face];
+    vector2 v2 = vertices[next];
+
+    contact.a = circle;
+    contact.b = polygon;
+
+    if (separation > std::numeric_limits<double>::epsilon()) {
+        if ((local_center - v1) * (v2 - v1) <= 0) {
+            return collide_points(center, radius, polygon->world_vertex(face), 0, contact);
+        }
+        if ((local_center - v2) * (v1 - v2) <= 0) {
+            return collide_points(center, radius, polygon->world_vertex(next), 0, contact);
+        }
+    }
+
+    contact.normal = polygon->world_normal(face);
+    contact.penetration = radius - separation;
+    contact.contact_points.assign(1, center - (radius - 0.5 * contact.penetration) * contact.normal);
+
+    return true;
+}
+
+
+bool clip_contact(RigidBody* ref, size_t ref_face, RigidBody* inc, const vector2& collision_normal, 
+                  Contact& contact)
+{   
+    /* Clips the incident edge against the side planes of the reference face and keeps the
+       points behind it. The normal must point from ref towards inc. */
+    size_t ref_count = ref->get_polygon().size();
+    size_t inc_count = inc->get_polygon().size();
+
+    // The incident edge is the one most anti-parallel to the collision normal
+    size_t inc_edge = inc->get_polygon().best_edge(inc->to_local_direction(-collision_normal));
+
+    vector2 ref_v1 = ref->world_vertex(ref_face);
+    vector2 ref_v2 = ref->world_vertex((ref_face + 1) % ref_count);
+    vector2 inc_v1 = inc->world_vertex(inc_edge);
+    vector2 inc_v2 = inc->world_vertex((inc_edge + 1) % inc_count);
+
+    vector2 ref_normal = ref->world_normal(ref_face);
+    double ref_offset = ref_normal * ref_v1 + ref->get_radius();
 
-            double depth = std::min(max_a, max_b) - std::max(min_a, min_b);
-            if (depth < min_depth) {
-                min_depth = depth;
-                collision_normal = normal;
-                ref = a;
+    // Unit edge direction, the normal is its perpendicular
+    vector2 side_normal1 { ref_normal.y, -ref_normal.x };
+    double side_offset1 = side_normal1 * ref_v1;
+
+    vector2 side_normal2 = -side_normal1;
+    double side_offset2 = side_normal2 * ref_v2;
+
+    // Clip incident edge to reference edge side planes
+    std::vector<vector2> clipped_points;
+    int np = clip_edge(clipped_points, inc_v1, inc_v2, side_normal1, side_offset1);
+    if (np < 2) return false;
+
+    np = clip_edge(clipped_points, clipped_points[0], clipped_points[1], side_normal2, side_offset2);
+    if (np < 2) return false;
+
+    contact.contact_points.clear();
+
+    double inc_radius = inc->get_radius();
+    for (const auto& pt : clipped_points) {
+        double separation = ref_normal * pt - ref_offset - inc_radius;
+        if (separation <= 0) {
+            contact.contact_points.push_back(pt - inc_radius * ref_normal);
+        }
+    }
+
+    if (contact.contact_points.empty()) {
+        return false;
+    }
+
+    contact.a = inc;
+    contact.b = ref;
+    contact.normal = collision_normal;
+
+    return true;
+}
+
+
+struct RelativeTransform
+{
+    /* Brief: Maps the local frame of one proxy into the local frame of another. */
+    double cos_angle {};
+    double sin_angle {};
+    vector2 offset {};
+
+    vector2 apply(const vector2& v) const { return offset + rotate(v, cos_angle, sin_angle); }
+};
+
+
+static RelativeTransform relative_transform(const ConvexProxy& a, const ConvexProxy& b)
+{   
+    // Frame of a expressed in the frame of b
+    return RelativeTransform {
+        a.cos_angle * b.cos_angle + a.sin_angle * b.sin_angle,
+        a.sin_angle * b.cos_angle - a.cos_angle * b.sin_angle,
+        b.to_local(a.position - b.position)
+    };
+}
+
+
+static double find_max_separation(const ConvexProxy& a, const ConvexProxy& b, double limit, size_t& face)
+{   
+    /* Largest signed distance of the core of b from the face planes of a, evaluated in the 
+       local frame of b. The face normals of a turn monotonically, so the deepest vertex of b
+       along each is hill climbed from the one of the previous face. Stops early once the 
+       separation exceeds limit. */
+    const std::vector<vector2>& vertices_a = a.polygon->vertices();
+    const std::vector<vector2>& normals_a  = a.polygon->normals();
+    const std::vector<vector2>& vertices_b = b.polygon->vertices();
+
+    RelativeTransform a_to_b = relative_transform(a, b);
+
+    double max_separation = -std::numeric_limits<double>::max();
+    size_t deepest = 0;
+
+    for (size_t i = 0; i < normals_a.size(); ++i) {
+        vector2 normal = rotate(normals_a[i], a_to_b.cos_angle, a_to_b.sin_angle);
+        vector2 vertex = a_to_b.apply(vertices_a[i]);
+
+        deepest = (i == 0) ? b.polygon->support(-normal) : b.polygon->support(-normal, deepest);
+        double separation = normal * (vertices_b[deepest] - vertex);
+
+        if (separation > max_separation) {
+            max_separation = separation;
+            face = i;
+
+            if (separation > limit) {
+                break;
             }
         }
+    }
 
-        if (separating_found) {
+    return max_separation;
+}
+
+
+static double face_separation(const ConvexProxy& owner, size_t face, const ConvexProxy& other)
+{
+    vector2 normal = owner.normal(face);
+    return normal * (other.vertex(other.support(-normal)) - owner.vertex(face));
+}
+
+
+bool collide_polygons(RigidBody* a, RigidBody* b, Contact& contact, PairCache* cache)
+{   
+    /* SAT on the edge normals of both cores against the summed radius of rounded shapes 
+       (capsules). Face contacts clip the incident edge against the reference face; rounded 
+       shapes also test the axes joining their core vertices to the nearest core vertex of 
+       the other body, which yield single point contacts. */
+    ConvexProxy proxy_a = a->proxy();
+    ConvexProxy proxy_b = b->proxy();
+    double radius = a->get_radius() + b->get_radius();
+
+    // Last step's separating face, a single support query when it still separates
+    if (cache && cache->axis_valid) {
+        bool owner_is_a = (cache->axis_owner == a->get_serial());
+        const ConvexProxy& owner = owner_is_a ? proxy_a : proxy_b;
+        const ConvexProxy& other = owner_is_a ? proxy_b : proxy_a;
+
+        if (cache->axis_face < owner.polygon->normals().size() && 
+            face_separation(owner, cache->axis_face, other) > radius) {
+            return false;
+        }
+        cache->axis_valid = false;
+    }
+
+    auto cache_axis = [&](RigidBody* owner, size_t face) 
+    {
+        if (cache) {
+            cache->axis_owner = owner->get_serial();
+            cache->axis_face = static_cast<uint32_t>(face);
+            cache->axis_valid = true;
+        }
+    };
+
+    size_t face_a = 0;
+    double separation_a = find_max_separation(proxy_a, proxy_b, radius, face_a);
+    if (separation_a > radius) {
+        cache_axis(a, face_a);
+        return false;
+    }
+
+    size_t face_b = 0;
+    double separation_b = find_max_separation(proxy_b, proxy_a, radius, face_b);
+    if (separation_b > radius) {
+        cache_axis(b, face_b);
+        return false;
+    }
+
+    // Slight preference for a keeps the reference face stable between frames
+    RigidBody* ref = a;
+    size_t ref_face = face_a;
+    double max_separation = separation_a;
+
+    if (separation_b > separation_a + 1e-3) {
+        ref = b;
+        ref_face = face_b;
+        max_separation = separation_b;
+    }
+
+    // Vertex axes of rounded shapes
+    vector2 vertex_point {};
+    vector2 other_point {};
+    RigidBody* rounded = nullptr;
+
+    for (RigidBody* body : { a, b }) {
+        if (body->get_radius() == 0) {
             continue;
         }
 
-        // SAT for b's normals
-        for (auto& normal : b->get_normals()) {
-            auto [min_a, max_a] = project_polygon(normal, vertices_a.data(), vertices_a.size());
-            auto [min_b, max_b] = project_polygon(normal, vertices_b.data(), vertices_b.size());
+        const ConvexProxy& own   = (body == a) ? proxy_a : proxy_b;
+        const ConvexProxy& other = (body == a) ? proxy_b : proxy_a;
 
-            if (max_a < min_b || min_a > max_b) {
-                separating_found = true;
-                break;
-            } 
+        for (size_t i = 0; i < own.size(); ++i) {
+            vector2 p = own.vertex(i);
+
+            vector2 nearest = other.vertex(0);
+            for (size_t j = 1; j < other.size(); ++j) {
+                vector2 q = other.vertex(j);
+                if ((q - p) * (q - p) < (nearest - p) * (nearest - p)) {
+                    nearest = q;
+                }
+            }
 
-            double depth = std::min(max_a, max_b) - std::max(min_a, min_b);
-            if (depth < min_depth) {
-                min_depth = depth;
-                collision_normal = normal;
-                ref = b;
+            vector2 axis = nearest - p;
+            double length = axis.norm();
+            if (length == 0) {
+                continue;
+            }
+            axis = axis / length;
+
+            double separation = axis * (other.vertex(other.support(-axis)) - own.vertex(own.support(axis)));
+            if (separation > radius) {
+                return false;
+            }
+
+            if (separation > max_separation) {
+                max_separation = separation;
+                rounded = body;
+                vertex_point = p;
+                other_point = nearest;
             }
         }
+    }
 
-        if (separating_found) {
-            continue;
+    contact.penetration = radius - max_separation;
+
+    if (rounded != nullptr) {
+        RigidBody* other = (rounded == a) ? b : a;
+        contact.a = rounded;
+        contact.b = other;
+
+        if (!collide_points(vertex_point, rounded->get_radius(), other_point, other->get_radius(), contact)) {
+            return false;
         }
 
-        if (min_depth >= epsilon) {
-            deep_penetration_found = true;
-            return deep_penetration_found;
+        contact.penetration = radius - max_separation;
+        return true;
+    }
+
+    RigidBody* inc = (ref == a) ? b : a;
+    return clip_contact(ref, ref_face, inc, ref->world_normal(ref_face), contact);
+}
+
+
+bool collide_polygons_gjk(RigidBody* a, RigidBody* b, Contact& contact, PairCache* cache)
+{   
+    /* GJK distance between the cores, EPA when they overlap. The reference body is the one 
+       with the face best aligned to the separation normal. */
+    ConvexProxy proxy_a = a->proxy();
+    ConvexProxy proxy_b = b->proxy();
+    double radius = a->get_radius() + b->get_radius();
+
+    GjkResult gjk = gjk_distance(proxy_a, proxy_b, cache ? &cache->gjk : nullptr);
+
+    vector2 normal {};
+    if (!gjk.overlap) {
+        if (gjk.distance > radius) {
+            return false;
         }
 
-        RigidBody* inc = (ref == a) ? b : a;
-        const auto& ref_verts = ref->get_world_vertices();
-        const auto& inc_verts = inc->get_world_vertices();
+        normal = (gjk.closest_b - gjk.closest_a) / gjk.distance;
+        contact.penetration = radius - gjk.distance;
+    } else {
+        EpaResult epa = epa_penetration(proxy_a, proxy_b, gjk);
+        if (!epa.valid) {
+            return false;
+        }
 
-        // Find reference and incident edges
-        int ref_edge_idx = find_best_edge(ref_verts, collision_normal);
-        int inc_edge_idx = find_best_edge(inc_verts, -collision_normal);
+        normal = epa.normal;
+        contact.penetration = epa.depth + radius;
+    }
 
-        vector2 ref_v1 = ref_verts[ref_edge_idx];
-        vector2 ref_v2 = ref_verts[(ref_edge_idx + 1) % ref_verts.size()];
-        vector2 inc_v1 = inc_verts[inc_edge_idx];
-        vector2 inc_v2 = inc_verts[(inc_edge_idx + 1) % inc_verts.size()];
+    size_t face_a = proxy_a.best_edge(normal);
+    size_t face_b = proxy_b.best_edge(-normal);
 
-        vector2 ref_edge = ref_v2 - ref_v1;
-        vector2 ref_normal = normalize(perpendicular(ref_edge));
-        double ref_offset = ref_normal * ref_v1;
+    double alignment_a = proxy_a.normal(face_a) * normal;
+    double alignment_b = proxy_b.normal(face_b) * -normal;
+
+    // Slight preference for a keeps the reference face stable between frames
+    if (alignment_b > alignment_a + 1e-3) {
+        return clip_contact(b, face_b, a, -normal, contact);
+    } 
+    return clip_contact(a, face_a, b, normal, contact);
+}
 
-        vector2 side_normal1 = normalize(ref_edge);
-        double side_offset1 = side_normal1 * ref_v1;
 
-        vector2 side_normal2 = -side_normal1;
-        double side_offset2 = side_normal2 * ref_v2;
+bool collide_bodies(RigidBody* a, RigidBody* b, Contact& contact, PairCache* cache)
+{   
+    if (a->get_shape_type() > b->get_shape_type()) {
+        std::swap(a, b);
+    }
 
-        // Clip incident edge to reference edge side planes
-        std::vector<vector2> clipped_points;
-        int np = clip_edge(clipped_points, inc_v1, inc_v2, side_normal1, side_offset1);
-        if (np < 2) continue;
+    switch (a->get_shape_type()) {
+        case CollisionShapeType::POLYGON_SHAPE:
+            if (b->get_shape_type() == CIRCLE_SHAPE) {
+                return collide_polygon_circle(a, b, contact);
+            } 
+            break;
 
-        np = clip_edge(clipped_points, clipped_points[0], clipped_points[1], side_normal2, side_offset2);
-        if (np < 2) continue;
+        case CollisionShapeType::CIRCLE_SHAPE: {
+            vector2 center = a->world_vertex(0);
+            vector2 closest = (b->get_shape_type() == CAPSULE_SHAPE) ? 
+                closest_point_on_segment(center, b->world_vertex(0), b->world_vertex(1)) : b->world_vertex(0);
 
-        contact.contact_points.clear();
-        contact.penetration = 0.0;
+            contact.a = a;
+            contact.b = b;
+            return collide_points(center, a->get_radius(), closest, b->get_radius(), contact);
+        }
 
-        for (const auto& pt : clipped_points) {
-            double separation = ref_normal * pt - ref_offset;
-            if (separation <= 0) {
-                contact.contact_points.push_back(pt);
-            }
+        case CollisionShapeType::CAPSULE_SHAPE:
+            break;
+
+        default:
+            return false;
+    }
+
+    if (a->get_vertices().size() + b->get_vertices().size() > G_GJK_VERTEX_THRESHOLD) {
+        return collide_polygons_gjk(a, b, contact, cache);
+    }
+    return collide_polygons(a, b, contact, cache);
+}
+
+
+bool detect_collisions(const std::vector<BodyPtr>& bodies, 
+                       std::vector<Contact>& contacts, double epsilon, CollisionCache* cache,
+                       bool deterministic)
+{
+    MECSIM_PROFILE_STAGE(STAGE_COLLISION_DETECTION);
+
+    contacts.clear();
+
+    if (cache) {
+        ++cache->frame;
+    }
+
+    bool deep_penetration_found = false;
+
+    std::vector<std::pair<size_t, size_t>> candidate_pairs = sort_and_sweep_aabb_boxes(bodies);
+    MECSIM_PROFILE_COUNT(COUNTER_BROADPHASE_PAIRS, candidate_pairs.size());
+
+    // The sweep order follows the storage order of the bodies, the serials do not
+    if (deterministic) {
+        std::vector<std::pair<uint64_t, size_t>> keys(candidate_pairs.size());
+        for (size_t k = 0; k < keys.size(); ++k) {
+            auto [i, j] = candidate_pairs[k];
+            keys[k] = { CollisionCache::key(bodies[i]->get_serial(), bodies[j]->get_serial()), k };
         }
+        std::sort(keys.begin(), keys.end());
 
-        if (contact.contact_points.empty()) {
+        std::vector<std::pair<size_t, size_t>> sorted(keys.size());
+        for (size_t k = 0; k < keys.size(); ++k) {
+            sorted[k] = candidate_pairs[keys[k].second];
+        }
+        candidate_pairs = std::move(sorted);
+    }
+
+    if (candidate_pairs.empty()) {
+        if (cache) {
+            cache->pairs.clear();
+        }
+        return deep_penetration_found; 
+    }
+
+    for (auto& pair : candidate_pairs) {
+        RigidBody* a = bodies[pair.first].get();
+        RigidBody* b = bodies[pair.second].get();
+
+        // Overlapping static bodies can neither be resolved nor backtracked out of
+        if (a->type == STATIC_BODY && b->type == STATIC_BODY) {
             continue;
         }
 
-        contact.a = inc;
-        contact.b = ref;
-        
-        if (collision_normal * (inc->position - ref->position) < 0) {
-            contact.normal = -collision_normal;
-        } else {
-            contact.normal = collision_normal;  
+        // Fixed order per pair keeps cached features and the reference face preference stable
+        if (a->get_serial() > b->get_serial()) {
+            std::swap(a, b);
+        }
+
+        PairCache* pair_cache = nullptr;
+        if (cache) {
+            pair_cache = &cache->pairs[CollisionCache::key(a->get_serial(), b->get_serial())];
+            pair_cache->last_frame = cache->frame;
+        }
+
+        Contact contact;
+        if (!collide_bodies(a, b, contact, pair_cache)) {
+            continue;
+        }
+        MECSIM_PROFILE_COUNT(COUNTER_NARROWPHASE_HITS, 1);
+
+        if (contact.penetration >= epsilon) {
+            deep_penetration_found = true;
+            return deep_penetration_found;
         }
         
-        contacts.push_back(contact);
+        contacts.push_back(std::move(contact));
+    }
+
+    if (cache) {
+        std::erase_if(cache->pairs, [&](const auto& entry) { return entry.second.last_frame != cache->frame; });
     }
 
     return deep_penetration_found;
@@ -4,12 +4,69 @@
 #include <vector>
 #include <memory>
 #include <numeric>
+#include <cstdint>
 #include <algorithm>
+#include <unordered_map>
 
+#include "gjk.hpp"
 #include "vector2.hpp"
 
 class RigidBody;
 
+
+struct BodyDeleter
+{
+    /* Brief: Owner of the bodies of a System. Bodies relocated into its arena by 
+              reorder_bodies() are only destroyed, their memory goes with the arena. */
+    bool in_arena { false };
+
+    void operator()(RigidBody* body) const;
+};
+
+using BodyPtr = std::unique_ptr<RigidBody, BodyDeleter>;
+
+
+// Convex pairs with more core vertices than this in total use GJK/EPA instead of SAT
+constexpr size_t G_GJK_VERTEX_THRESHOLD { 64 };
+
+
+
+enum CollisionShapeType
+{
+    POLYGON_SHAPE,
+    CIRCLE_SHAPE,
+    CAPSULE_SHAPE,
+    NUM_COLLISION_SHAPES,
+};
+
+
+struct ShapeDefinition
+{   
+    /* Brief: Core polygon (counter- or clockwise), swept by radius. Circles have the single
+              core vertex at the origin, capsules a core segment centred on it. */
+    CollisionShapeType type { POLYGON_SHAPE };
+    std::vector<vector2> vertices {};
+    double radius {};
+};
+
+
+inline ShapeDefinition polygon_shape(std::vector<vector2>&& vertices)
+{
+    return ShapeDefinition { POLYGON_SHAPE, std::move(vertices), 0 };
+}
+
+inline ShapeDefinition circle_shape(double radius)
+{
+    return ShapeDefinition { CIRCLE_SHAPE, { vector2 { 0, 0 } }, radius };
+}
+
+inline ShapeDefinition capsule_shape(double length, double radius)
+{   
+    // Segment along the local x axis, the total extent is length + 2*radius
+    return ShapeDefinition { CAPSULE_SHAPE, { vector2 { -length/2, 0 }, vector2 { length/2, 0 } }, radius };
+}
+
+
 struct AABB 
 {
     double min_x, max_x;
@@ -25,12 +82,41 @@ struct Contact {
     std::vector<vector2> contact_points {};
 };
 
+struct PairCache
+{
+    /* Brief: Narrowphase state of one broadphase pair carried over to the next step. A face 
+              that separated the pair is tried first and usually still does, which skips the
+              full SAT sweep. The GJK simplex warm starts the distance query. */
+    size_t axis_owner {};
+    uint32_t axis_face {};
+    bool axis_valid { false };
+
+    GjkCache gjk {};
+    size_t last_frame {};
+};
+
+
+struct CollisionCache
+{   
+    /* Brief: Pair caches keyed by the serials of both bodies. Pairs that leave the broadphase
+              are pruned at the end of every detection pass. */
+    std::unordered_map<uint64_t, PairCache> pairs {};
+    size_t frame { 0 };
+
+    static uint64_t key(size_t serial_a, size_t serial_b)
+    {
+        return (static_cast<uint64_t>(std::min(serial_a, serial_b)) << 32) | std::max(serial_a, serial_b);
+    }
+};
+
+
 AABB compute_bouding_box(const vector2* vertices, size_t size);
 
-std::vector<std::pair<size_t, size_t>> sort_and_sweep_aabb_boxes(const std::vector<RigidBody*>& bodies);
+std::vector<std::pair<size_t, size_t>> sort_and_sweep_aabb_boxes(const std::vector<BodyPtr>& bodies);
 
-bool detect_collisions(const std::vector<std::unique_ptr<RigidBody>>& bodies, 
-                             std::vector<Contact>& contacts, double epsilon);
+bool detect_collisions(const std::vector<BodyPtr>& bodies, 
+                             std::vector<Contact>& contacts, double epsilon, CollisionCache* cache = nullptr,
+                             bool deterministic = false);
 
 void resolve_contact(Contact& contact);
 
@@ -0,0 +1,366 @@
+#include "gjk.hpp"
+
+#include <limits>
+
+
+static SupportPoint make_support_point(const ConvexProxy& a, const ConvexProxy& b, 
+                                       size_t index_a, size_t index_b)
+{
+    vector2 point_a = a.vertex(index_a);
+    vector2 point_b = b.vertex(index_b);
+
+    return SupportPoint { point_a - point_b, point_a, point_b, index_a, index_b };
+}
+
+
+static SupportPoint support(const ConvexProxy& a, const ConvexProxy& b, const vector2& direction, 
+                            size_t hint_a, size_t hint_b)
+{   
+    // Consecutive search directions rotate slowly, so the previous support is a close start
+    size_t index_a = a.support(direction, hint_a);
+    size_t index_b = b.support(-direction, hint_b);
+
+    return make_support_point(a, b, index_a, index_b);
+}
+
+
+static SupportPoint support(const ConvexProxy& a, const ConvexProxy& b, const vector2& direction)
+{
+    return make_support_point(a, b, a.support(direction), b.support(-direction));
+}
+
+
+struct Simplex
+{
+    /* Brief: Up to three support points with the barycentric coordinates of the point of
+              their convex hull closest to the origin. */
+    std::array<SupportPoint, 3> v {};
+    std::array<double, 3> bary {};
+    size_t count {};
+
+    void solve2()
+    {
+        vector2 w1 = v[0].w;
+        vector2 w2 = v[1].w;
+        vector2 e12 = w2 - w1;
+
+        // w1 region
+        double d12_2 = -(w1 * e12);
+        if (d12_2 <= 0) {
+            bary[0] = 1;
+            count = 1;
+            return;
+        }
+
+        // w2 region
+        double d12_1 = w2 * e12;
+        if (d12_1 <= 0) {
+            bary[0] = 1;
+            v[0] = v[1];
+            count = 1;
+            return;
+        }
+
+        // Edge region
+        double inv = 1 / (d12_1 + d12_2);
+        bary[0] = d12_1 * inv;
+        bary[1] = d12_2 * inv;
+        count = 2;
+    }
+
+    void solve3()
+    {
+        vector2 w1 = v[0].w;
+        vector2 w2 = v[1].w;
+        vector2 w3 = v[2].w;
+
+        vector2 e12 = w2 - w1;
+        double d12_1 = w2 * e12;
+        double d12_2 = -(w1 * e12);
+
+        vector2 e13 = w3 - w1;
+        double d13_1 = w3 * e13;
+        double d13_2 = -(w1 * e13);
+
+        vector2 e23 = w3 - w2;
+        double d23_1 = w3 * e23;
+        double d23_2 = -(w2 * e23);
+
+        double n123 = cross2d(e12, e13);
+        double d123_1 = n123 * cross2d(w2, w3);
+        double d123_2 = n123 * cross2d(w3, w1);
+        double d123_3 = n123 * cross2d(w1, w2);
+
+        // w1 region
+        if (d12_2 <= 0 && d13_2 <= 0) {
+            bary[0] = 1;
+            count = 1;
+            return;
+        }
+
+        // e12 region
+        if (d12_1 > 0 && d12_2 > 0 && d123_3 <= 0) {
+            double inv = 1 / (d12_1 + d12_2);
+            bary[0] = d12_1 * inv;
+            bary[1] = d12_2 * inv;
+            count = 2;
+            return;
+        }
+
+        // e13 region
+        if (d13_1 > 0 && d13_2 > 0 && d123_2 <= 0) {
+            double inv = 1 / (d13_1 + d13_2);
+            bary[0] = d13_1 * inv;
+            bary[1] = d13_2 * inv;
+            v[1] = v[2];
+            count = 2;
+            return;
+        }
+
+        // w2 region
+        if (d12_1 <= 0 && d23_2 <= 0) {
+            bary[0] = 1;
+            v[0] = v[1];
+            count = 1;
+            return;
+        }
+
+        // w3 region
+        if (d13_1 <= 0 && d23_1 <= 0) {
+            bary[0] = 1;
+            v[0] = v[2];
+            count = 1;
+            return;
+        }
+
+        // e23 region
+        if (d23_1 > 0 && d23_2 > 0 && d123_1 <= 0) {
+            double inv = 1 / (d23_1 + d23_2);
+            bary[0] = d23_2 * inv;
+            bary[1] = d23_1 * inv;
+            v[0] = v[2];
+            count = 2;
+            return;
+        }
+
+        // Origin inside the triangle
+        double inv = 1 / (d123_1 + d123_2 + d123_3);
+        bary[0] = d123_1 * inv;
+        bary[1] = d123_2 * inv;
+        bary[2] = d123_3 * inv;
+        count = 3;
+    }
+
+    vector2 search_direction() const
+    {
+        if (count == 1) {
+            return -v[0].w;
+        }
+
+        // Perpendicular to the edge, on the side of the origin
+        vector2 e12 = v[1].w - v[0].w;
+        if (cross2d(e12, -v[0].w) > 0) {
+            return perpendicular(e12);
+        }
+        return -perpendicular(e12);
+    }
+
+    void witness_points(vector2& point_a, vector2& point_b) const
+    {
+        point_a = vector2 {};
+        point_b = vector2 {};
+
+        for (size_t i = 0; i < count; ++i) {
+            point_a += bary[i] * v[i].point_a;
+            point_b += bary[i] * v[i].point_b;
+        }
+    }
+};
+
+
+GjkResult gjk_distance(const ConvexProxy& a, const ConvexProxy& b, GjkCache* cache)
+{
+    size_t size_a = a.size();
+    size_t size_b = b.size();
+    Simplex simplex {};
+
+    if (cache && cache->count > 0) {
+        for (size_t i = 0; i < cache->count; ++i) {
+            size_t ia = std::min(cache->index_a[i], size_a - 1);
+            size_t ib = std::min(cache->index_b[i], size_b - 1);
+            simplex.v[i] = make_support_point(a, b, ia, ib);
+        }
+        simplex.count = cache->count;
+    } else {
+        simplex.v[0] = make_support_point(a, b, 0, 0);
+        simplex.count = 1;
+    }
+    simplex.bary[0] = 1;
+
+    const size_t max_iterations = 20 + size_a + size_b;
+    size_t iteration = 0;
+
+    while (iteration < max_iterations) {
+        std::array<size_t, 3> saved_a {};
+        std::array<size_t, 3> saved_b {};
+        size_t saved_count = simplex.count;
+
+        for (size_t i = 0; i < saved_count; ++i) {
+            saved_a[i] = simplex.v[i].index_a;
+            saved_b[i] = simplex.v[i].index_b;
+        }
+
+        switch (simplex.count) {
+            case 2: simplex.solve2(); break;
+            case 3: simplex.solve3(); break;
+            default: break;
+        }
+
+        if (simplex.count == 3) {
+            break;
+        }
+
+        vector2 direction = simplex.search_direction();
+        if (direction * direction < std::numeric_limits<double>::epsilon() * std::numeric_limits<double>::epsilon()) {
+            break;
+        }
+
+        const SupportPoint& last = simplex.v[simplex.count - 1];
+        SupportPoint point = support(a, b, direction, last.index_a, last.index_b);
+        ++iteration;
+
+        // A repeated support point means no progress can be made
+        bool duplicate = false;
+        for (size_t i = 0; i < saved_count; ++i) {
+            if (point.index_a == saved_a[i] && point.index_b == saved_b[i]) {
+                duplicate = true;
+                break;
+            }
+        }
+
+        if (duplicate) {
+            break;
+        }
+
+        simplex.v[simplex.count++] = point;
+    }
+
+    GjkResult result {};
+    simplex.witness_points(result.closest_a, result.closest_b);
+    result.distance = (result.closest_b - result.closest_a).norm();
+    result.overlap = (simplex.count == 3) || result.distance < 1e-12;
+    result.simplex = simplex.v;
+    result.simplex_count = simplex.count;
+    result.iterations = iteration;
+
+    if (cache) {
+        cache->count = simplex.count;
+        for (size_t i = 0; i < simplex.count; ++i) {
+            cache->index_a[i] = simplex.v[i].index_a;
+            cache->index_b[i] = simplex.v[i].index_b;
+        }
+    }
+
+    return result;
+}
+
+
+EpaResult epa_penetration(const ConvexProxy& a, const ConvexProxy& b, const GjkResult& gjk)
+{
+    /* Expands the terminating GJK simplex into a polytope of A - B, always splitting the
+       edge closest to the origin, until the support along its normal adds no depth. */
+    EpaResult result {};
+    std::vector<SupportPoint> polytope(gjk.simplex.begin(), gjk.simplex.begin() + gjk.simplex_count);
+
+    // Touching contacts terminate GJK with fewer than three points, blow them up to a triangle
+    if (polytope.size() == 1) {
+        polytope.push_back(support(a, b, vector2 { 1, 0 }));
+        if ((polytope[1].w - polytope[0].w).norm() == 0) {
+            polytope[1] = support(a, b, vector2 { -1, 0 });
+        }
+    }
+
+    if (polytope.size() == 2) {
+        vector2 normal = perpendicular(polytope[1].w - polytope[0].w);
+        SupportPoint point = support(a, b, normal);
+
+        if (std::abs(cross2d(polytope[1].w - polytope[0].w, point.w - polytope[0].w)) < 1e-12) {
+            point = support(a, b, -normal);
+        }
+        polytope.push_back(point);
+    }
+
+    if (cross2d(polytope[1].w - polytope[0].w, polytope[2].w - polytope[0].w) < 0) {
+        std::swap(polytope[1], polytope[2]);
+    }
+
+    const size_t max_iterations = 20 + a.size() + b.size();
+
+    for (size_t iteration = 0; iteration < max_iterations; ++iteration) {
+        size_t closest_edge = 0;
+        double min_distance = std::numeric_limits<double>::max();
+        vector2 closest_normal {};
+
+        for (size_t i = 0; i < polytope.size(); ++i) {
+            vector2 edge = polytope[(i + 1) % polytope.size()].w - polytope[i].w;
+            double length = edge.norm();
+            if (length == 0) {
+                continue;
+            }
+
+            // Outward normal of a counter-clockwise polytope
+            vector2 normal = vector2 { edge.y, -edge.x } / length;
+            double distance = normal * polytope[i].w;
+
+            if (distance < min_distance) {
+                min_distance = distance;
+                closest_edge = i;
+                closest_normal = normal;
+            }
+        }
+
+        const SupportPoint& edge_start = polytope[closest_edge];
+        SupportPoint point = support(a, b, closest_normal, edge_start.index_a, edge_start.index_b);
+        double growth = point.w * closest_normal - min_distance;
+
+        result.normal = closest_normal;
+        result.depth = min_distance;
+        result.valid = true;
+
+        if (growth < 1e-10 * (1 + min_distance)) {
+            break;
+        }
+
+        size_t k = closest_edge + 1;
+        polytope.insert(polytope.begin() + k, point);
+
+        // Drop neighbours left reflex or collinear by the new point to keep the polytope convex
+        while (polytope.size() > 3) {
+            size_t n = polytope.size();
+            size_t prev = (k + n - 1) % n;
+            size_t prev2 = (k + n - 2) % n;
+
+            if (cross2d(polytope[prev].w - polytope[prev2].w, point.w - polytope[prev].w) > 0) {
+                break;
+            }
+
+            polytope.erase(polytope.begin() + prev);
+            k = (prev < k) ? k - 1 : k;
+        }
+
+        while (polytope.size() > 3) {
+            size_t n = polytope.size();
+            size_t next = (k + 1) % n;
+            size_t next2 = (k + 2) % n;
+
+            if (cross2d(polytope[next].w - point.w, polytope[next2].w - polytope[next].w) > 0) {
+                break;
+            }
+
+            polytope.erase(polytope.begin() + next);
+            k = (next < k) ? k - 1 : k;
+        }
+    }
+
+    return result;
+}
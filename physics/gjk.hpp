@@ -0,0 +1,62 @@
+#ifndef GJK_HPP
+#define GJK_HPP
+
+#include <array>
+#include <vector>
+#include <cstddef>
+
+#include "vector2.hpp"
+#include "ConvexPolygon.hpp"
+
+
+struct SupportPoint
+{
+    /* Brief: Vertex of the Minkowski difference A - B, w = A[index_a] - B[index_b]. */
+    vector2 w {};
+    vector2 point_a {};
+    vector2 point_b {};
+    size_t index_a {};
+    size_t index_b {};
+};
+
+
+struct GjkCache
+{
+    /* Brief: Support indices of the last simplex. Passing the cache of a previous query on
+              the same pair warm starts GJK, which then usually terminates in one or two
+              iterations for slowly moving bodies. */
+    size_t count { 0 };
+    std::array<size_t, 3> index_a {};
+    std::array<size_t, 3> index_b {};
+};
+
+
+struct GjkResult
+{
+    bool overlap { false };
+    double distance {};
+
+    // Witness points, equal to each other when the cores overlap
+    vector2 closest_a {};
+    vector2 closest_b {};
+
+    size_t simplex_count {};
+    std::array<SupportPoint, 3> simplex {};
+    size_t iterations {};
+};
+
+
+struct EpaResult
+{
+    // Penetration direction from A towards B, translating A by -depth*normal separates the pair
+    vector2 normal {};
+    double depth {};
+    bool valid { false };
+};
+
+
+GjkResult gjk_distance(const ConvexProxy& a, const ConvexProxy& b, GjkCache* cache = nullptr);
+
+EpaResult epa_penetration(const ConvexProxy& a, const ConvexProxy& b, const GjkResult& gjk);
+
+#endif
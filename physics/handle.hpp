@@ -0,0 +1,172 @@
+#ifndef HANDLE_HPP
+#define HANDLE_HPP
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <stdexcept>
+
+#include "serialize.hpp"
+
+
+constexpr uint32_t G_INVALID_SLOT { UINT32_MAX };
+
+
+template <typename Tag>
+struct Handle
+{
+    /* Brief: Generational reference to an element of a SlotMap. The generation of a slot is
+              bumped whenever its element is removed, so handles to removed elements go stale
+              instead of silently referring to whatever reuses the slot. */
+    uint32_t slot { G_INVALID_SLOT };
+    uint32_t generation { 0 };
+
+    bool is_valid() const { return slot != G_INVALID_SLOT; }
+
+    friend bool operator==(const Handle&, const Handle&) = default;
+};
+
+
+struct BodyTag;
+struct ForceTag;
+struct ConstraintTag;
+struct ShapeTag;
+
+using BodyHandle       = Handle<BodyTag>;
+using ForceHandle      = Handle<ForceTag>;
+using ConstraintHandle = Handle<ConstraintTag>;
+using ShapeHandle      = Handle<ShapeTag>;
+
+
+template <typename Tag>
+class SlotMap
+{
+    /* Brief: Maps handles to indices into a dense array owned by the caller, which keeps both
+              in step: push_back() when appending an element, swap_remove() when removing one
+              and permute() when reordering. All lookups are O(1). */
+    private:
+        std::vector<uint32_t> m_slot_to_dense {};
+        std::vector<uint32_t> m_generations {};
+        std::vector<uint32_t> m_dense_to_slot {};
+        std::vector<uint32_t> m_free_slots {};
+
+    public:
+        size_t size() const { return m_dense_to_slot.size(); }
+
+        void reserve(size_t capacity)
+        {
+            m_dense_to_slot.reserve(capacity);
+            m_slot_to_dense.reserve(capacity);
+            m_generations.reserve(capacity);
+        }
+
+        Handle<Tag> push_back()
+        {
+            uint32_t slot {};
+            if (!m_free_slots.empty()) {
+                slot = m_free_slots.back();
+                m_free_slots.pop_back();
+            } else {
+                slot = static_cast<uint32_t>(m_slot_to_dense.size());
+                m_slot_to_dense.push_back(0);
+                m_generations.push_back(0);
+            }
+
+            // Live slots have odd generations, so a default constructed handle never matches
+            ++m_generations[slot];
+            m_slot_to_dense[slot] = static_cast<uint32_t>(m_dense_to_slot.size());
+            m_dense_to_slot.push_back(slot);
+
+            return Handle<Tag> { slot, m_generations[slot] };
+        }
+
+        bool contains(Handle<Tag> handle) const
+        {
+            return handle.slot < m_generations.size() && m_generations[handle.slot] == handle.generation &&
+                   (handle.generation & 1) == 1;
+        }
+
+        size_t index(Handle<Tag> handle) const
+        {
+            if (!contains(handle)) {
+                throw std::runtime_error("ERROR::SLOT_MAP::STALE_HANDLE");
+            }
+            return m_slot_to_dense[handle.slot];
+        }
+
+        Handle<Tag> handle(size_t index) const
+        {
+            uint32_t slot = m_dense_to_slot.at(index);
+            return Handle<Tag> { slot, m_generations[slot] };
+        }
+
+        size_t swap_remove(Handle<Tag> handle)
+        {
+            /* The last dense element moves into the hole left by the removed one, the caller 
+               mirrors this on its own array. Returns the index of the hole. */
+            size_t index = this->index(handle);
+            uint32_t last_slot = m_dense_to_slot.back();
+
+            m_dense_to_slot[index] = last_slot;
+            m_slot_to_dense[last_slot] = static_cast<uint32_t>(index);
+            m_dense_to_slot.pop_back();
+
+            ++m_generations[handle.slot];
+            m_free_slots.push_back(handle.slot);
+
+            return index;
+        }
+
+        void permute(const std::vector<size_t>& new_to_old)
+        {
+            // New dense element i is the old element new_to_old[i]
+            std::vector<uint32_t> dense_to_slot(m_dense_to_slot.size());
+
+            for (size_t i = 0; i < new_to_old.size(); ++i) {
+                dense_to_slot[i] = m_dense_to_slot[new_to_old[i]];
+                m_slot_to_dense[dense_to_slot[i]] = static_cast<uint32_t>(i);
+            }
+
+            m_dense_to_slot = std::move(dense_to_slot);
+        }
+
+        /* The whole mapping with generations and free list, so that handles taken before a
+           write resolve to the same elements after the read. */
+        void write(BinaryWriter& writer) const
+        {
+            writer.write_array(m_slot_to_dense);
+            writer.write_array(m_generations);
+            writer.write_array(m_dense_to_slot);
+            writer.write_array(m_free_slots);
+        }
+
+        void read(BinaryReader& reader)
+        {
+            reader.read_array(m_slot_to_dense);
+            reader.read_array(m_generations);
+            reader.read_array(m_dense_to_slot);
+            reader.read_array(m_free_slots);
+
+            if (m_generations.size() != m_slot_to_dense.size()) {
+                throw std::runtime_error("ERROR::SLOT_MAP::READ::INCONSISTENT_SLOTS");
+            }
+
+            for (size_t i = 0; i < m_dense_to_slot.size(); ++i) {
+                uint32_t slot = m_dense_to_slot[i];
+                if (slot >= m_slot_to_dense.size() || m_slot_to_dense[slot] != i) {
+                    throw std::runtime_error("ERROR::SLOT_MAP::READ::INCONSISTENT_SLOTS");
+                }
+            }
+        }
+
+        void clear()
+        {
+            for (uint32_t slot : m_dense_to_slot) {
+                ++m_generations[slot];
+                m_free_slots.push_back(slot);
+            }
+            m_dense_to_slot.clear();
+        }
+};
+
+#endif
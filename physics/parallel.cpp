@@ -0,0 +1,129 @@
+#include "parallel.hpp"
+
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <cstdint>
+#include <condition_variable>
+
+
+namespace {
+
+// Set on the pool workers and on a thread while it works on its own loop
+thread_local bool t_in_parallel_region { false };
+
+
+struct WorkerPool
+{
+    /* Brief: A loop is published under the mutex with a new generation, every worker then
+              claims tasks from a shared counter until none is left. The caller waits for all
+              workers to be done with the generation, so none of them still reads the loop
+              when the next one is published. */
+    std::mutex submit {};
+    std::mutex mutex {};
+    std::condition_variable wake {};
+    std::condition_variable done {};
+
+    void (*task)(void*, size_t) { nullptr };
+    void* context { nullptr };
+    size_t ntasks {};
+    std::atomic<size_t> next { 0 };
+
+    uint64_t generation {};
+    size_t busy {};
+
+    std::vector<std::thread> threads {};
+
+    explicit WorkerPool(size_t nworkers)
+    {
+        threads.reserve(nworkers);
+        for (size_t w = 0; w < nworkers; ++w) {
+            threads.emplace_back([this]() { work(); });
+        }
+    }
+
+    void drain()
+    {
+        for (size_t t = next.fetch_add(1); t < ntasks; t = next.fetch_add(1)) {
+            task(context, t);
+        }
+    }
+
+    void work()
+    {
+        t_in_parallel_region = true;
+
+#ifdef MECSIM_ENABLE_TRACING
+        // Workers never exit, so they keep their lane and recording never takes the lock
+        attach_trace_ring();
+#endif
+
+        uint64_t seen = 0;
+
+        while (true) {
+            {
+                std::unique_lock lock { mutex };
+                wake.wait(lock, [&]() { return generation != seen; });
+                seen = generation;
+            }
+
+            drain();
+
+            std::lock_guard lock { mutex };
+            if (--busy == 0) {
+                done.notify_one();
+            }
+        }
+    }
+
+    void run(size_t count, void (*function)(void*, size_t), void* data)
+    {
+        {
+            std::lock_guard lock { mutex };
+            task = function;
+            context = data;
+            ntasks = count;
+            next.store(0, std::memory_order_relaxed);
+            busy = threads.size();
+            ++generation;
+        }
+        wake.notify_all();
+
+        t_in_parallel_region = true;
+        drain();
+        t_in_parallel_region = false;
+
+        std::unique_lock lock { mutex };
+        done.wait(lock, [&]() { return busy == 0; });
+    }
+};
+
+
+WorkerPool& pool()
+{
+    // Never destroyed, workers sleep until the process ends instead of racing static destruction
+    static WorkerPool* instance = new WorkerPool(std::max<size_t>(1, std::thread::hardware_concurrency()) - 1);
+    return *instance;
+}
+
+}
+
+
+size_t parallel_concurrency()
+{
+    return t_in_parallel_region ? 1 : pool().threads.size() + 1;
+}
+
+
+bool run_parallel_tasks(size_t ntasks, void (*task)(void*, size_t), void* context)
+{
+    WorkerPool& p = pool();
+
+    std::unique_lock lock { p.submit, std::try_to_lock };
+    if (!lock.owns_lock()) {
+        return false;
+    }
+
+    p.run(ntasks, task, context);
+    return true;
+}
@@ -0,0 +1,76 @@
+#ifndef PARALLEL_HPP
+#define PARALLEL_HPP
+
+#include <vector>
+#include <cstddef>
+#include <exception>
+#include <algorithm>
+
+#include "tracing.hpp"
+
+
+/* Brief: Worker threads started once per process and kept until it ends, parallel_for hands
+          them its chunks instead of starting threads of its own. One loop runs on the pool
+          at a time and the calling thread works on it too. */
+
+// Threads a parallel_for started here runs on, 1 inside a chunk of another parallel_for
+size_t parallel_concurrency();
+
+/* Runs task(context, t) for every t in [0, ntasks) on the pool and the calling thread and
+   returns once all have finished, tasks must not throw. Returns false without running any
+   when the pool is busy with the loop of another thread. */
+bool run_parallel_tasks(size_t ntasks, void (*task)(void*, size_t), void* context);
+
+
+template <typename Function>
+void parallel_for(size_t begin, size_t end, Function&& function, size_t min_chunk = 64)
+{
+    /* Brief: Calls function(i) for every i in [begin, end), split into contiguous chunks over
+              the threads of the pool. Ranges too small to be worth a thread, and loops nested
+              in another parallel_for, run inline. The first exception thrown by any chunk is
+              rethrown once all of them have finished. */
+    size_t count = (end > begin) ? end - begin : 0;
+    size_t workers = std::min(parallel_concurrency(), count / std::max<size_t>(1, min_chunk));
+
+    if (workers <= 1) {
+        for (size_t i = begin; i < end; ++i) {
+            function(i);
+        }
+        return;
+    }
+
+    size_t chunk = (count + workers - 1) / workers;
+    std::vector<std::exception_ptr> errors(workers);
+
+    auto run_chunk = [&](size_t w)
+    {
+        MECSIM_TRACE_SCOPE("parallel_for chunk");
+
+        size_t first = begin + w * chunk;
+        size_t last  = std::min(end, first + chunk);
+
+        try {
+            for (size_t i = first; i < last; ++i) {
+                function(i);
+            }
+        } catch (...) {
+            errors[w] = std::current_exception();
+        }
+    };
+
+    auto task = [](void* context, size_t w) { (*static_cast<decltype(run_chunk)*>(context))(w); };
+
+    if (!run_parallel_tasks(workers, task, &run_chunk)) {
+        for (size_t w = 0; w < workers; ++w) {
+            run_chunk(w);
+        }
+    }
+
+    for (auto& error : errors) {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+}
+
+#endif
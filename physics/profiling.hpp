@@ -0,0 +1,198 @@
+#ifndef PROFILING_HPP
+#define PROFILING_HPP
+
+#include <array>
+#include <chrono>
+#include <string>
+#include <cstdint>
+#include <cstddef>
+#include <unordered_map>
+
+#include "tracing.hpp"
+
+
+enum ProfileStage
+{
+    STAGE_STEP,                 // whole System::step, inclusive
+    STAGE_INTEGRATION,          // ODE solver, without the force evaluations it triggers
+    STAGE_FORCES,               // compute_forces_and_torques
+    STAGE_COLLISION_DETECTION,  // every detect_collisions call, retries included
+    STAGE_CONTACT_RESOLUTION,
+    STAGE_CONSTRAINTS,
+    NUM_PROFILE_STAGES,
+};
+
+
+enum ProfileCounter
+{
+    COUNTER_BROADPHASE_PAIRS,
+    COUNTER_NARROWPHASE_HITS,
+    COUNTER_PENETRATION_RETRIES,
+    COUNTER_CG_ITERATIONS,
+    COUNTER_CONTACTS,
+    NUM_PROFILE_COUNTERS,
+};
+
+
+const std::unordered_map<ProfileStage, std::string> G_PROFILE_STAGE_STRINGS_MAP
+{
+    { STAGE_STEP,                "Step" },
+    { STAGE_INTEGRATION,         "Integration" },
+    { STAGE_FORCES,              "Forces" },
+    { STAGE_COLLISION_DETECTION, "Collision detection" },
+    { STAGE_CONTACT_RESOLUTION,  "Contact resolution" },
+    { STAGE_CONSTRAINTS,         "Constraints" },
+};
+
+
+const std::unordered_map<ProfileCounter, std::string> G_PROFILE_COUNTER_STRINGS_MAP
+{
+    { COUNTER_BROADPHASE_PAIRS,    "Broadphase pairs" },
+    { COUNTER_NARROWPHASE_HITS,    "Narrowphase hits" },
+    { COUNTER_PENETRATION_RETRIES, "Penetration retries" },
+    { COUNTER_CG_ITERATIONS,       "CG iterations" },
+    { COUNTER_CONTACTS,            "Contacts" },
+};
+
+
+struct StepStats
+{
+    /* Brief: Time per stage, exclusive of the nested stages except for STAGE_STEP, number of
+              times each stage ran, and event counters. */
+    std::array<double, NUM_PROFILE_STAGES> seconds {};
+    std::array<uint64_t, NUM_PROFILE_STAGES> calls {};
+    std::array<uint64_t, NUM_PROFILE_COUNTERS> counters {};
+
+    StepStats& operator+=(const StepStats& other)
+    {
+        for (size_t i = 0; i < NUM_PROFILE_STAGES; ++i) {
+            seconds[i] += other.seconds[i];
+            calls[i] += other.calls[i];
+        }
+        for (size_t i = 0; i < NUM_PROFILE_COUNTERS; ++i) {
+            counters[i] += other.counters[i];
+        }
+        return *this;
+    }
+};
+
+
+struct ProfileStats
+{
+    StepStats last_step {};
+    StepStats total {};
+    size_t steps {};
+};
+
+
+#ifdef MECSIM_ENABLE_PROFILING
+
+/* Stats of the step running on this thread, null outside System::step. Stages and counters
+   reached from worker threads or outside a step are not recorded. */
+inline thread_local StepStats* t_step_stats { nullptr };
+
+
+class StepProfileScope
+{
+    /* Brief: Makes a fresh StepStats current on this thread for the lifetime of the scope and
+              adds it to the totals at the end. Declared before the step timer, so that timer
+              still records into it. */
+    private:
+        ProfileStats& m_stats;
+        StepStats* m_outer { nullptr };
+
+    public:
+        explicit StepProfileScope(ProfileStats& stats) : m_stats(stats), m_outer(t_step_stats)
+        {
+            m_stats.last_step = {};
+            t_step_stats = &m_stats.last_step;
+        }
+
+        ~StepProfileScope()
+        {
+            t_step_stats = m_outer;
+            m_stats.total += m_stats.last_step;
+            ++m_stats.steps;
+        }
+
+        StepProfileScope(const StepProfileScope&) = delete;
+        StepProfileScope& operator=(const StepProfileScope&) = delete;
+};
+
+
+class ScopedStageTimer
+{
+    /* Brief: Adds the lifetime of the scope to a stage of the running step. Nested timers
+              report their time to the enclosing one, which subtracts it, so stage times are
+              exclusive and add up to the step time. */
+    private:
+        static inline thread_local ScopedStageTimer* s_innermost { nullptr };
+
+        ProfileStage m_stage {};
+        ScopedStageTimer* m_parent { nullptr };
+        double m_nested {};
+        std::chrono::steady_clock::time_point m_start {};
+
+    public:
+        explicit ScopedStageTimer(ProfileStage stage) : m_stage(stage)
+        {
+            if (t_step_stats == nullptr) {
+                return;
+            }
+
+            m_parent = s_innermost;
+            s_innermost = this;
+            m_start = std::chrono::steady_clock::now();
+        }
+
+        ~ScopedStageTimer()
+        {
+            if (t_step_stats == nullptr || s_innermost != this) {
+                return;
+            }
+
+            double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_start).count();
+            s_innermost = m_parent;
+
+            // The step is the root, its own time stays inclusive
+            bool inclusive = (m_stage == STAGE_STEP);
+            t_step_stats->seconds[m_stage] += inclusive ? elapsed : elapsed - m_nested;
+            t_step_stats->calls[m_stage] += 1;
+
+            if (m_parent != nullptr) {
+                m_parent->m_nested += elapsed;
+            }
+        }
+
+        ScopedStageTimer(const ScopedStageTimer&) = delete;
+        ScopedStageTimer& operator=(const ScopedStageTimer&) = delete;
+};
+
+
+inline void profile_count(ProfileCounter counter, uint64_t amount)
+{
+    if (t_step_stats != nullptr) {
+        t_step_stats->counters[counter] += amount;
+    }
+}
+
+#define MECSIM_PROFILE_CONCAT_IMPL(a, b) a##b
+#define MECSIM_PROFILE_CONCAT(a, b) MECSIM_PROFILE_CONCAT_IMPL(a, b)
+
+#define MECSIM_PROFILE_STEP(stats) StepProfileScope MECSIM_PROFILE_CONCAT(step_profile_, __LINE__) { stats }
+#define MECSIM_PROFILE_STAGE_TIMER(stage) ScopedStageTimer MECSIM_PROFILE_CONCAT(stage_timer_, __LINE__) { stage }
+#define MECSIM_PROFILE_COUNT(counter, amount) profile_count(counter, static_cast<uint64_t>(amount))
+
+#else
+
+#define MECSIM_PROFILE_STEP(stats) ((void)0)
+#define MECSIM_PROFILE_STAGE_TIMER(stage) ((void)0)
+#define MECSIM_PROFILE_COUNT(counter, amount) ((void)0)
+
+#endif
+
+// Stages also show up on the trace timeline when tracing is compiled in
+#define MECSIM_PROFILE_STAGE(stage) \
+    MECSIM_PROFILE_STAGE_TIMER(stage); MECSIM_TRACE_SCOPE(G_PROFILE_STAGE_STRINGS_MAP.at(stage).c_str())
+
+#endif
@@ -0,0 +1,634 @@
+#include "scene_file.hpp"
+
+#include <cmath>
+#include <cstdio>
+#include <charconv>
+#include <optional>
+#include <algorithm>
+
+
+namespace {
+
+const std::unordered_map<std::string_view, RigidBodyType> G_BODY_TYPE_NAMES
+{
+    { "dynamic",    DYNAMIC_BODY },
+    { "rotational", ROTATIONAL_ONLY },
+    { "static",     STATIC_BODY },
+};
+
+
+const std::unordered_map<std::string_view, OdeSolverType> G_SOLVER_NAMES
+{
+    { "forward-euler", FORWARD_EULER },
+    { "leapfrog",      LEAPFROG },
+    { "forest-ruth",   FOREST_RUTH },
+    { "yoshida4",      YOSHIDA4 },
+};
+
+
+const std::unordered_map<std::string_view, AccumulationMode> G_ACCUMULATION_NAMES
+{
+    { "serial",   SERIAL_ACCUMULATION },
+    { "coloured", COLOURED_ACCUMULATION },
+    { "buffered", BUFFERED_ACCUMULATION },
+};
+
+
+class SceneParser
+{
+    /* Brief: Single pass over the text, one directive per line. The tokens of a line are
+              views into the text, split into positional arguments and key=value pairs. */
+    private:
+        const std::unordered_map<std::string, double>& m_overrides;
+        std::unordered_map<std::string, double> m_variables {};
+        SceneDescription m_scene {};
+
+        size_t m_line {};
+        std::vector<std::string_view> m_arguments {};
+        std::vector<std::pair<std::string_view, std::string_view>> m_keys {};
+        std::vector<bool> m_keys_used {};
+
+        [[noreturn]] void fail(const std::string& what) const
+        {
+            throw std::runtime_error("ERROR::SCENE_PARSER::LINE_" + std::to_string(m_line) + "::" + what + "\n");
+        }
+
+        void tokenize(std::string_view line)
+        {
+            m_arguments.clear();
+            m_keys.clear();
+
+            size_t i = 0;
+            while (i < line.size()) {
+                while (i < line.size() && (line[i] == ' ' || line[i] == '\t' || line[i] == '\r')) {
+                    ++i;
+                }
+                if (i == line.size() || line[i] == '#') {
+                    break;
+                }
+
+                size_t begin = i;
+                while (i < line.size() && line[i] != ' ' && line[i] != '\t' && line[i] != '\r' && line[i] != '#') {
+                    ++i;
+                }
+
+                std::string_view token = line.substr(begin, i - begin);
+                size_t equal = token.find('=');
+
+                if (equal == std::string_view::npos) {
+                    m_arguments.push_back(token);
+                } else {
+                    m_keys.emplace_back(token.substr(0, equal), token.substr(equal + 1));
+                }
+            }
+
+            m_keys_used.assign(m_keys.size(), false);
+        }
+
+        void expect_arguments(size_t min, size_t max)
+        {
+            if (m_arguments.size() < min || m_arguments.size() > max) {
+                fail("WRONG_NUMBER_OF_ARGUMENTS_FOR_" + std::string(m_arguments[0]));
+            }
+        }
+
+        std::optional<std::string_view> key(std::string_view name)
+        {
+            for (size_t k = 0; k < m_keys.size(); ++k) {
+                if (m_keys[k].first == name) {
+                    m_keys_used[k] = true;
+                    return m_keys[k].second;
+                }
+            }
+            return std::nullopt;
+        }
+
+        void expect_keys_used() const
+        {
+            for (size_t k = 0; k < m_keys.size(); ++k) {
+                if (!m_keys_used[k]) {
+                    fail("UNKNOWN_KEY_" + std::string(m_keys[k].first));
+                }
+            }
+        }
+
+        double number(std::string_view token) const
+        {
+            if (!token.empty() && token[0] == '$') {
+                auto it = m_variables.find(std::string(token.substr(1)));
+                if (it == m_variables.end()) {
+                    fail("UNDEFINED_VARIABLE_" + std::string(token.substr(1)));
+                }
+                return it->second;
+            }
+
+            double value {};
+            auto [end, error] = std::from_chars(token.data(), token.data() + token.size(), value);
+
+            if (error != std::errc() || end != token.data() + token.size()) {
+                fail("INVALID_NUMBER_" + std::string(token));
+            }
+            return value;
+        }
+
+        size_t count(std::string_view token) const
+        {
+            double value = number(token);
+            if (value < 0 || value != std::floor(value)) {
+                fail("INVALID_COUNT_" + std::string(token));
+            }
+            return static_cast<size_t>(value);
+        }
+
+        double number_key(std::string_view name, double fallback)
+        {
+            auto value = key(name);
+            return value ? number(*value) : fallback;
+        }
+
+        uint32_t body(std::string_view token) const
+        {
+            if (!token.empty() && token[0] == '@') {
+                size_t index = count(token.substr(1));
+                if (index >= m_scene.bodies.size()) {
+                    fail("UNKNOWN_BODY_" + std::string(token));
+                }
+                return static_cast<uint32_t>(index);
+            }
+
+            auto it = m_scene.body_indices.find(std::string(token));
+            if (it == m_scene.body_indices.end()) {
+                fail("UNKNOWN_BODY_" + std::string(token));
+            }
+            return it->second;
+        }
+
+        AnchorType anchor(std::optional<std::string_view> token) const
+        {
+            if (!token) {
+                return OFFSET_0_ANGLE_0;
+            }
+
+            size_t index = count(*token);
+            if (index >= NUM_ANCHOR_TYPES) {
+                fail("INVALID_ANCHOR_" + std::string(*token));
+            }
+            return static_cast<AnchorType>(index);
+        }
+
+        template <typename Value>
+        Value lookup(const std::unordered_map<std::string_view, Value>& names, std::string_view token,
+                     const char* what) const
+        {
+            auto it = names.find(token);
+            if (it == names.end()) {
+                fail(std::string("UNKNOWN_") + what + "_" + std::string(token));
+            }
+            return it->second;
+        }
+
+        SceneBody body_template(RigidBodyType type, std::string_view shape)
+        {
+            // Parameters shared by every body a directive creates
+            auto it = m_scene.shape_indices.find(std::string(shape));
+            if (it == m_scene.shape_indices.end()) {
+                fail("UNKNOWN_SHAPE_" + std::string(shape));
+            }
+
+            SceneBody b;
+            b.shape = it->second;
+            b.type = type;
+            b.mass = number_key("mass", 1);
+            b.angle = number_key("angle", 0);
+            b.angular_velocity = number_key("omega", 0);
+            b.velocity = { number_key("vx", 0), number_key("vy", 0) };
+
+            if (auto mask = key("mask")) {
+                b.field_mask = static_cast<uint32_t>(count(*mask));
+            }
+
+            if (type != STATIC_BODY && b.mass <= 0) {
+                fail("NON_POSITIVE_MASS");
+            }
+            return b;
+        }
+
+        uint32_t push_body(const SceneBody& b)
+        {
+            m_scene.bodies.push_back(b);
+            return static_cast<uint32_t>(m_scene.bodies.size() - 1);
+        }
+
+        void parse_let()
+        {
+            expect_arguments(3, 3);
+            std::string name { m_arguments[1] };
+
+            // Variables of the caller win, so sweeps override the defaults of the file
+            if (!m_overrides.contains(name)) {
+                m_variables[name] = number(m_arguments[2]);
+            }
+        }
+
+        void parse_config()
+        {
+            expect_arguments(3, 3);
+            std::string_view name = m_arguments[1];
+            std::string_view value = m_arguments[2];
+            SystemConfig& config = m_scene.config;
+
+            if (name == "solver") {
+                config.ode_solver_type = lookup(G_SOLVER_NAMES, value, "SOLVER");
+                return;
+            }
+
+            double x = number(value);
+
+            if      (name == "time_step")        { config.time_step = x; }
+            else if (name == "gravity")          { config.gravitational_g = x; }
+            else if (name == "gravity_flag")     { config.global_gravity_flag = (x != 0); }
+            else if (name == "drag")             { config.viscous_drag_coef = x; }
+            else if (name == "drag_flag")        { config.global_viscous_drag_flag = (x != 0); }
+            else if (name == "penetration")      { config.penetration_threshhold = x; }
+            else if (name == "reorder_interval") { config.reorder_interval = count(value); }
+            else if (name == "deterministic")    { config.deterministic = (x != 0); }
+            else {
+                fail("UNKNOWN_CONFIG_" + std::string(name));
+            }
+
+            if (config.time_step <= 0 || config.viscous_drag_coef < 0 || config.penetration_threshhold <= 0) {
+                fail("INVALID_CONFIG_" + std::string(name));
+            }
+        }
+
+        void parse_shape()
+        {
+            if (m_arguments.size() < 4) {
+                fail("WRONG_NUMBER_OF_ARGUMENTS_FOR_shape");
+            }
+
+            std::string name { m_arguments[1] };
+            std::string_view kind = m_arguments[2];
+            ShapeDefinition shape;
+
+            if (kind == "circle") {
+                expect_arguments(4, 4);
+                shape = circle_shape(number(m_arguments[3]));
+            } else if (kind == "capsule") {
+                expect_arguments(5, 5);
+                shape = capsule_shape(number(m_arguments[3]), number(m_arguments[4]));
+            } else if (kind == "box") {
+                expect_arguments(5, 5);
+                double w = number(m_arguments[3]);
+                double h = number(m_arguments[4]);
+                shape = polygon_shape({ { -w/2, -h/2 }, { -w/2, h/2 }, { w/2, h/2 }, { w/2, -h/2 } });
+            } else if (kind == "polygon") {
+                if (m_arguments.size() < 9 || m_arguments.size() % 2 == 0) {
+                    fail("WRONG_NUMBER_OF_ARGUMENTS_FOR_shape");
+                }
+
+                std::vector<vector2> vertices;
+                for (size_t k = 3; k < m_arguments.size(); k += 2) {
+                    vertices.push_back({ number(m_arguments[k]), number(m_arguments[k + 1]) });
+                }
+                shape = polygon_shape(std::move(vertices));
+            } else {
+                fail("UNKNOWN_SHAPE_KIND_" + std::string(kind));
+            }
+
+            if (!m_scene.shape_indices.try_emplace(name, static_cast<uint32_t>(m_scene.shapes.size())).second) {
+                fail("DUPLICATE_SHAPE_" + name);
+            }
+            m_scene.shapes.push_back(std::move(shape));
+        }
+
+        void parse_body()
+        {
+            expect_arguments(5, 5);
+            SceneBody b = body_template(lookup(G_BODY_TYPE_NAMES, m_arguments[1], "BODY_TYPE"), m_arguments[2]);
+            b.position = { number(m_arguments[3]), number(m_arguments[4]) };
+
+            uint32_t index = push_body(b);
+
+            if (auto name = key("name")) {
+                if (!m_scene.body_indices.try_emplace(std::string(*name), index).second) {
+                    fail("DUPLICATE_BODY_" + std::string(*name));
+                }
+                m_scene.body_names.emplace_back(index, std::string(*name));
+            }
+        }
+
+        void parse_grid()
+        {
+            expect_arguments(9, 9);
+            SceneBody b = body_template(lookup(G_BODY_TYPE_NAMES, m_arguments[1], "BODY_TYPE"), m_arguments[2]);
+
+            vector2 origin { number(m_arguments[3]), number(m_arguments[4]) };
+            size_t columns = count(m_arguments[5]);
+            size_t rows = count(m_arguments[6]);
+            vector2 spacing { number(m_arguments[7]), number(m_arguments[8]) };
+
+            m_scene.bodies.reserve(m_scene.bodies.size() + columns * rows);
+
+            for (size_t row = 0; row < rows; ++row) {
+                for (size_t column = 0; column < columns; ++column) {
+                    b.position = { origin.x + spacing.x * static_cast<double>(column),
+                                   origin.y + spacing.y * static_cast<double>(row) };
+                    push_body(b);
+                }
+            }
+        }
+
+        void parse_pile()
+        {
+            expect_arguments(7, 7);
+            SceneBody b = body_template(DYNAMIC_BODY, m_arguments[1]);
+
+            size_t n = count(m_arguments[2]);
+            vector2 origin { number(m_arguments[3]), number(m_arguments[4]) };
+            double width = number(m_arguments[5]);
+            double spacing = number(m_arguments[6]);
+
+            if (spacing <= 0) {
+                fail("NON_POSITIVE_SPACING");
+            }
+
+            auto columns = std::max<size_t>(1, static_cast<size_t>(width / spacing));
+            m_scene.bodies.reserve(m_scene.bodies.size() + n);
+
+            // The shift keeps bodies from landing exactly on top of each other
+            for (size_t i = 0; i < n; ++i) {
+                size_t row = i / columns;
+                size_t column = i % columns;
+
+                b.position = { origin.x + spacing * (static_cast<double>(column) + 0.1 * static_cast<double>(row % 2)),
+                               origin.y + spacing * static_cast<double>(row) };
+                push_body(b);
+            }
+        }
+
+        void parse_chain()
+        {
+            expect_arguments(8, 8);
+            SceneBody b = body_template(DYNAMIC_BODY, m_arguments[1]);
+
+            size_t n = count(m_arguments[2]);
+            vector2 origin { number(m_arguments[3]), number(m_arguments[4]) };
+            vector2 step { number(m_arguments[5]), number(m_arguments[6]) };
+            double stiffness = number(m_arguments[7]);
+            double length = step.norm();
+
+            std::optional<uint32_t> previous {};
+            if (auto anchor = key("anchor")) {
+                previous = body(*anchor);
+            }
+
+            if (stiffness <= 0) {
+                fail("NON_POSITIVE_STIFFNESS");
+            }
+
+            m_scene.bodies.reserve(m_scene.bodies.size() + n);
+
+            for (size_t i = 0; i < n; ++i) {
+                b.position = { origin.x + step.x * static_cast<double>(i), origin.y + step.y * static_cast<double>(i) };
+                uint32_t index = push_body(b);
+
+                if (previous) {
+                    // The anchor is wherever it is, the first spring starts at rest as well
+                    vector2 delta = b.position - m_scene.bodies[*previous].position;
+                    double rest = (i == 0) ? delta.norm() : length;
+                    m_scene.springs.push_back({ *previous, index, OFFSET_0_ANGLE_0, OFFSET_0_ANGLE_0, stiffness, rest });
+                }
+                previous = index;
+            }
+        }
+
+        void parse_spring()
+        {
+            expect_arguments(5, 5);
+
+            SceneSpring spring;
+            spring.body_a = body(m_arguments[1]);
+            spring.body_b = body(m_arguments[2]);
+            spring.stiffness = number(m_arguments[3]);
+            spring.length = number(m_arguments[4]);
+            spring.anchor_a = anchor(key("anchor_a"));
+            spring.anchor_b = anchor(key("anchor_b"));
+
+            if (spring.stiffness <= 0 || spring.length < 0) {
+                fail("INVALID_SPRING");
+            }
+            m_scene.springs.push_back(spring);
+        }
+
+        void parse_network()
+        {
+            expect_arguments(1, 2);
+            m_scene.networks.push_back((m_arguments.size() == 2) ?
+                                       lookup(G_ACCUMULATION_NAMES, m_arguments[1], "ACCUMULATION_MODE") :
+                                       SERIAL_ACCUMULATION);
+        }
+
+        void parse_link()
+        {
+            expect_arguments(5, 6);
+            if (m_scene.networks.empty()) {
+                fail("LINK_OUTSIDE_NETWORK");
+            }
+
+            SceneLink link;
+            link.network = static_cast<uint32_t>(m_scene.networks.size() - 1);
+            link.body_a = body(m_arguments[1]);
+            link.body_b = body(m_arguments[2]);
+            link.rest_length = number(m_arguments[3]);
+            link.stiffness = number(m_arguments[4]);
+            link.damping = (m_arguments.size() == 6) ? number(m_arguments[5]) : 0;
+
+            if (link.body_a == link.body_b || link.rest_length < 0 || link.stiffness <= 0) {
+                fail("INVALID_LINK");
+            }
+            m_scene.links.push_back(link);
+        }
+
+        void parse_field()
+        {
+            if (m_arguments.size() < 2) {
+                fail("WRONG_NUMBER_OF_ARGUMENTS_FOR_field");
+            }
+
+            std::string_view kind = m_arguments[1];
+            SceneField field;
+
+            if (kind == "gravity") {
+                expect_arguments(3, 3);
+                field = { GRAVITY_FIELD, FIELD_GRAVITY, {}, number(m_arguments[2]), 0 };
+            } else if (kind == "uniform") {
+                expect_arguments(4, 4);
+                field = { UNIFORM_FIELD, FIELD_UNIFORM, { number(m_arguments[2]), number(m_arguments[3]) }, 0, 0 };
+            } else if (kind == "drag") {
+                expect_arguments(3, 3);
+                field = { VISCOUS_DRAG_FIELD, FIELD_DRAG, {}, number(m_arguments[2]), 0 };
+            } else if (kind == "wind") {
+                expect_arguments(5, 5);
+                field = { WIND_FIELD, FIELD_WIND, { number(m_arguments[2]), number(m_arguments[3]) }, number(m_arguments[4]), 0 };
+            } else if (kind == "radial") {
+                expect_arguments(6, 6);
+                field = { RADIAL_FIELD, FIELD_RADIAL, { number(m_arguments[2]), number(m_arguments[3]) },
+                          number(m_arguments[4]), number(m_arguments[5]) };
+            } else {
+                fail("UNKNOWN_FIELD_" + std::string(kind));
+            }
+
+            if (kind == "uniform" || kind == "wind" || kind == "radial") {
+                if (auto mask = key("mask")) {
+                    field.mask = static_cast<uint32_t>(count(*mask));
+                }
+            }
+
+            if (((kind == "drag" || kind == "wind") && field.scalar < 0) || (kind == "radial" && field.softening <= 0)) {
+                fail("INVALID_FIELD_" + std::string(kind));
+            }
+            m_scene.fields.push_back(field);
+        }
+
+    public:
+        explicit SceneParser(const std::unordered_map<std::string, double>& overrides) :
+        m_overrides(overrides), m_variables(overrides.begin(), overrides.end()) {}
+
+        SceneDescription parse(std::string_view text)
+        {
+            size_t begin = 0;
+
+            while (begin < text.size()) {
+                size_t end = text.find('\n', begin);
+                if (end == std::string_view::npos) {
+                    end = text.size();
+                }
+
+                ++m_line;
+                tokenize(text.substr(begin, end - begin));
+                begin = end + 1;
+
+                if (m_arguments.empty()) {
+                    if (!m_keys.empty()) {
+                        fail("MISSING_DIRECTIVE");
+                    }
+                    continue;
+                }
+
+                std::string_view directive = m_arguments[0];
+
+                if      (directive == "let")     { parse_let(); }
+                else if (directive == "config")  { parse_config(); }
+                else if (directive == "shape")   { parse_shape(); }
+                else if (directive == "body")    { parse_body(); }
+                else if (directive == "grid")    { parse_grid(); }
+                else if (directive == "pile")    { parse_pile(); }
+                else if (directive == "chain")   { parse_chain(); }
+                else if (directive == "spring")  { parse_spring(); }
+                else if (directive == "network") { parse_network(); }
+                else if (directive == "link")    { parse_link(); }
+                else if (directive == "field")   { parse_field(); }
+                else {
+                    fail("UNKNOWN_DIRECTIVE_" + std::string(directive));
+                }
+
+                expect_keys_used();
+            }
+
+            return std::move(m_scene);
+        }
+};
+
+}
+
+
+SceneDescription parse_scene(std::string_view text, const std::unordered_map<std::string, double>& variables)
+{
+    return SceneParser(variables).parse(text);
+}
+
+
+SceneDescription read_scene_file(const std::string& path, const std::unordered_map<std::string, double>& variables)
+{
+    std::FILE* file = std::fopen(path.c_str(), "rb");
+    if (file == nullptr) {
+        throw std::runtime_error("ERROR::SCENE_PARSER::CANNOT_OPEN_" + path + "\n");
+    }
+
+    std::string text;
+    char buffer[1 << 16];
+    size_t read = 0;
+
+    while ((read = std::fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        text.append(buffer, read);
+    }
+    std::fclose(file);
+
+    return parse_scene(text, variables);
+}
+
+
+std::vector<BodyHandle> load_scene(System& system, const SceneDescription& scene, bool parallel)
+{
+    std::vector<BodyDescriptor> descriptors(scene.bodies.size());
+
+    for (size_t i = 0; i < scene.bodies.size(); ++i) {
+        const SceneBody& b = scene.bodies[i];
+        descriptors[i] = BodyDescriptor { &scene.shapes[b.shape], {}, b.type, b.mass, b.angle, b.angular_velocity,
+                                          b.position, b.velocity };
+    }
+
+    std::vector<BodyHandle> handles = system.add_bodies(descriptors, parallel);
+
+    std::vector<RigidBody*> bodies(handles.size());
+    for (size_t i = 0; i < handles.size(); ++i) {
+        bodies[i] = system.get_rigid_body(handles[i]);
+
+        if (scene.bodies[i].field_mask != ALL_FIELDS) {
+            bodies[i]->set_field_mask(scene.bodies[i].field_mask);
+        }
+    }
+
+    for (auto& [index, name] : scene.body_names) {
+        bodies[index]->set_name(name);
+    }
+
+    for (auto& s : scene.springs) {
+        system.add_spring_connector(bodies[s.body_a], bodies[s.body_b], s.anchor_a, s.anchor_b, s.stiffness, s.length);
+    }
+
+    std::vector<SpringNetwork*> networks;
+    for (AccumulationMode mode : scene.networks) {
+        networks.push_back(system.add_spring_network(mode));
+    }
+
+    for (auto& l : scene.links) {
+        networks[l.network]->add_spring(bodies[l.body_a], bodies[l.body_b], vector2 { 0, 0 }, vector2 { 0, 0 },
+                                        l.rest_length, l.stiffness, l.damping);
+    }
+
+    for (auto& f : scene.fields) {
+        switch (f.type) {
+            case GRAVITY_FIELD:
+                system.add_field(std::make_unique<GravityField>(f.scalar));
+                break;
+            case UNIFORM_FIELD:
+                system.add_field(std::make_unique<UniformField>(f.vector, f.mask));
+                break;
+            case VISCOUS_DRAG_FIELD:
+                system.add_field(std::make_unique<ViscousDragField>(f.scalar));
+                break;
+            case WIND_FIELD:
+                system.add_field(std::make_unique<WindField>(f.vector, f.scalar, f.mask));
+                break;
+            case RADIAL_FIELD:
+                system.add_field(std::make_unique<RadialField>(f.vector, f.scalar, f.softening, f.mask));
+                break;
+            default:
+                throw std::runtime_error("ERROR::LOAD_SCENE::UNKNOWN_FIELD_TYPE\n");
+        }
+    }
+
+    return handles;
+}
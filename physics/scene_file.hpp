@@ -0,0 +1,126 @@
+#ifndef SCENE_FILE_HPP
+#define SCENE_FILE_HPP
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <string_view>
+#include <unordered_map>
+
+#include "System.hpp"
+
+
+/* Scene files describe a System line by line, blank separated, # starts a comment. Numbers
+   may be written as $NAME to use a variable. Bodies are referred to by name or as @INDEX,
+   their position in the file. Optional parameters are given as key=value.
+
+     let NAME VALUE                       variable, unless the caller already defined it
+     config KEY VALUE                     time_step, gravity, gravity_flag, drag, drag_flag,
+                                          penetration, reorder_interval, deterministic, solver
+                                          (forward-euler, leapfrog, forest-ruth, yoshida4)
+     shape NAME circle RADIUS
+     shape NAME capsule LENGTH RADIUS
+     shape NAME box WIDTH HEIGHT
+     shape NAME polygon X1 Y1 X2 Y2 X3 Y3 ...
+     body TYPE SHAPE X Y                  TYPE is dynamic, rotational or static, keys mass,
+                                          angle, omega, vx, vy, mask and name
+     grid TYPE SHAPE X0 Y0 COLUMNS ROWS DX DY
+                                          lattice of bodies, row by row, body keys but name
+     pile SHAPE COUNT X0 Y0 WIDTH SPACING
+                                          dynamic bodies in rows of WIDTH/SPACING from the
+                                          lower left corner up, every other row shifted by a
+                                          tenth of the spacing, body keys but name
+     chain SHAPE COUNT X0 Y0 DX DY STIFFNESS
+                                          dynamic bodies joined in a row by spring connectors
+                                          at rest, key anchor=BODY hangs the first one from a
+                                          body, body keys but name
+     spring A B STIFFNESS LENGTH          spring connector, keys anchor_a and anchor_b
+     network MODE                         spring network, serial, coloured or buffered, the
+                                          links that follow go into it
+     link A B REST STIFFNESS [DAMPING]    spring of the last network between the centres
+     field gravity G
+     field uniform AX AY                  keys mask
+     field drag COEFFICIENT
+     field wind VX VY COEFFICIENT         keys mask
+     field radial X Y STRENGTH SOFTENING  keys mask
+
+   Constraints are not part of the format. */
+
+
+struct SceneBody
+{
+    uint32_t shape {};
+    RigidBodyType type { DYNAMIC_BODY };
+    double mass { 1 };
+    double angle {};
+    double angular_velocity {};
+    vector2 position {};
+    vector2 velocity {};
+    uint32_t field_mask { ALL_FIELDS };
+};
+
+
+struct SceneSpring
+{
+    uint32_t body_a {};
+    uint32_t body_b {};
+    AnchorType anchor_a { OFFSET_0_ANGLE_0 };
+    AnchorType anchor_b { OFFSET_0_ANGLE_0 };
+    double stiffness {};
+    double length {};
+};
+
+
+struct SceneLink
+{
+    uint32_t network {};
+    uint32_t body_a {};
+    uint32_t body_b {};
+    double rest_length {};
+    double stiffness {};
+    double damping {};
+};
+
+
+struct SceneField
+{
+    ForceFieldType type {};
+    uint32_t mask {};
+    vector2 vector {};      // acceleration, flow velocity or centre
+    double scalar {};       // g, drag coefficient or strength
+    double softening {};
+};
+
+
+struct SceneDescription
+{
+    /* Brief: Parsed scene, loaded into a System by load_scene(). The configuration is not
+              applied by the loader, build the System from it. Bodies refer to shapes and
+              springs to bodies by index. */
+    SystemConfig config {};
+
+    std::vector<ShapeDefinition> shapes {};
+    std::unordered_map<std::string, uint32_t> shape_indices {};
+
+    std::vector<SceneBody> bodies {};
+    std::vector<std::pair<uint32_t, std::string>> body_names {};
+    std::unordered_map<std::string, uint32_t> body_indices {};
+
+    std::vector<SceneSpring> springs {};
+    std::vector<AccumulationMode> networks {};
+    std::vector<SceneLink> links {};
+    std::vector<SceneField> fields {};
+};
+
+
+/* Variables passed in override the let lines of the scene, so one file serves a whole
+   parameter sweep. Errors name the offending line. */
+SceneDescription parse_scene(std::string_view text, const std::unordered_map<std::string, double>& variables = {});
+SceneDescription read_scene_file(const std::string& path, const std::unordered_map<std::string, double>& variables = {});
+
+/* Adds the bodies in one batch, then the springs, networks and fields. Returns the handles
+   of the bodies in scene order. */
+std::vector<BodyHandle> load_scene(System& system, const SceneDescription& scene, bool parallel = false);
+
+#endif
@@ -0,0 +1,124 @@
+#ifndef SERIALIZE_HPP
+#define SERIALIZE_HPP
+
+#include <span>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+#include <type_traits>
+
+
+class BinaryWriter
+{
+    /* Brief: Appends trivially copyable values, and arrays of them as one block, to a byte
+              buffer in native byte order. Arrays are prefixed by their length. */
+    private:
+        std::vector<char> m_data {};
+
+    public:
+        std::vector<char>& data() { return m_data; }
+        size_t size() const { return m_data.size(); }
+
+        void reserve(size_t bytes) { m_data.reserve(bytes); }
+
+        void write_bytes(const void* bytes, size_t count)
+        {
+            size_t offset = m_data.size();
+            m_data.resize(offset + count);
+            if (count > 0) {
+                std::memcpy(m_data.data() + offset, bytes, count);
+            }
+        }
+
+        template <typename T>
+        void write(const T& value)
+        {
+            static_assert(std::is_trivially_copyable_v<T>);
+            write_bytes(&value, sizeof(T));
+        }
+
+        template <typename T>
+        void write_array(std::span<const T> values)
+        {
+            static_assert(std::is_trivially_copyable_v<T>);
+            write<uint64_t>(values.size());
+            write_bytes(values.data(), values.size_bytes());
+        }
+
+        template <typename T>
+        void write_array(const std::vector<T>& values) { write_array(std::span<const T>(values)); }
+
+        void write_string(const std::string& text)
+        {
+            write_array(std::span<const char>(text.data(), text.size()));
+        }
+};
+
+
+class BinaryReader
+{
+    /* Brief: Reads back what a BinaryWriter wrote, in the same order. Throws instead of
+              reading past the end, so a truncated or corrupt buffer fails cleanly. */
+    private:
+        std::span<const char> m_data {};
+        size_t m_offset {};
+
+    public:
+        explicit BinaryReader(std::span<const char> data) : m_data(data) {}
+
+        size_t remaining() const { return m_data.size() - m_offset; }
+
+        void read_bytes(void* bytes, size_t count)
+        {
+            if (count > remaining()) {
+                throw std::runtime_error("ERROR::BINARY_READER::TRUNCATED_DATA\n");
+            }
+            if (count > 0) {
+                std::memcpy(bytes, m_data.data() + m_offset, count);
+            }
+            m_offset += count;
+        }
+
+        template <typename T>
+        T read()
+        {
+            static_assert(std::is_trivially_copyable_v<T>);
+            T value;
+            read_bytes(&value, sizeof(T));
+            return value;
+        }
+
+        template <typename T>
+        void read_array(std::vector<T>& values)
+        {
+            static_assert(std::is_trivially_copyable_v<T>);
+            auto count = read<uint64_t>();
+
+            // Checked before resizing so a corrupt length cannot allocate without bound
+            if (count > remaining() / sizeof(T)) {
+                throw std::runtime_error("ERROR::BINARY_READER::TRUNCATED_DATA\n");
+            }
+
+            values.resize(count);
+            read_bytes(values.data(), count * sizeof(T));
+        }
+
+        template <typename T>
+        std::vector<T> read_array()
+        {
+            std::vector<T> values;
+            read_array(values);
+            return values;
+        }
+
+        std::string read_string()
+        {
+            std::vector<char> text = read_array<char>();
+            return std::string(text.begin(), text.end());
+        }
+};
+
+#endif
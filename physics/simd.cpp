@@ -0,0 +1,119 @@
+#include "simd.hpp"
+
+#include <cfloat>
+#include <cmath>
+#include <algorithm>
+
+#if defined(__AVX2__) && defined(__FMA__)
+#include <immintrin.h>
+#endif
+
+
+double max_plane_distance(const PlaneArrays<double>& planes, const vector2& point, size_t& index)
+{
+    size_t n = planes.size();
+    index = 0;
+
+#if defined(__AVX2__) && defined(__FMA__)
+    /* Four planes per register, every lane keeps its own running maximum and plane index.
+       Ties go to the lower index as in the scalar loop. */
+    __m256d px = _mm256_set1_pd(point.x);
+    __m256d py = _mm256_set1_pd(point.y);
+
+    __m256d best = _mm256_set1_pd(-DBL_MAX);
+    __m256d best_index = _mm256_setzero_pd();
+    __m256d lane_index = _mm256_setr_pd(0, 1, 2, 3);
+    const __m256d step = _mm256_set1_pd(4);
+
+    for (size_t i = 0; i < n; i += 4) {
+        __m256d nx = _mm256_loadu_pd(planes.nx.data() + i);
+        __m256d ny = _mm256_loadu_pd(planes.ny.data() + i);
+        __m256d offset = _mm256_loadu_pd(planes.offset.data() + i);
+
+        __m256d distance = _mm256_sub_pd(_mm256_fmadd_pd(nx, px, _mm256_mul_pd(ny, py)), offset);
+        __m256d greater = _mm256_cmp_pd(distance, best, _CMP_GT_OQ);
+
+        best = _mm256_blendv_pd(best, distance, greater);
+        best_index = _mm256_blendv_pd(best_index, lane_index, greater);
+        lane_index = _mm256_add_pd(lane_index, step);
+    }
+
+    alignas(32) double lanes[4];
+    alignas(32) double lane_indices[4];
+    _mm256_store_pd(lanes, best);
+    _mm256_store_pd(lane_indices, best_index);
+
+    double max = lanes[0];
+    double max_index = lane_indices[0];
+    for (size_t k = 1; k < 4; ++k) {
+        if (lanes[k] > max || (lanes[k] == max && lane_indices[k] < max_index)) {
+            max = lanes[k];
+            max_index = lane_indices[k];
+        }
+    }
+
+    index = static_cast<size_t>(max_index);
+    return max;
+#else
+    double max = -DBL_MAX;
+
+    for (size_t i = 0; i < n; ++i) {
+        double distance = planes.nx[i] * point.x + planes.ny[i] * point.y - planes.offset[i];
+        if (distance > max) {
+            max = distance;
+            index = i;
+        }
+    }
+
+    return max;
+#endif
+}
+
+
+void accumulate_linear_field(const double* mass, const double* vx, const double* vy, 
+                             const uint32_t* flags, double* fx, double* fy, size_t count, 
+                             uint32_t mask, const vector2& acceleration, double drag, const vector2& flow)
+{
+    size_t i = 0;
+
+#if defined(__AVX2__) && defined(__FMA__)
+    /* Four bodies per register, the flag test becomes a lane mask that zeroes the force of
+       bodies outside the field instead of branching on them. */
+    __m256d ax = _mm256_set1_pd(acceleration.x);
+    __m256d ay = _mm256_set1_pd(acceleration.y);
+    __m256d c  = _mm256_set1_pd(drag);
+    __m256d wx = _mm256_set1_pd(drag * flow.x);
+    __m256d wy = _mm256_set1_pd(drag * flow.y);
+    __m128i field = _mm_set1_epi32(static_cast<int>(mask));
+
+    for (; i + 4 <= count; i += 4) {
+        __m128i bits = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(flags + i)), field);
+        __m256d outside = _mm256_castsi256_pd(_mm256_cvtepi32_epi64(_mm_cmpeq_epi32(bits, _mm_setzero_si128())));
+
+        __m256d m = _mm256_loadu_pd(mass + i);
+        __m256d gx = _mm256_fmadd_pd(m, ax, _mm256_fnmadd_pd(c, _mm256_loadu_pd(vx + i), wx));
+        __m256d gy = _mm256_fmadd_pd(m, ay, _mm256_fnmadd_pd(c, _mm256_loadu_pd(vy + i), wy));
+
+        _mm256_storeu_pd(fx + i, _mm256_add_pd(_mm256_loadu_pd(fx + i), _mm256_andnot_pd(outside, gx)));
+        _mm256_storeu_pd(fy + i, _mm256_add_pd(_mm256_loadu_pd(fy + i), _mm256_andnot_pd(outside, gy)));
+    }
+#endif
+
+#if defined(__AVX2__) && defined(__FMA__)
+    /* Same fused operations as the lanes above, a body rounds alike in the tail and in a
+       register, whatever its position in the storage. */
+    for (; i < count; ++i) {
+        double gx = std::fma(mass[i], acceleration.x, std::fma(-drag, vx[i], drag * flow.x));
+        double gy = std::fma(mass[i], acceleration.y, std::fma(-drag, vy[i], drag * flow.y));
+        fx[i] += (flags[i] & mask) ? gx : 0.0;
+        fy[i] += (flags[i] & mask) ? gy : 0.0;
+    }
+#else
+    // Branch free so the compiler can vectorise it for other targets
+    for (; i < count; ++i) {
+        double inside = (flags[i] & mask) ? 1.0 : 0.0;
+        fx[i] += inside * (mass[i] * acceleration.x + drag * (flow.x - vx[i]));
+        fy[i] += inside * (mass[i] * acceleration.y + drag * (flow.y - vy[i]));
+    }
+#endif
+}
@@ -0,0 +1,37 @@
+#ifndef SIMD_HPP
+#define SIMD_HPP
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#include "vector2.hpp"
+
+
+// Plane arrays are padded to a multiple of the widest vector, two AVX2 registers of doubles
+constexpr size_t G_SIMD_PADDING { 8 };
+
+
+template <typename T>
+struct PlaneArrays
+{
+    /* Brief: Face planes n*x = offset stored as separate component arrays. The padding planes
+              have a zero normal and the largest offset, no point is ever in front of them. */
+    std::vector<T> nx {};
+    std::vector<T> ny {};
+    std::vector<T> offset {};
+
+    size_t size() const { return nx.size(); }
+};
+
+
+/* Brief: Largest signed distance of point from the planes and the index of that plane. */
+double max_plane_distance(const PlaneArrays<double>& planes, const vector2& point, size_t& index);
+
+/* Brief: Adds mass*acceleration + drag*(flow - velocity) to the force of every body whose 
+          flags share a bit with mask, the others are left untouched. */
+void accumulate_linear_field(const double* mass, const double* vx, const double* vy, 
+                             const uint32_t* flags, double* fx, double* fy, size_t count, 
+                             uint32_t mask, const vector2& acceleration, double drag, const vector2& flow);
+
+#endif
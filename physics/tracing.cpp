@@ -0,0 +1,204 @@
+#include "tracing.hpp"
+
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <vector>
+#include <stdexcept>
+#include <algorithm>
+
+
+namespace {
+
+struct TraceEvent
+{
+    const char* name {};
+    uint64_t begin {};
+    uint64_t end {};
+};
+
+
+struct TraceRing
+{
+    /* Brief: Single producer ring, only the owning thread writes. The head counts all events
+              ever recorded, the slot of an event is its count modulo the capacity. */
+    std::vector<TraceEvent> events {};
+    std::atomic<uint64_t> head { 0 };
+    uint32_t lane {};
+};
+
+
+struct TraceRegistry
+{
+    std::mutex mutex {};
+    std::vector<std::unique_ptr<TraceRing>> rings {};
+    std::vector<TraceRing*> free_rings {};
+
+    std::atomic<bool> active { false };
+    size_t capacity { G_TRACE_BUFFER_EVENTS };
+    std::chrono::steady_clock::time_point origin { std::chrono::steady_clock::now() };
+
+    TraceRing* acquire()
+    {
+        std::lock_guard lock { mutex };
+        return acquire_locked();
+    }
+
+    TraceRing* acquire_locked()
+    {
+        if (!free_rings.empty()) {
+            TraceRing* ring = free_rings.back();
+            free_rings.pop_back();
+            return ring;
+        }
+
+        rings.push_back(std::make_unique<TraceRing>());
+        rings.back()->events.resize(capacity);
+        rings.back()->lane = static_cast<uint32_t>(rings.size() - 1);
+        return rings.back().get();
+    }
+
+    void release(TraceRing* ring)
+    {
+        std::lock_guard lock { mutex };
+        free_rings.push_back(ring);
+    }
+};
+
+
+TraceRegistry& registry()
+{
+    static TraceRegistry instance;
+    return instance;
+}
+
+
+struct RingLease
+{
+    /* Brief: Ring of the calling thread, taken on its first event or by attach_trace_ring() and
+              handed back when the thread exits. */
+    TraceRing* ring { nullptr };
+
+    ~RingLease()
+    {
+        if (ring != nullptr) {
+            registry().release(ring);
+        }
+    }
+};
+
+
+thread_local RingLease t_lease {};
+
+}
+
+
+void start_tracing(size_t events_per_thread)
+{
+    // Rounded up to a power of two so the slot is a mask of the head
+    size_t capacity = 1;
+    while (capacity < std::max<size_t>(1, events_per_thread)) {
+        capacity *= 2;
+    }
+
+    TraceRegistry& r = registry();
+    std::lock_guard lock { r.mutex };
+
+    r.capacity = capacity;
+    for (auto& ring : r.rings) {
+        ring->events.assign(capacity, {});
+        ring->head.store(0, std::memory_order_relaxed);
+    }
+
+    if (t_lease.ring == nullptr) {
+        t_lease.ring = r.acquire_locked();
+    }
+
+    r.origin = std::chrono::steady_clock::now();
+    r.active.store(true, std::memory_order_release);
+}
+
+
+void attach_trace_ring()
+{
+    if (t_lease.ring == nullptr) {
+        t_lease.ring = registry().acquire();
+    }
+}
+
+
+void stop_tracing()
+{
+    registry().active.store(false, std::memory_order_release);
+}
+
+
+bool tracing_active()
+{
+    return registry().active.load(std::memory_order_relaxed);
+}
+
+
+uint64_t trace_clock()
+{
+    auto elapsed = std::chrono::steady_clock::now() - registry().origin;
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+}
+
+
+void record_trace_event(const char* name, uint64_t begin, uint64_t end)
+{
+    attach_trace_ring();
+
+    TraceRing& ring = *t_lease.ring;
+    uint64_t head = ring.head.load(std::memory_order_relaxed);
+
+    ring.events[head & (ring.events.size() - 1)] = { name, begin, end };
+    ring.head.store(head + 1, std::memory_order_release);
+}
+
+
+size_t write_chrome_trace(const std::string& path)
+{
+    TraceRegistry& r = registry();
+    std::lock_guard lock { r.mutex };
+
+    std::FILE* file = std::fopen(path.c_str(), "w");
+    if (file == nullptr) {
+        throw std::runtime_error("ERROR::TRACING::CANNOT_OPEN_FILE\n");
+    }
+
+    // Complete events, timestamps and durations in microseconds
+    std::fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n", file);
+
+    size_t written = 0;
+    const char* separator = "";
+
+    for (auto& ring : r.rings) {
+        std::fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"lane %u\"}}",
+                     separator, ring->lane, ring->lane);
+        separator = ",\n";
+
+        uint64_t head = ring->head.load(std::memory_order_acquire);
+        uint64_t size = ring->events.size();
+        uint64_t first = (head > size) ? head - size : 0;
+
+        for (uint64_t k = first; k < head; ++k) {
+            const TraceEvent& event = ring->events[k & (size - 1)];
+            const char* phase = (event.end == event.begin) ? "i" : "X";
+
+            std::fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"%s\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f%s}",
+                         event.name, phase, ring->lane, static_cast<double>(event.begin) * 1e-3,
+                         static_cast<double>(event.end - event.begin) * 1e-3,
+                         (event.end == event.begin) ? ",\"s\":\"t\"" : "");
+            ++written;
+        }
+    }
+
+    std::fputs("\n]}\n", file);
+    std::fclose(file);
+
+    return written;
+}
@@ -0,0 +1,81 @@
+#ifndef TRACING_HPP
+#define TRACING_HPP
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+
+// Events kept per thread, older ones are overwritten once a ring is full
+constexpr size_t G_TRACE_BUFFER_EVENTS { 1 << 16 };
+
+
+/* Brief: Timeline of the physics stages per thread, written as Chrome trace JSON that
+          chrome://tracing and Perfetto open. Every thread records into its own ring buffer
+          with a single atomic store per event. The workers of the parallel_for pool and
+          the thread that starts tracing take their ring up front, so recording on them
+          never locks, other threads take one on their first event. Rings are handed back
+          when their thread exits and reused by the next one. Start, stop and write the
+          trace while no step runs. Compiled in with MECSIM_ENABLE_TRACING, recording is
+          off until start_tracing(). */
+
+void start_tracing(size_t events_per_thread = G_TRACE_BUFFER_EVENTS);
+void stop_tracing();
+bool tracing_active();
+
+// Gives the calling thread its ring now instead of on its first event
+void attach_trace_ring();
+
+// Returns the number of events written
+size_t write_chrome_trace(const std::string& path);
+
+
+// Nanoseconds since start_tracing()
+uint64_t trace_clock();
+void record_trace_event(const char* name, uint64_t begin, uint64_t end);
+
+
+class TraceScope
+{
+    private:
+        const char* m_name { nullptr };
+        uint64_t m_begin {};
+
+    public:
+        explicit TraceScope(const char* name)
+        {
+            if (tracing_active()) {
+                m_name = name;
+                m_begin = trace_clock();
+            }
+        }
+
+        ~TraceScope()
+        {
+            if (m_name != nullptr) {
+                record_trace_event(m_name, m_begin, trace_clock());
+            }
+        }
+
+        TraceScope(const TraceScope&) = delete;
+        TraceScope& operator=(const TraceScope&) = delete;
+};
+
+
+#ifdef MECSIM_ENABLE_TRACING
+
+#define MECSIM_TRACE_CONCAT_IMPL(a, b) a##b
+#define MECSIM_TRACE_CONCAT(a, b) MECSIM_TRACE_CONCAT_IMPL(a, b)
+
+#define MECSIM_TRACE_SCOPE(name) TraceScope MECSIM_TRACE_CONCAT(trace_scope_, __LINE__) { name }
+// Zero length event, for marking points such as a penetration retry
+#define MECSIM_TRACE_INSTANT(name) do { if (tracing_active()) { uint64_t now = trace_clock(); record_trace_event(name, now, now); } } while (0)
+
+#else
+
+#define MECSIM_TRACE_SCOPE(name) ((void)0)
+#define MECSIM_TRACE_INSTANT(name) ((void)0)
+
+#endif
+
+#endif
@@ -112,6 +112,8 @@ std::vector<double>& operator+=(std::vector<double>& v, const std::vector<double
 
 
 
+/* dot() and norm() sum strictly from the first element to the last, deterministic systems
+   rely on it. Keep them serial and free of reassociation (no -ffast-math). */
 double dot(const std::vector<double>& v, const std::vector<double>& w)
 {
     double result = 0;
@@ -3,6 +3,7 @@
 
 #include <cmath>
 #include <vector>
+#include <cstdint>
 #include <ranges>
 #include <algorithm>
 
@@ -45,6 +46,18 @@ inline bool is_convex(const vector2* vertices, size_t size)
 }
 
 
+inline double signed_area(const vector2* vertices, size_t size)
+{   
+    // Positive for counter-clockwise winding
+    double area = 0.0;
+    for (size_t i = 0; i < size; ++i) {
+        area += cross2d(vertices[i], vertices[(i + 1) % size]);
+    }
+
+    return 0.5 * area;
+}
+
+
 inline vector2 compute_centroid(vector2* vertices, size_t size) {
     double A = 0.0;
     double Cx = 0.0;
@@ -94,6 +107,27 @@ inline double moment_of_inertia_per_unit_mass_about_origin(const vector2* vertic
 }
 
 
+inline double rounded_moment_of_inertia_per_unit_mass(const vector2* vertices, size_t size, double radius)
+{   
+    /* Disc (one core vertex) or capsule (two core vertices), centred on the origin. The capsule
+       is split into its core rectangle and two half discs, each weighted by area. */
+    double r = radius;
+    if (size < 2) {
+        return 0.5 * r * r;
+    }
+
+    double hl = 0.5 * (vertices[1] - vertices[0]).norm();
+
+    double box_area  = 4 * hl * r;
+    double disc_area = M_PI * r * r;
+
+    double box_inertia  = (4 * hl * hl + 4 * r * r) / 12.0;
+    double caps_inertia = 0.5 * r * r + hl * hl + 2 * hl * 4 * r / (3 * M_PI);
+
+    return (box_area * box_inertia + disc_area * caps_inertia) / (box_area + disc_area);
+}
+
+
 inline void center_vertices_to_centroid(std::vector<vector2>& vertices) 
 {
     vector2 centroid = compute_centroid(vertices.data(), vertices.size());
@@ -137,6 +171,60 @@ inline double distance_to_edge(double angle, const vector2* vertices, size_t siz
     throw std::runtime_error("Ray does not intersect polygon");
 }
 
+inline double distance_to_rounded_edge(double angle, const vector2* vertices, size_t size, double radius) 
+{   
+    /* Distance from the origin to the boundary of a point or segment core swept by radius, 
+       along the ray of the given angle. Takes the furthest hit of the end discs and the 
+       offset sides of the segment. */
+    vector2 dir = { std::cos(angle), std::sin(angle) };
+    double t_max = 0;
+
+    for (size_t i = 0; i < size; ++i) {
+        vector2 p = vertices[i];
+        double dp = dir * p;
+        double disc = dp * dp - p * p + radius * radius;
+
+        if (disc >= 0) {
+            t_max = std::max(t_max, dp + std::sqrt(disc));
+        }
+    }
+
+    if (size == 2) {
+        vector2 edge = vertices[1] - vertices[0];
+        vector2 normal = normalize(perpendicular(edge));
+        double dn = dir * normal;
+
+        if (std::abs(dn) > 1e-12) {
+            for (double side : { -radius, radius }) {
+                double t = (normal * vertices[0] + side) / dn;
+                double s = (t * dir - vertices[0]) * edge / (edge * edge);
+
+                if (t > 0 && s >= 0 && s <= 1) {
+                    t_max = std::max(t_max, t);
+                }
+            }
+        }
+    }
+
+    return t_max;
+}
+
+inline uint32_t morton_code(uint16_t x, uint16_t y)
+{   
+    /* Interleaves the bits of x and y (x in the even bits), so sorting by the code walks a 
+       Z-order curve that keeps nearby points close together. */
+    auto spread = [](uint32_t v) -> uint32_t
+    {
+        v = (v | (v << 8)) & 0x00FF00FF;
+        v = (v | (v << 4)) & 0x0F0F0F0F;
+        v = (v | (v << 2)) & 0x33333333;
+        v = (v | (v << 1)) & 0x55555555;
+        return v;
+    };
+
+    return spread(x) | (spread(y) << 1);
+}
+
 std::vector<double>  operator*(double a, const std::vector<double>& v);
 std::vector<double>  operator*(const std::vector<float>& v, const std::vector<double>& w);
 std::vector<double>  operator*(const std::vector<double>& v, const std::vector<double>& w);
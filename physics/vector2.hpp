@@ -93,4 +93,10 @@ inline vector2 rotate(const vector2& v, double angle)
     return {v.x * cos(angle)- v.y * sin(angle), v.x * sin(angle) + v.y * cos(angle)};
 }
 
+
+inline vector2 rotate(const vector2& v, double cos_angle, double sin_angle) 
+{
+    return {v.x * cos_angle - v.y * sin_angle, v.x * sin_angle + v.y * cos_angle};
+}
+
 #endif
\ No newline at end of file